@@ -0,0 +1,48 @@
+/**
+ * Pack voltage sense and motor compensation.
+ *
+ * The pack is read on an analog pin through a divider and low-pass
+ * filtered, so motor current spikes do not move it. A DC motor's speed at a
+ * given duty falls roughly in proportion to the pack voltage, so every
+ * timed move (TURN_LEFT_MS, the 150 ms pulses in challenge2.c, ...) runs
+ * short as the pack drains. Two ways to hold it:
+ *  - batteryScalePwm(): scale a PWM command by nominal / measured, so the
+ *    motor sees the same average voltage (driveMotor());
+ *  - batteryScaleMs(): stretch a timed move by the same ratio, for drivers
+ *    whose enables are not on PWM pins or already run fully on.
+ * Tune the open-loop constants with the pack at UTRA_BATTERY_NOMINAL_MV. A
+ * full pack sits above it, so PWM is trimmed down and there is headroom to
+ * scale back up as it drains; a command already at 255 cannot be raised.
+ *
+ * Built with -DUTRA_BATTERY the sketches call batteryBegin(); until then,
+ * or with no divider fitted (reading below BATTERY_MIN_MV), both scale
+ * functions return their input.
+ */
+
+#ifndef UTRA_BATTERY_H
+#define UTRA_BATTERY_H
+
+#include <stdint.h>
+
+#ifndef UTRA_BATTERY_DIVIDER_X10
+#define UTRA_BATTERY_DIVIDER_X10 30    // (R1 + R2) / R2 x 10: 20k over 10k, up to 15 V
+#endif
+#ifndef UTRA_BATTERY_NOMINAL_MV
+#define UTRA_BATTERY_NOMINAL_MV 7200   // 2S pack, part drained
+#endif
+
+const uint16_t BATTERY_NOMINAL_MV = UTRA_BATTERY_NOMINAL_MV;
+const uint16_t BATTERY_MIN_MV = 5000;  // below: no pack on the divider
+const uint16_t BATTERY_SAMPLE_MS = 20;
+const uint8_t BATTERY_LOG_SAMPLES = 50; // batteryUpdate() reports once a second
+
+void batteryBegin(uint8_t pin);
+// Samples every BATTERY_SAMPLE_MS; call once per loop. Returns true once
+// every BATTERY_LOG_SAMPLES samples, when the reading is due in telemetry.
+bool batteryUpdate();
+// Filtered pack voltage, 0 until the first sample.
+uint16_t batteryMillivolts();
+int batteryScalePwm(int pwm);
+unsigned long batteryScaleMs(unsigned long ms);
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ * Microbenchmarks for the hot-path kernels: colour classification,
+ * echo-to-distance conversion, sensor filters, driveMotor() and state
+ * dispatch.
+ *
+ * The same table runs in two places:
+ *   - host: `program bench`, timed with steady_clock, results in ns
+ *   - Uno:  [env:uno_bench], timed with Timer1 at prescaler 1, results in
+ *           CPU cycles, printed over serial as the same JSON
+ * Each kernel takes a varying input index and returns a value that is folded
+ * into a volatile sink, so the compiler cannot hoist or drop the work. The
+ * cost of an empty kernel is subtracted from every result.
+ */
+
+#ifndef UTRA_BENCH_H
+#define UTRA_BENCH_H
+
+#include <stdint.h>
+
+typedef uint16_t (*BenchKernel)(uint16_t i);
+
+typedef struct {
+  const char *name;
+  BenchKernel fn;
+} BenchCase;
+
+typedef struct {
+  const char *name;
+  float perCall;          // benchUnit() per call, overhead removed
+  uint32_t iterations;    // calls per timed sample
+} BenchResult;
+
+typedef void (*BenchSink)(const BenchResult *result, void *ctx);
+
+const BenchCase *benchCases(uint8_t *count);
+// Runs every case whose name contains filter (NULL: all).
+void benchRunAll(const char *filter, BenchSink sink, void *ctx);
+const char *benchUnit();
+const char *benchTarget();
+
+#ifdef ARDUINO_ARCH_AVR
+// Runs everything and prints the JSON report over Serial.
+void benchPrintJson();
+#endif
+
+#endif
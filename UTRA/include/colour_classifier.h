@@ -0,0 +1,111 @@
+/**
+ * Integer colour classifiers for the TCS3200 pulse widths.
+ *
+ * ColourTracker follows ambient light: it keeps per-channel estimates of the
+ * white table and black tape widths, learnt from readings it is already
+ * sure of, rescales each reading to reflectance between those two and
+ * classifies on that, so a shift in lighting moves the references rather
+ * than the readings across a fixed threshold.
+ *
+ * A trained model is fitted on the host from labelled recordings (program
+ * train-colour, see src/host/colour_train.h) and generated as
+ * include/colour_model.h. Building with -DUTRA_COLOUR_MODEL compiles that
+ * header in as COLOUR_MODEL and the sketches' getColour() uses it instead of
+ * the black/white thresholds. Tables live in flash; classifying is a few
+ * 16x16-bit multiplies (linear models) or compares (trees), no floats.
+ *
+ * Every classifier also reports how sure it is (ColourReading), so control
+ * laws can steer by how far onto a colour the sensor is and state changes
+ * can ignore borderline readings.
+ */
+
+#ifndef UTRA_COLOUR_CLASSIFIER_H
+#define UTRA_COLOUR_CLASSIFIER_H
+
+#include <stdint.h>
+
+const uint16_t COLOUR_WIDTH_MAX = 16383;   // widths are clamped so scores fit in 32 bits
+
+// Same numbering as the sketches' PathColour.
+typedef enum {
+  COLOUR_WHITE = 0,
+  COLOUR_RED = 1,
+  COLOUR_GREEN = 2,
+  COLOUR_BLUE = 3,
+  COLOUR_BLACK = 4
+} ColourClass;
+
+// Margin to the nearest class boundary in Q8, as a fraction of the pulse
+// width (or of full reflectance for the adaptive classifier); confidence
+// saturates once the margin reaches a quarter.
+const uint8_t COLOUR_FULL_MARGIN_Q8 = 64;
+
+typedef struct {
+  uint8_t colour;         // ColourClass
+  uint8_t confidence;     // 0 = on a class boundary .. 255 = solidly inside
+  uint8_t share[3];       // red, green, blue share of the light, Q8 (255 = all)
+} ColourReading;
+
+// The sketches' hand-set rule: black when every width is above blackUs,
+// white when every width is below whiteUs, else the channel with the
+// shortest pulse (the most light), red winning ties.
+void colourReadThresholds(uint16_t red, uint16_t green, uint16_t blue, uint16_t whiteUs,
+                          uint16_t blackUs, ColourReading *out);
+
+// ========== Adaptive white/black references ==========
+const uint16_t COLOUR_REFLECTANCE_ONE = 256;   // Q8: the white reference; 0 = black
+
+typedef struct {
+  uint16_t whiteQ4[3];    // pulse width over the white table, us in Q4, per channel
+  uint16_t blackQ4[3];    // over black tape
+} ColourTracker;
+
+// Starts the references at the given widths (e.g. the hand-set thresholds);
+// they settle on the real levels within a few confident readings.
+void colourTrackerBegin(ColourTracker *t, uint16_t whiteUs, uint16_t blackUs);
+// Reflectance of each channel in Q8, from frequency (1 / width), clamped to
+// 0..COLOUR_REFLECTANCE_ONE. A width of 0 (timeout) reads as black.
+void colourNormalize(const ColourTracker *t, const uint16_t width[3], uint16_t reflectance[3]);
+// Classifies on reflectance, then moves the white or black reference
+// toward the reading when it is clearly that surface.
+void colourReadAdaptive(ColourTracker *t, uint16_t red, uint16_t green, uint16_t blue, ColourReading *out);
+uint8_t colourClassifyAdaptive(ColourTracker *t, uint16_t red, uint16_t green, uint16_t blue);
+
+// ========== Trained models ==========
+
+// One class of a linear model: score = bias + sum(weight[c] * width[c]);
+// the highest score wins. Covers nearest-centroid and Mahalanobis models.
+typedef struct {
+  int16_t weight[3];      // red, green, blue
+  int32_t bias;
+} ColourLinearTerm;
+
+// Decision tree node: width[channel] < threshold goes to below, else above.
+// A child >= 0 is a node index; a negative child ~k is a leaf for class k.
+typedef struct {
+  uint8_t channel;        // 0 red, 1 green, 2 blue
+  uint16_t threshold;
+  int8_t below, above;
+} ColourTreeNode;
+
+typedef struct {
+  uint8_t classes;
+  const uint8_t *labels;            // PathColour value per class
+  const ColourLinearTerm *linear;   // one term per class, or NULL
+  const ColourTreeNode *tree;       // root first, or NULL
+} ColourModel;
+
+// Class index (not label) the model picks for these pulse widths.
+uint8_t colourModelClass(const ColourModel *model, uint16_t red, uint16_t green, uint16_t blue);
+// PathColour value the model picks.
+uint8_t colourClassify(const ColourModel *model, uint16_t red, uint16_t green, uint16_t blue);
+// Confidence from the distance to the nearest threshold on the tree path,
+// or between the two best linear scores.
+void colourReadModel(const ColourModel *model, uint16_t red, uint16_t green, uint16_t blue,
+                     ColourReading *out);
+
+#ifdef UTRA_COLOUR_MODEL
+extern const ColourModel COLOUR_MODEL;
+#endif
+
+#endif
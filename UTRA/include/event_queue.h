@@ -0,0 +1,61 @@
+/**
+ * Interrupt-to-loop event queues.
+ *
+ * One EventQueue per interrupt source (colour edge, echo, each encoder):
+ * that ISR is the only producer and loop() the only consumer, so neither
+ * side needs to disable interrupts. Each side owns one 8-bit index, which
+ * the AVR loads and stores in a single instruction, so the other side never
+ * sees it half-written; the event record itself is only read after the
+ * index that publishes it. This replaces handing multi-byte values through
+ * globals (redPW, duration), which loop() can read torn if the ISR fires in
+ * the middle of the read.
+ *
+ * Indices run free and wrap at 256; EVENT_QUEUE_SIZE is a power of two up
+ * to 128.
+ * A full queue drops the new event and counts it.
+ *
+ * Host stress check: program event-stress (src/host/event_stress.h).
+ */
+
+#ifndef UTRA_EVENT_QUEUE_H
+#define UTRA_EVENT_QUEUE_H
+
+#include <stdint.h>
+
+#ifndef UTRA_EVENT_QUEUE_SIZE
+#define UTRA_EVENT_QUEUE_SIZE 16
+#endif
+
+const uint8_t EVENT_QUEUE_SIZE = UTRA_EVENT_QUEUE_SIZE;
+
+typedef enum {
+  EVENT_EDGE = 0,       // value: level after the edge
+  EVENT_PULSE = 1,      // value: width in us (TCS3200 half period, HC-SR04 echo)
+  EVENT_ENCODER = 2     // value: signed tick count since the last event
+} EventType;
+
+typedef struct {
+  uint8_t type;         // EventType
+  uint8_t source;       // pin, or encoder number
+  uint16_t value;
+  uint32_t tUs;         // micros() in the ISR
+} Event;
+
+typedef struct {
+  uint8_t head;         // next slot to write; producer only
+  uint8_t tail;         // next slot to read; consumer only
+  uint8_t dropped;      // events lost to a full queue, wraps; producer only
+  Event slots[UTRA_EVENT_QUEUE_SIZE];
+} EventQueue;
+
+void eventQueueInit(EventQueue *q);
+// Producer (ISR) side. Returns false, and counts a drop, when full.
+bool eventPush(EventQueue *q, const Event *e);
+// Consumer (loop) side. Returns false when empty.
+bool eventPop(EventQueue *q, Event *e);
+uint8_t eventPending(const EventQueue *q);
+// Drops since the last call for this queue; *seen is the caller's copy of
+// the producer's counter.
+uint8_t eventDroppedSince(const EventQueue *q, uint8_t *seen);
+
+#endif
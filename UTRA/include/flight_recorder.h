@@ -0,0 +1,65 @@
+/**
+ * On-board flight recorder.
+ * Keeps the last UTRA_RECORDER_SLOTS sensor/line/state records in a RAM ring,
+ * in exactly the payload format of the live telemetry, so a run can be recovered
+ * without the USB cable attached. Recording is a 13-byte copy per record.
+ *
+ * The ring is 16 slots (208 B) by default: on the Uno's 2 KB it sits next to
+ * Serial's 128 B of buffers and telemetry's 256 B of rings, and the main
+ * build still has to leave room for the stack. Every state record goes in,
+ * but sensor frames only one per UTRA_RECORDER_RAM_INTERVAL_MS (200 ms), so
+ * the ring holds about RECORDER_RAM_SPAN_MS (3.2 s) rather than the last
+ * fraction of a second of colour reads. Raise UTRA_RECORDER_SLOTS on a build
+ * with RAM to spare, or rely on the EEPROM log for the whole run.
+ *
+ * With -DUTRA_RECORDER_EEPROM a decimated copy is also spilled to EEPROM as a
+ * circular log that survives power-off. Slots are written one byte per tick
+ * when the EEPROM is idle (never waiting on the ~3.3 ms write), and the log
+ * head rotates across the whole EEPROM between runs for wear levelling. Each
+ * slot carries a CRC-16 over its sequence byte and record; a dump skips
+ * slots that fail it (torn by power loss, or worn out).
+ *
+ * Serial commands (after the run, via serialCommandPoll()):
+ *   dump          all RAM records
+ *   dump <s>      RAM records from the last <s> seconds; anything past
+ *                 RECORDER_RAM_SPAN_MS is the whole ring
+ *   dump eeprom   the EEPROM log, oldest first
+ * Each dump is DUMP_BEGIN (record count; an upper bound for EEPROM), the
+ * records, DUMP_END - the bridge attaches the records to runs.telemetry.
+ */
+
+#ifndef UTRA_FLIGHT_RECORDER_H
+#define UTRA_FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include "telemetry.h"
+
+#ifndef UTRA_RECORDER_SLOTS
+#define UTRA_RECORDER_SLOTS 16
+#endif
+
+#ifndef UTRA_RECORDER_RAM_INTERVAL_MS
+#define UTRA_RECORDER_RAM_INTERVAL_MS 200
+#endif
+
+#ifndef UTRA_RECORDER_EEPROM_INTERVAL_MS
+#define UTRA_RECORDER_EEPROM_INTERVAL_MS 250
+#endif
+
+const uint8_t RECORDER_RECORD_LEN = TELEMETRY_SENSOR_LEN;  // largest telemetry payload we keep
+// How far back the RAM ring reaches with no state changes in between.
+const uint32_t RECORDER_RAM_SPAN_MS = (uint32_t)UTRA_RECORDER_SLOTS * UTRA_RECORDER_RAM_INTERVAL_MS;
+
+typedef enum {
+  RECORDER_SOURCE_RAM = 0,
+  RECORDER_SOURCE_EEPROM = 1
+} RecorderSource;
+
+// Registers the telemetry tap and the "dump" command.
+void flightRecorderBegin();
+void flightRecorderLog(const uint8_t *payload, uint8_t len);
+// Advances the EEPROM spill by at most one byte; call once per loop.
+void flightRecorderTick();
+void flightRecorderDump(uint32_t lastMs, RecorderSource source);
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * Hardware abstraction layer.
+ * The small set of board services the firmware uses: GPIO, PWM, pulse timing,
+ * servo, clock and serial. Two backends implement it:
+ *  - hal_avr.cpp   forwards to the Arduino core on the Uno (-DUTRA_HAL_AVR;
+ *                  the sketches still call the core directly)
+ *  - host/hal_host.cpp   plain C++ for [env:native], with hooks for simulated
+ *                        sensors and actuators (see host/hal_host.h)
+ * On the host, host/Arduino.h and host/Servo.h map the Arduino API onto this
+ * interface, so the sketches compile unmodified in both environments.
+ */
+
+#ifndef UTRA_HAL_H
+#define UTRA_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+const uint8_t HAL_SERVO_MAX = 4;
+
+// --- GPIO / PWM ---
+void halPinMode(uint8_t pin, uint8_t mode);
+void halDigitalWrite(uint8_t pin, uint8_t value);
+int halDigitalRead(uint8_t pin);
+int halAnalogRead(uint8_t pin);
+void halAnalogWrite(uint8_t pin, int value);
+
+// --- Pulse timing ---
+unsigned long halPulseIn(uint8_t pin, uint8_t state, unsigned long timeoutUs);
+
+// --- Clock ---
+unsigned long halMillis();
+unsigned long halMicros();
+void halDelay(unsigned long ms);
+void halDelayMicroseconds(unsigned int us);
+
+// --- Servo ---
+// Returns a channel for halServoWrite, or -1 when all channels are in use.
+int halServoAttach(uint8_t pin);
+void halServoWrite(int channel, int degrees);
+
+// --- Serial ---
+void halSerialBegin(unsigned long baud);
+size_t halSerialWrite(const uint8_t *data, size_t len);
+int halSerialAvailableForWrite();
+int halSerialAvailable();
+int halSerialRead();
+
+#endif
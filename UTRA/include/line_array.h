@@ -0,0 +1,48 @@
+/**
+ * Analog IR reflectance array (QTR-style, up to 8 channels on the analog
+ * pins) for line position.
+ *
+ * The TCS3200 spot only says whether the robot is on the line; the array
+ * says where the line is across the robot's nose, so a follower can steer
+ * in proportion instead of bang-bang. One scan is one analogRead() per
+ * channel (about 110 us each on the Uno) and the estimate is integer only:
+ * each channel's coverage in Q8 between the floor and line levels, then the
+ * coverage-weighted centroid. Colour identity still comes from the TCS3200.
+ *
+ * Channels are listed left to right; the sensor reads higher over the
+ * (darker) line than over the floor.
+ */
+
+#ifndef UTRA_LINE_ARRAY_H
+#define UTRA_LINE_ARRAY_H
+
+#include <stdint.h>
+
+const uint8_t LINE_ARRAY_MAX = 8;
+const uint16_t LINE_PITCH_Q8 = 256;   // one channel spacing in the position units
+
+typedef struct {
+  const uint8_t *pins;    // left to right
+  uint8_t count;
+  uint16_t floorRaw;      // ADC reading over the floor
+  uint16_t lineRaw;       // ... and squarely over the line
+  int16_t lastPosition;   // where the line was last seen, for when it is lost
+} LineArray;
+
+typedef struct {
+  // Centroid from the array centre in Q8 channel pitches, + = right. When
+  // the line is lost, the outermost channel on the side it was last seen.
+  int16_t position;
+  // Line under the array in Q8 channel pitches; 0 = no line seen.
+  uint16_t width;
+} LineReading;
+
+void lineArrayBegin(LineArray *a, const uint8_t *pins, uint8_t count, uint16_t floorRaw,
+                    uint16_t lineRaw);
+// One analogRead() per channel, left to right.
+void lineArrayScan(const LineArray *a, uint16_t raw[]);
+// Position and width from one scan's raw readings.
+void lineArrayEstimate(LineArray *a, const uint16_t raw[], LineReading *out);
+void lineArrayRead(LineArray *a, LineReading *out);
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * Building blocks for running sensors and control at their own rates.
+ *
+ * SampleSlot holds the latest timestamped sample from one producer for one
+ * consumer, without locks: the producer bumps a sequence number to odd
+ * before writing and back to even after, and the consumer copies until it
+ * sees the same even number on both sides of the copy. The consumer gets
+ * the freshest value, its timestamp (so its age) and the sequence number,
+ * which tells a new sample from one it has already used. The producer may
+ * be an interrupt; the consumer must be the side that can be interrupted.
+ *
+ * RateTask decides when a periodic task is due, from micros(), without
+ * bursting to catch up after an overrun.
+ */
+
+#ifndef UTRA_PIPELINE_H
+#define UTRA_PIPELINE_H
+
+#include <stdint.h>
+
+#define PIPELINE_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+template <class T>
+struct SampleSlot {
+  volatile uint8_t seq;   // odd while being written; 0 = never written
+  uint32_t tUs;           // micros() when the sample was taken
+  T value;
+};
+
+template <class T>
+void slotPublish(SampleSlot<T> *slot, const T &value, uint32_t tUs) {
+  slot->seq++;
+  PIPELINE_BARRIER();
+  slot->value = value;
+  slot->tUs = tUs;
+  PIPELINE_BARRIER();
+  slot->seq++;
+  if (slot->seq == 0) slot->seq = 2;   // 0 stays "never written"
+}
+
+// Copies the latest sample and returns its sequence number, 0 when nothing
+// has been published yet (value and tUs are then left alone).
+template <class T>
+uint8_t slotRead(const SampleSlot<T> *slot, T *value, uint32_t *tUs) {
+  uint8_t before, after;
+  do {
+    before = slot->seq;
+    if (before == 0) return 0;
+    PIPELINE_BARRIER();
+    *value = slot->value;
+    *tUs = slot->tUs;
+    PIPELINE_BARRIER();
+    after = slot->seq;
+  } while (before != after || (before & 1));
+  return before;
+}
+
+typedef struct {
+  uint32_t periodUs;
+  uint32_t nextUs;        // 0 = due on the first call
+} RateTask;
+
+inline bool rateDue(RateTask *task, uint32_t nowUs) {
+  if (task->nextUs != 0 && (int32_t)(nowUs - task->nextUs) < 0) return false;
+  task->nextUs += task->periodUs;
+  // More than a period late: restart the schedule from now.
+  if ((int32_t)(nowUs - task->nextUs) >= 0) task->nextUs = nowUs + task->periodUs;
+  return true;
+}
+
+#endif
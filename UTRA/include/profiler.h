@@ -0,0 +1,72 @@
+/**
+ * Loop-timing profiler.
+ * Build with -DUTRA_PROFILE to enable; otherwise every macro expands to
+ * nothing and the firmware is byte-for-byte unchanged.
+ *
+ *   PROFILE_SCOPE("colour");   // times the rest of the enclosing block
+ *   PROFILE_LOOP_TICK();       // first line of loop(): period + jitter
+ *   PROFILER_BEGIN();          // in setup(): registers the "prof" command
+ *
+ * Each call site keeps count, total, max and a log2 histogram of micros()
+ * (bucket b holds durations in [2^(b-1), 2^b) us). micros() is used rather
+ * than Timer1 because the Servo library owns Timer1 on the Uno.
+ *
+ * "prof" over serial sends one PROFILE_SITE and two PROFILE_BUCKETS records
+ * per site; "prof reset" clears all counters.
+ */
+
+#ifndef UTRA_PROFILER_H
+#define UTRA_PROFILER_H
+
+#include <stdint.h>
+
+const uint8_t PROFILE_BUCKETS = 16;
+const uint8_t PROFILE_NAME_LEN = 8;   // names are truncated to this in dumps
+
+#ifdef UTRA_PROFILE
+
+#include <Arduino.h>
+
+typedef struct ProfileSite {
+  const char *name;
+  struct ProfileSite *next;
+  bool registered;
+  uint32_t count;
+  uint32_t totalUs;
+  uint32_t maxUs;
+  uint16_t buckets[PROFILE_BUCKETS];
+} ProfileSite;
+
+void profileRecord(ProfileSite *site, uint32_t us);
+void profilerLoopTick();
+void profilerBegin();
+void profilerReset();
+void profilerDump();
+
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfileSite *site) : site_(site), startUs_(micros()) {}
+  ~ProfileScope() { profileRecord(site_, micros() - startUs_); }
+
+ private:
+  ProfileSite *site_;
+  uint32_t startUs_;
+};
+
+#define UTRA_PROF_CAT2(a, b) a##b
+#define UTRA_PROF_CAT(a, b) UTRA_PROF_CAT2(a, b)
+#define PROFILE_SCOPE(name)                                                     \
+  static ProfileSite UTRA_PROF_CAT(profSite_, __LINE__) = { name, NULL, false, 0, 0, 0, {0} }; \
+  ProfileScope UTRA_PROF_CAT(profScope_, __LINE__)(&UTRA_PROF_CAT(profSite_, __LINE__))
+#define PROFILE_LOOP_TICK() profilerLoopTick()
+#define PROFILER_BEGIN() profilerBegin()
+
+#else
+
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_LOOP_TICK() do {} while (0)
+#define PROFILER_BEGIN() do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * Ramp state estimator for Challenge One Stage 2.
+ * Tracks where the robot is on the ramp (base -> climb -> mid -> crest) from:
+ *  - black-tape dwell time (the ramp is marked with black lines)
+ *  - commanded PWM integrated into expected travel, compared to the ramp length
+ *    and against what is observed: travel well past the ramp length with the
+ *    ramp still under the robot (still pitched up, or still on the lines) is
+ *    slip, and the throttle goes back to climbing instead of braking
+ *  - pitch from an optional accelerometer
+ * The accelerometer is read through a function pointer so the MPU-6050 driver
+ * and the simulated stand-in used on the host are interchangeable.
+ */
+
+#ifndef UTRA_RAMP_ESTIMATOR_H
+#define UTRA_RAMP_ESTIMATOR_H
+
+#include <stdint.h>
+
+typedef enum {
+  RAMP_PHASE_APPROACH = 0,  // black seen, not climbing yet
+  RAMP_PHASE_CLIMB = 1,     // on the incline, building speed
+  RAMP_PHASE_MID = 2,       // steady climb
+  RAMP_PHASE_CREST = 3,     // near the top: brake before the platform
+  RAMP_PHASE_TOP = 4        // level again at the top
+} RampPhase;
+
+// Returns false when no sample is available. Units are raw counts with
+// RAMP_ACCEL_1G counts per g along the robot's forward (x) and up (z) axes.
+typedef bool (*RampAccelReader)(int16_t *ax, int16_t *az);
+
+const int16_t RAMP_ACCEL_1G = 16384;  // MPU-6050 at +/-2 g
+
+typedef struct {
+  RampPhase phase;
+  unsigned long phaseStartMs;
+  unsigned long lastUpdateMs;
+  unsigned long blackDwellMs;   // time on black tape since the ramp base
+  unsigned long offBlackMs;     // current stretch off black
+  long travelUm;                // commanded travel while on black, um so low PWM still adds up
+  long slipBaseUm;              // travelUm when progress was last seen (see rampEstimatorRebaseline)
+  int pitchDeg10;               // filtered pitch, tenths of a degree (0 if no accel)
+  bool pitchValid;
+  bool slipping;                // commanded travel not matched by observed progress
+  RampAccelReader readAccel;
+} RampEstimator;
+
+void rampEstimatorBegin(RampEstimator *est, unsigned long nowMs, RampAccelReader reader);
+void rampEstimatorUpdate(RampEstimator *est, unsigned long nowMs, bool onBlack, int commandedPwm);
+int rampThrottle(const RampEstimator *est, int rampSpeed);
+bool rampIsAtTop(const RampEstimator *est);
+bool rampIsSlipping(const RampEstimator *est);
+// A stall back-off ended and the robot is driving again: clears the slip
+// verdict, and judges the retry on the commanded travel from here.
+void rampEstimatorRebaseline(RampEstimator *est);
+
+#ifdef UTRA_RAMP_ACCEL_MPU6050
+bool mpu6050Begin();
+bool mpu6050ReadAccel(int16_t *ax, int16_t *az);
+#endif
+
+// Host/simulator stand-in: returns whatever pitch was last set, or no
+// sample at all when not fitted (program --no-accel), which leaves the
+// estimator on its no-accelerometer path.
+void simulatedAccelSetPitch(float degrees);
+void simulatedAccelSetFitted(bool fitted);
+bool simulatedAccelRead(int16_t *ax, int16_t *az);
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * One control-loop worth of raw sensor readings.
+ * Shared by telemetry, logging and host tools so they agree on units.
+ */
+
+#ifndef UTRA_SENSOR_FRAME_H
+#define UTRA_SENSOR_FRAME_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t tMs;          // millis() when the colour read started
+  uint16_t redPW;        // TCS3200 pulse widths, us (0 = timeout)
+  uint16_t greenPW;
+  uint16_t bluePW;
+  uint16_t distanceCm;   // HC-SR04, 9999 = no echo
+  uint8_t colour;        // PathColour
+  int16_t linePos;       // reflectance array (line_array.h), Q8 channel pitches, + = right
+  uint16_t lineWidth;    // Q8 channel pitches, 0 = no line or no array
+} SensorFrame;
+
+#endif
@@ -0,0 +1,19 @@
+/**
+ * Tiny line-based command reader for post-run commands ("dump", "prof", ...).
+ * Polling only copies bytes that have already arrived, so it is safe to call
+ * every loop during a run.
+ */
+
+#ifndef UTRA_SERIAL_COMMAND_H
+#define UTRA_SERIAL_COMMAND_H
+
+// args points at the text after the command name (leading spaces skipped).
+typedef void (*SerialCommandHandler)(const char *args);
+
+const int SERIAL_COMMAND_MAX = 6;
+const int SERIAL_COMMAND_LINE = 24;
+
+bool serialCommandRegister(const char *name, SerialCommandHandler handler);
+void serialCommandPoll();
+
+#endif
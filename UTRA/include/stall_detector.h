@@ -0,0 +1,80 @@
+/**
+ * Stall and wheel-slip detector: "driving, but not getting anywhere".
+ *
+ * The wheels are commanded forward and nothing says the robot moved: stuck
+ * on the ramp at RAMP_SPEED, or pushing into an obstacle. Progress is any
+ * of the evidence the robot has:
+ *  - colour sequence: the reading changed (stallNoteColour);
+ *  - range: the distance ahead moved by STALL_RANGE_STEP_CM (stallNoteRange);
+ *  - encoders, when fitted: any tick (stallNoteTicks);
+ *  - the caller's own word that it is moving (stallNoteMoving).
+ * Colour and range only change every few centimetres, so windowMs has to
+ * cover the longest plain stretch; once an encoder tick has been seen the
+ * window drops to STALL_ENCODER_MS. Two signals are a stall by themselves
+ * once held, without waiting out the window:
+ *  - motor current, when fitted: stalled motors draw their stall current
+ *    (stallNoteCurrent, STALL_CURRENT_MS);
+ *  - another estimator's slip verdict, such as the ramp estimator's
+ *    commanded vs observed travel (stallNoteSlipping, STALL_SLIP_MS).
+ *
+ * On a stall stallUpdate() runs a back-off for backoffMs, then hands the
+ * wheels back with retries counted; stallRetryPwm() adds torque per retry.
+ * Progress a whole window after the back-off means the retry worked, and
+ * the count starts again. After maxRetries it stops watching and leaves the
+ * robot to what it was doing. Call stallBegin() on entering each state that
+ * drives.
+ */
+
+#ifndef UTRA_STALL_DETECTOR_H
+#define UTRA_STALL_DETECTOR_H
+
+#include <stdint.h>
+
+const int STALL_RANGE_STEP_CM = 3;          // more than HC-SR04 jitter
+const unsigned long STALL_ENCODER_MS = 250;
+const unsigned long STALL_CURRENT_MS = 200;
+const unsigned long STALL_SLIP_MS = 200;
+
+typedef enum {
+  STALL_PHASE_WATCH = 0,    // driving, watching for progress
+  STALL_PHASE_BACK_OFF = 1, // reversing away from whatever holds it
+  STALL_PHASE_OFF = 2       // out of retries
+} StallPhase;
+
+typedef struct {
+  StallPhase phase;
+  unsigned long phaseStartMs;
+  unsigned long progressMs;     // last progress, or when driving started
+  unsigned long tickMs;         // last encoder tick
+  unsigned long overCurrentMs;  // start of the current stretch over the limit
+  unsigned long slipMs;         // start of the current slip verdict
+  bool driving;
+  bool hasEncoders;
+  bool overCurrent;
+  bool slipping;
+  bool hasColour;
+  uint8_t colour;
+  int rangeCm;                  // at the last progress mark, -1 until seen
+  uint8_t retries;
+  uint8_t maxRetries;
+  unsigned long windowMs;
+  unsigned long backoffMs;
+} StallDetector;
+
+void stallBegin(StallDetector *d, unsigned long nowMs, unsigned long windowMs,
+                unsigned long backoffMs, uint8_t maxRetries);
+void stallNoteColour(StallDetector *d, unsigned long nowMs, uint8_t colour);
+// cm <= 0 is no echo and is ignored.
+void stallNoteRange(StallDetector *d, unsigned long nowMs, int cm);
+void stallNoteTicks(StallDetector *d, unsigned long nowMs, int ticks);
+// moving: the caller's own evidence says the robot is getting somewhere.
+void stallNoteMoving(StallDetector *d, unsigned long nowMs, bool moving);
+void stallNoteCurrent(StallDetector *d, unsigned long nowMs, uint16_t mA, uint16_t limitMa);
+// slipping: another estimator says the commanded motion is not happening.
+void stallNoteSlipping(StallDetector *d, unsigned long nowMs, bool slipping);
+// Once per control step; driving is whether the wheels are commanded
+// forward. Returns true while the caller should be backing off.
+bool stallUpdate(StallDetector *d, unsigned long nowMs, bool driving);
+int stallRetryPwm(const StallDetector *d, int pwm, int stepPwm);
+
+#endif
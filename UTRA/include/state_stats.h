@@ -0,0 +1,56 @@
+/**
+ * Per-state time accounting for the challenge state machines.
+ * Each machine owns a StateTime table indexed by its state enum; transitions
+ * go through stateStatsEnter(). When the machine reaches its final state,
+ * stateStatsFinish() sends one RUN_SUMMARY record followed by a STATE_TIME
+ * record per state that was entered:
+ *
+ *   RUN_SUMMARY: u8 type | u8 machine | u32 completionTimeMs | u8 resets
+ *   STATE_TIME:  u8 type | u8 machine | u8 state | u16 entries
+ *                | u32 totalMs | u32 longestMs
+ *
+ * completionTimeMs and resets map onto obstacleScoring.completionTimeMs and
+ * obstacleScoring.resets in the runs schema.
+ */
+
+#ifndef UTRA_STATE_STATS_H
+#define UTRA_STATE_STATS_H
+
+#include <stdint.h>
+
+typedef enum {
+  STATE_MACHINE_CHALLENGE_ONE = 1,   // ChallengeOneState
+  STATE_MACHINE_CHALLENGE_TWO = 2,   // ChallengeTwoState (part two)
+  STATE_MACHINE_OBSTACLE = 3,        // RobotState (obstacle course)
+  STATE_MACHINE_CHALLENGE2 = 4       // RobotState (challenge2.c)
+} StateMachineId;
+
+typedef struct {
+  uint32_t totalMs;
+  uint32_t longestMs;
+  uint16_t entries;
+} StateTime;
+
+typedef struct {
+  StateTime *slots;
+  uint8_t count;
+  uint8_t machine;
+  uint8_t current;
+  uint32_t enteredMs;
+  uint32_t runStartMs;
+  bool finished;
+} StateStats;
+
+void stateStatsBegin(StateStats *stats, uint8_t machine, StateTime *slots, uint8_t count,
+                     uint8_t initial, uint32_t nowMs);
+void stateStatsEnter(StateStats *stats, uint8_t state, uint32_t nowMs);
+// Closes the current stay and emits the summary once; later calls do nothing.
+void stateStatsFinish(StateStats *stats, uint32_t nowMs);
+uint32_t stateStatsElapsed(const StateStats *stats, uint32_t nowMs);
+// The machine that most recently began or changed state (NULL before any).
+const StateStats *stateStatsActive();
+
+// Resets (reset button / watchdog) since power-on; see state_stats.cpp.
+uint8_t stateStatsResetCount();
+
+#endif
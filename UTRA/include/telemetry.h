@@ -0,0 +1,113 @@
+/**
+ * Binary telemetry over Serial.
+ * Every record is a small fixed-size payload + CRC-16/CCITT, COBS-encoded and
+ * terminated with 0x00, so the bridge can resync on any zero byte and drop
+ * frames that fail the CRC.
+ *
+ * Sensor record (13 bytes + CRC = 15, 17 on the wire):
+ *   u8 type | u8 state | u16 t (ms, wraps) | u16 R | u16 G | u16 B (us, as read)
+ *   | u8 colour | u16 distanceCm
+ * The widths go out whole: black tape reads well past 255 us, and replay
+ * and colour training (train-colour) work from the recorded widths.
+ * Line record (8 bytes + CRC), right after a sensor record whose frame has
+ * a reflectance array reading (-DUTRA_LINE_ARRAY):
+ *   u8 type | u8 state | u16 t (ms, wraps) | i16 linePos | u16 lineWidth
+ *   (Q8 channel pitches, see line_array.h)
+ * State record (7 bytes + CRC):
+ *   u8 type | u8 state | u32 t (ms) | u8 machine (StateMachineId, state_stats.h)
+ *   The timestamp also anchors the wrapping sensor timestamps; the machine
+ *   tells apart state numbers of sketches that run in one build (main.cpp's
+ *   challenge one and part two).
+ * Battery record (6 bytes + CRC), about once a second (battery.h):
+ *   u8 type | u8 0 | u16 t (ms, wraps) | u16 filtered pack voltage (mV)
+ * All multi-byte fields are little-endian.
+ *
+ * Frames never go straight to Serial. They are queued in static rings and
+ * handed to HardwareSerial (whose UDRE interrupt does the actual shifting)
+ * only when its 64-byte buffer has room for a whole frame, so a send call
+ * does not wait on the UART. Samples drop oldest-first when their ring is full.
+ * Critical records (state changes, dumps) have their own ring; when it is
+ * full a send waits at most a few milliseconds for the UART to make room,
+ * then drops the oldest critical frame and counts it.
+ */
+
+#ifndef UTRA_TELEMETRY_H
+#define UTRA_TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensor_frame.h"
+
+#ifndef UTRA_TELEMETRY_BAUD
+#define UTRA_TELEMETRY_BAUD 115200
+#endif
+
+typedef enum {
+  TELEMETRY_HELLO = 0x01,
+  TELEMETRY_SENSOR = 0x02,
+  TELEMETRY_STATE = 0x03,
+  TELEMETRY_BATTERY = 0x04,
+  TELEMETRY_LINE = 0x05,
+  TELEMETRY_DUMP_BEGIN = 0x10,   // u8 type | u8 source | u16 count
+  TELEMETRY_DUMP_END = 0x11,     // u8 type | u8 source
+  TELEMETRY_PROFILE_SITE = 0x20,     // see profiler.cpp
+  TELEMETRY_PROFILE_BUCKETS = 0x21,
+  TELEMETRY_RUN_SUMMARY = 0x30,      // see state_stats.h
+  TELEMETRY_STATE_TIME = 0x31
+} TelemetryRecordType;
+
+// Sees every sensor/state payload before it is framed (flight recorder hook).
+typedef void (*TelemetryTap)(const uint8_t *payload, uint8_t len);
+
+typedef enum {
+  TELEMETRY_PRIO_SAMPLE = 0,    // droppable, newest wins
+  TELEMETRY_PRIO_CRITICAL = 1   // never dropped
+} TelemetryPriority;
+
+#ifndef UTRA_TELEMETRY_SAMPLE_RING
+#define UTRA_TELEMETRY_SAMPLE_RING 192
+#endif
+#ifndef UTRA_TELEMETRY_CRITICAL_RING
+#define UTRA_TELEMETRY_CRITICAL_RING 64
+#endif
+
+typedef struct {
+  uint16_t samplesDropped;     // sample frames evicted to make room
+  uint16_t criticalStalls;     // critical ring full, had to wait for the UART
+  uint16_t criticalDropped;    // ... and the wait ran out: oldest critical frame evicted
+  uint16_t samplesQueued;
+  uint16_t criticalQueued;
+} TelemetryStats;
+
+const uint8_t TELEMETRY_SENSOR_LEN = 13;
+const uint8_t TELEMETRY_STATE_LEN = 7;
+const uint8_t TELEMETRY_LINE_LEN = 8;
+const uint8_t TELEMETRY_BATTERY_LEN = 6;
+const uint8_t TELEMETRY_MAX_PAYLOAD = 32;
+// COBS adds one byte per 254, plus the 0x00 delimiter
+const uint8_t TELEMETRY_MAX_FRAME = TELEMETRY_MAX_PAYLOAD + 2 + 2;
+
+void telemetryBegin(unsigned long baud = UTRA_TELEMETRY_BAUD);
+void telemetrySendSensor(const SensorFrame *frame, uint8_t state);
+void telemetrySendState(uint8_t machine, uint8_t state, uint32_t tMs);
+void telemetrySendBattery(uint16_t millivolts, uint32_t tMs);
+void telemetrySendRecord(const uint8_t *payload, uint8_t len,
+                         TelemetryPriority prio = TELEMETRY_PRIO_SAMPLE);
+// Moves queued frames into the UART buffer; call once per loop.
+void telemetryPump();
+// Blocks until both rings are empty; for post-run dumps only.
+void telemetryFlush();
+void telemetrySetTap(TelemetryTap tap);
+#ifdef UTRA_HOST
+// A second tap for host tools (trace replay), beside the flight recorder's.
+void telemetrySetHostTap(TelemetryTap tap);
+#endif
+const TelemetryStats *telemetryStats();
+
+// Packing helpers, exposed so host tools can build/parse identical records.
+uint8_t telemetryPackSensor(uint8_t *out, const SensorFrame *frame, uint8_t state);
+uint8_t telemetryPackLine(uint8_t *out, const SensorFrame *frame, uint8_t state);
+uint16_t telemetryCrc16(const uint8_t *data, size_t len);
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out);
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * Tuning constants the host autotuner can search.
+ *
+ *   TUNABLE(int, TURN_SPEED, 120, 60, 255);
+ *
+ * On the robot this is an ordinary compile-time constant. Building with
+ * -DUTRA_USE_TUNED takes the value from a header the autotuner generated
+ * (UTRA_TUNED_HEADER, tuned_main.h unless set) when that header names the
+ * constant for the declaring file, otherwise the default stays. On the host
+ * the constant is a variable registered with its search range, so a run
+ * can override it (--set NAME=VALUE) and the tuner can search it.
+ * Each sketch gets its own entry: a constant of the same name in another
+ * file is another entry, listed as file:NAME, with its own default and range.
+ */
+
+#ifndef UTRA_TUNABLE_H
+#define UTRA_TUNABLE_H
+
+typedef struct {
+  const char *file;   // declaring source file, matched against the end of __FILE__
+  const char *name;
+  long value;
+} TunedEntry;
+
+#ifdef UTRA_USE_TUNED
+#ifndef UTRA_TUNED_HEADER
+#define UTRA_TUNED_HEADER "tuned_main.h"
+#endif
+#include UTRA_TUNED_HEADER
+constexpr TunedEntry TUNED_ENTRIES[] = { UTRA_TUNED_ENTRIES { "", "", 0 } };
+#else
+constexpr TunedEntry TUNED_ENTRIES[] = { { "", "", 0 } };
+#endif
+
+constexpr bool tunedNameEquals(const char *a, const char *b) {
+  return *a == *b && (*a == '\0' || tunedNameEquals(a + 1, b + 1));
+}
+
+constexpr int tunedLength(const char *s) {
+  return *s == '\0' ? 0 : 1 + tunedLength(s + 1);
+}
+
+// True when path is file, or ends in "/file".
+constexpr bool tunedFileMatches(const char *path, int pathLen, const char *file, int fileLen) {
+  return fileLen <= pathLen && tunedNameEquals(path + pathLen - fileLen, file) &&
+         (fileLen == pathLen || path[pathLen - fileLen - 1] == '/' ||
+          path[pathLen - fileLen - 1] == '\\');
+}
+
+// Value from the tuned header, or fallback when it does not list the name
+// for this file.
+constexpr long tunedValue(const char *path, const char *name, long fallback, int i = 0) {
+  return TUNED_ENTRIES[i].name[0] == '\0' ? fallback
+         : tunedNameEquals(TUNED_ENTRIES[i].name, name) &&
+               tunedFileMatches(path, tunedLength(path), TUNED_ENTRIES[i].file,
+                                tunedLength(TUNED_ENTRIES[i].file))
+           ? TUNED_ENTRIES[i].value
+         : tunedValue(path, name, fallback, i + 1);
+}
+
+#ifdef UTRA_HOST
+
+typedef struct {
+  const char *name;
+  const char *file;       // declaring file, without its directory
+  long value;             // compiled-in value (default or tuned), or what --set made it
+  long minValue, maxValue;
+} TunableInfo;
+
+long tunableRegister(const char *name, const char *file, void *var,
+                     void (*store)(void *var, long value), long value, long minValue, long maxValue);
+// name is file:NAME for one sketch's entry, or a bare NAME for every
+// sketch's. False when nothing matches.
+bool tunableSet(const char *name, long value);
+int tunableCount();
+const TunableInfo *tunableAt(int index);
+// True when the entry was declared in file (compared without directories).
+bool tunableDeclaredIn(int index, const char *file);
+
+template <class T>
+void tunableStore(void *var, long value) {
+  *(T *)var = (T)value;
+}
+
+#define TUNABLE(type, name, value, minValue, maxValue)                                        \
+  static type name = (type)tunableRegister(#name, __FILE__, &name, tunableStore<type>,        \
+                                           tunedValue(__FILE__, #name, value), minValue, maxValue)
+
+#else
+
+#define TUNABLE(type, name, value, minValue, maxValue) \
+  const type name = (type)tunedValue(__FILE__, #name, value)
+
+#endif
+
+#endif
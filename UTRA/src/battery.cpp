@@ -0,0 +1,70 @@
+/**
+ * Pack voltage sense - see battery.h
+ */
+
+#include <Arduino.h>
+#include "battery.h"
+
+const uint32_t ADC_REF_MV = 5000;
+const uint8_t FILTER_SHIFT = 5;         // ~0.6 s time constant at 50 Hz
+const uint16_t SCALE_MIN_Q8 = 128;      // never more than halve or double
+const uint16_t SCALE_MAX_Q8 = 512;
+
+static int8_t sensePin = -1;
+static uint32_t filteredQ4 = 0;         // mV in Q4
+static bool sampled = false;
+static unsigned long lastSampleMs = 0;
+static uint8_t samplesToLog = 0;
+static uint16_t scaleQ8 = 256;          // nominal / filtered
+
+void batteryBegin(uint8_t pin) {
+  sensePin = (int8_t)pin;
+  pinMode(pin, INPUT);
+  filteredQ4 = 0;
+  sampled = false;
+  samplesToLog = 0;
+  scaleQ8 = 256;
+}
+
+bool batteryUpdate() {
+  if (sensePin < 0) return false;
+  unsigned long now = millis();
+  if (sampled && now - lastSampleMs < BATTERY_SAMPLE_MS) return false;
+  lastSampleMs = now;
+
+  uint32_t mv = (uint32_t)analogRead(sensePin) * ADC_REF_MV * UTRA_BATTERY_DIVIDER_X10 / (1023UL * 10);
+  if (!sampled) {
+    filteredQ4 = mv << 4;
+    sampled = true;
+  } else {
+    filteredQ4 += (int32_t)((mv << 4) - filteredQ4) >> FILTER_SHIFT;
+  }
+
+  uint16_t filtered = batteryMillivolts();
+  if (filtered < BATTERY_MIN_MV) {
+    scaleQ8 = 256;
+  } else {
+    uint32_t s = ((uint32_t)BATTERY_NOMINAL_MV << 8) / filtered;
+    scaleQ8 = (uint16_t)constrain(s, (uint32_t)SCALE_MIN_Q8, (uint32_t)SCALE_MAX_Q8);
+  }
+
+  if (samplesToLog == 0) {
+    samplesToLog = BATTERY_LOG_SAMPLES;
+    return true;
+  }
+  samplesToLog--;
+  return false;
+}
+
+uint16_t batteryMillivolts() {
+  return (uint16_t)((filteredQ4 + 8) >> 4);
+}
+
+int batteryScalePwm(int pwm) {
+  long scaled = ((long)pwm * scaleQ8) >> 8;
+  return (int)constrain(scaled, -255L, 255L);
+}
+
+unsigned long batteryScaleMs(unsigned long ms) {
+  return (ms * scaleQ8) >> 8;
+}
@@ -0,0 +1,302 @@
+/**
+ * Microbenchmarks - see bench.h
+ * Kernels restate the firmware's arithmetic on a fixed input table so each
+ * variant can be timed on its own; driveMotor() is the real one.
+ */
+
+#include <Arduino.h>
+#include <string.h>
+#include "bench.h"
+#include "colour_classifier.h"
+#include "event_queue.h"
+#include "line_array.h"
+#include "stall_detector.h"
+
+#ifdef ARDUINO_ARCH_AVR
+const uint16_t BENCH_ITERATIONS = 16;   // 16-bit Timer1 must not wrap within a sample
+#else
+#include <chrono>
+const uint32_t BENCH_ITERATIONS = 20000;
+#endif
+const uint8_t BENCH_SAMPLES = 7;        // best of
+const uint8_t INPUT_COUNT = 8;
+
+void driveMotor(int leftPWM, int rightPWM);
+
+// ========== Inputs ==========
+// TCS3200 pulse widths at 20% scaling: white, red, green, blue, black, edges
+static const uint16_t RED_PW[INPUT_COUNT] =   { 22, 28, 70, 75, 160, 45, 33, 110 };
+static const uint16_t GREEN_PW[INPUT_COUNT] = { 24, 80, 35, 60, 170, 50, 40, 120 };
+static const uint16_t BLUE_PW[INPUT_COUNT] =  { 20, 75, 65, 30, 150, 48, 38, 105 };
+static const uint16_t ECHO_US[INPUT_COUNT] =  { 0, 580, 1160, 2320, 4640, 9280, 17400, 23000 };
+// Six-channel reflectance array scans: centred, off to each side, lost
+static const uint16_t LINE_RAW[INPUT_COUNT][6] = {
+  { 130, 140, 660, 650, 135, 130 }, { 130, 660, 650, 400, 135, 130 },
+  { 130, 135, 140, 400, 650, 660 }, { 660, 300, 135, 130, 140, 130 },
+  { 130, 135, 140, 130, 135, 130 }, { 130, 140, 660, 650, 640, 130 },
+  { 135, 130, 300, 660, 300, 130 }, { 130, 130, 130, 135, 400, 660 }
+};
+static const int BLACK_THRESHOLD = 100;
+static const int WHITE_THRESHOLD = 40;
+
+// ========== Kernels ==========
+static uint16_t kEmpty(uint16_t i) {
+  return i;
+}
+
+// getColour() as in the challenge files
+static uint16_t kColourMinChannel(uint16_t i) {
+  uint8_t k = i % INPUT_COUNT;
+  int r = RED_PW[k], g = GREEN_PW[k], b = BLUE_PW[k];
+  if (r > BLACK_THRESHOLD && g > BLACK_THRESHOLD && b > BLACK_THRESHOLD) return 4;
+  if (r < WHITE_THRESHOLD && g < WHITE_THRESHOLD && b < WHITE_THRESHOLD) return 0;
+  int m = min(r, min(g, b));
+  return m == r ? 1 : (m == g ? 2 : 3);
+}
+
+// Chromaticity: each channel's share of the total, integer percent
+static uint16_t kColourRatio(uint16_t i) {
+  uint8_t k = i % INPUT_COUNT;
+  uint16_t r = RED_PW[k], g = GREEN_PW[k], b = BLUE_PW[k];
+  uint16_t sum = r + g + b;
+  if (sum > 3 * BLACK_THRESHOLD) return 4;
+  if (sum < 3 * WHITE_THRESHOLD) return 0;
+  uint8_t rp = (uint8_t)(100U * r / sum), gp = (uint8_t)(100U * g / sum), bp = (uint8_t)(100U * b / sum);
+  return rp <= gp && rp <= bp ? 1 : (gp <= bp ? 2 : 3);
+}
+
+static uint16_t kColourFloat(uint16_t i) {
+  uint8_t k = i % INPUT_COUNT;
+  float r = RED_PW[k], g = GREEN_PW[k], b = BLUE_PW[k];
+  float sum = r + g + b;
+  if (sum > 3.0f * BLACK_THRESHOLD) return 4;
+  if (sum < 3.0f * WHITE_THRESHOLD) return 0;
+  float rn = r / sum, gn = g / sum, bn = b / sum;
+  return rn <= gn && rn <= bn ? 1 : (gn <= bn ? 2 : 3);
+}
+
+// Reflectance against tracked white/black references (UTRA_COLOUR_ADAPTIVE)
+static ColourTracker benchTracker = { { 22 << 4, 24 << 4, 20 << 4 }, { 160 << 4, 170 << 4, 150 << 4 } };
+static uint16_t kColourAdaptive(uint16_t i) {
+  uint8_t k = i % INPUT_COUNT;
+  return colourClassifyAdaptive(&benchTracker, RED_PW[k], GREEN_PW[k], BLUE_PW[k]);
+}
+
+static const uint8_t BENCH_LINE_PINS[6] = { 14, 15, 16, 17, 18, 19 };
+static LineArray benchLineArray = { BENCH_LINE_PINS, 6, 150, 650, 0 };
+static uint16_t kLineCentroid(uint16_t i) {
+  LineReading r;
+  lineArrayEstimate(&benchLineArray, LINE_RAW[i % INPUT_COUNT], &r);
+  return (uint16_t)r.position;
+}
+
+// One ISR push and the loop() pop that takes it
+static EventQueue benchQueue;
+static uint16_t kEventPushPop(uint16_t i) {
+  Event e = { EVENT_PULSE, 6, ECHO_US[i % INPUT_COUNT], i };
+  eventPush(&benchQueue, &e);
+  eventPop(&benchQueue, &e);
+  return e.value;
+}
+
+// One control step's worth of stall evidence: colour, range and the check
+static StallDetector benchStall = { STALL_PHASE_WATCH, 0, 0, 0, 0, 0, false, false, false, false, false,
+                                    0, -1, 0, 0, 0xFFFFFFFFUL, 0 };
+static uint16_t kStallUpdate(uint16_t i) {
+  stallNoteColour(&benchStall, i, (uint8_t)(i >> 4));
+  stallNoteRange(&benchStall, i, (int)(ECHO_US[i % INPUT_COUNT] / 58));
+  return stallUpdate(&benchStall, i, true);
+}
+
+static uint16_t kDistanceInt34(uint16_t i) {        // obstacle sketch
+  long duration = ECHO_US[i % INPUT_COUNT];
+  return (uint16_t)(duration * 34 / 2000);
+}
+
+static uint16_t kDistanceInt340(uint16_t i) {       // challenge2.c as written
+  long duration = ECHO_US[i % INPUT_COUNT];
+  return (uint16_t)(duration * 340 / 200);
+}
+
+static uint16_t kDistanceFloat(uint16_t i) {        // challenge one part two
+  long duration = ECHO_US[i % INPUT_COUNT];
+  return (uint16_t)((duration / 2.0f) / 29.1f);
+}
+
+static uint16_t emaState = 0;
+static uint16_t kFilterEma(uint16_t i) {
+  // x += (in - x) / 4 in Q4 fixed point
+  int16_t in = (int16_t)(RED_PW[i % INPUT_COUNT] << 4);
+  emaState += (in - (int16_t)emaState) >> 2;
+  return emaState >> 4;
+}
+
+static uint16_t kFilterMedian3(uint16_t i) {
+  uint16_t a = ECHO_US[i % INPUT_COUNT], b = ECHO_US[(i + 3) % INPUT_COUNT], c = ECHO_US[(i + 5) % INPUT_COUNT];
+  if (a > b) { uint16_t t = a; a = b; b = t; }
+  if (b > c) { uint16_t t = b; b = c; c = t; }
+  return a > b ? a : b;
+}
+
+static uint16_t meanWindow[4];
+static uint16_t meanSum = 0;
+static uint16_t kFilterMean4(uint16_t i) {
+  uint8_t slot = i & 3;
+  meanSum += RED_PW[i % INPUT_COUNT] - meanWindow[slot];
+  meanWindow[slot] = RED_PW[i % INPUT_COUNT];
+  return meanSum >> 2;
+}
+
+static uint16_t kDriveMotor(uint16_t i) {
+  int pwm = (int)(i & 0xFF) - 128;
+  driveMotor(pwm, -pwm);
+  return (uint16_t)pwm;
+}
+
+// State dispatch: a switch the shape of the obstacle RobotState machine,
+// against a table of handlers.
+static uint8_t dispatchState = 0;
+static uint16_t kDispatchSwitch(uint16_t i) {
+  uint16_t out;
+  switch (dispatchState) {
+    case 0: out = i + 1; break;
+    case 1: out = i ^ 0x55; break;
+    case 2: out = i << 1; break;
+    case 3: out = i >> 1; break;
+    case 4: out = i - 3; break;
+    case 5: out = i | 0x80; break;
+    case 6: out = i & 0x7F; break;
+    case 7: out = i + 7; break;
+    case 8: out = ~i; break;
+    default: out = i; break;
+  }
+  dispatchState = (dispatchState + 1) % 10;
+  return out;
+}
+
+static uint16_t h0(uint16_t i) { return i + 1; }
+static uint16_t h1(uint16_t i) { return i ^ 0x55; }
+static uint16_t h2(uint16_t i) { return i << 1; }
+static uint16_t h3(uint16_t i) { return i >> 1; }
+static uint16_t h4(uint16_t i) { return i - 3; }
+static uint16_t h5(uint16_t i) { return i | 0x80; }
+static uint16_t h6(uint16_t i) { return i & 0x7F; }
+static uint16_t h7(uint16_t i) { return i + 7; }
+static uint16_t h8(uint16_t i) { return ~i; }
+static uint16_t h9(uint16_t i) { return i; }
+static const BenchKernel HANDLERS[10] = { h0, h1, h2, h3, h4, h5, h6, h7, h8, h9 };
+
+static uint16_t kDispatchTable(uint16_t i) {
+  uint16_t out = HANDLERS[dispatchState](i);
+  dispatchState = (dispatchState + 1) % 10;
+  return out;
+}
+
+static const BenchCase CASES[] = {
+  { "colour/min_channel", kColourMinChannel },
+  { "colour/ratio_int", kColourRatio },
+  { "colour/ratio_float", kColourFloat },
+  { "colour/adaptive", kColourAdaptive },
+  { "line/centroid6", kLineCentroid },
+  { "event/push_pop", kEventPushPop },
+  { "stall/update", kStallUpdate },
+  { "distance/int_34_2000", kDistanceInt34 },
+  { "distance/int_340_200", kDistanceInt340 },
+  { "distance/float_29_1", kDistanceFloat },
+  { "filter/ema_q4", kFilterEma },
+  { "filter/median3", kFilterMedian3 },
+  { "filter/mean4", kFilterMean4 },
+  { "motor/drive_motor", kDriveMotor },
+  { "dispatch/switch", kDispatchSwitch },
+  { "dispatch/table", kDispatchTable },
+};
+
+const BenchCase *benchCases(uint8_t *count) {
+  *count = sizeof(CASES) / sizeof(CASES[0]);
+  return CASES;
+}
+
+// ========== Timing ==========
+static volatile uint16_t sink;
+
+#ifdef ARDUINO_ARCH_AVR
+// Timer1 with no prescaler counts CPU cycles. The bench build does not use
+// Servo, which would otherwise own Timer1.
+static void timerBegin() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+}
+
+static uint32_t timeSample(BenchKernel fn, uint16_t base) {
+  noInterrupts();
+  uint16_t start = TCNT1;
+  for (uint16_t i = 0; i < BENCH_ITERATIONS; i++) sink = fn(base + i);
+  uint16_t elapsed = TCNT1 - start;
+  interrupts();
+  return elapsed;
+}
+
+const char *benchUnit() { return "cycles"; }
+const char *benchTarget() { return "avr"; }
+#else
+static void timerBegin() {}
+
+static uint32_t timeSample(BenchKernel fn, uint16_t base) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) sink = fn((uint16_t)(base + i));
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+const char *benchUnit() { return "ns"; }
+const char *benchTarget() { return "host"; }
+#endif
+
+static uint32_t bestOf(BenchKernel fn) {
+  uint32_t best = 0xFFFFFFFFUL;
+  for (uint8_t s = 0; s < BENCH_SAMPLES; s++) {
+    uint32_t t = timeSample(fn, s * 37);
+    if (t < best) best = t;
+  }
+  return best;
+}
+
+void benchRunAll(const char *filter, BenchSink sink, void *ctx) {
+  timerBegin();
+  uint32_t overhead = bestOf(kEmpty);
+  uint8_t count;
+  const BenchCase *cases = benchCases(&count);
+  for (uint8_t c = 0; c < count; c++) {
+    if (filter != NULL && strstr(cases[c].name, filter) == NULL) continue;
+    uint32_t t = bestOf(cases[c].fn);
+    BenchResult r;
+    r.name = cases[c].name;
+    r.perCall = t > overhead ? (float)(t - overhead) / BENCH_ITERATIONS : 0.0f;
+    r.iterations = BENCH_ITERATIONS;
+    sink(&r, ctx);
+  }
+}
+
+#ifdef ARDUINO_ARCH_AVR
+static void printResult(const BenchResult *r, void *ctx) {
+  bool *first = (bool *)ctx;
+  Serial.print(*first ? F("\n    ") : F(",\n    "));
+  *first = false;
+  Serial.print(F("{\"name\": \""));
+  Serial.print(r->name);
+  Serial.print(F("\", \"per_call\": "));
+  Serial.print(r->perCall, 1);
+  Serial.print(F(", \"iterations\": "));
+  Serial.print(r->iterations);
+  Serial.print(F("}"));
+}
+
+void benchPrintJson() {
+  bool first = true;
+  Serial.print(F("{\"target\": \"avr\", \"unit\": \"cycles\", \"f_cpu\": "));
+  Serial.print(F_CPU);
+  Serial.print(F(", \"results\": ["));
+  benchRunAll(NULL, printResult, &first);
+  Serial.println(F("\n]}"));
+}
+#endif
@@ -1,9 +1,19 @@
+#include "battery.h"
+#include "telemetry.h"
+#include "flight_recorder.h"
+#include "serial_command.h"
+#include "profiler.h"
+#include "state_stats.h"
+
 // ultrasonic sensor
 const int TRIGPIN = A4;
 const int ECHOPIN = A5;
 long duration;
 int distance;
 
+// pack voltage through the divider (-DUTRA_BATTERY)
+const int BATTERY_PIN = A0;
+
 // dc motor
 const int LEFT1 = 10;
 const int LEFT2 = 9;
@@ -42,6 +52,21 @@ typedef enum
   STATE_FINISHED = 6
 } RobotState;
 RobotState robotstate = STATE_FOLLOW_RED;
+StateTime robotStateTimes[STATE_FINISHED + 1];
+StateStats robotStateStats;
+
+void setRobotState(RobotState state);
+bool isBlocked(int cm);
+PathColour getColour();
+int getRedPW();
+int getGreenPW();
+int getBluePW();
+void moveForward();
+void moveBackward();
+void moveLeft();
+void moveRight();
+void stopMotors();
+int getDistance();
 
 void setup()
 {
@@ -68,8 +93,28 @@ void setup()
   // set sensor output as input
   pinMode(S_OUT, INPUT);
 
-  Serial.begin(9600);
+  telemetryBegin();
+  flightRecorderBegin();
+  PROFILER_BEGIN();
+#ifdef UTRA_BATTERY
+  batteryBegin(BATTERY_PIN);
+#endif
   delay(2000);
+  stateStatsBegin(&robotStateStats, STATE_MACHINE_CHALLENGE2, robotStateTimes,
+                  STATE_FINISHED + 1, STATE_FOLLOW_RED, millis());
+  setRobotState(STATE_FOLLOW_RED);
+}
+
+void setRobotState(RobotState state)
+{
+  unsigned long now = millis();
+  robotstate = state;
+  telemetrySendState(STATE_MACHINE_CHALLENGE2, state, now);
+  stateStatsEnter(&robotStateStats, state, now);
+  if (state == STATE_FINISHED)
+  {
+    stateStatsFinish(&robotStateStats, now);
+  }
 }
 
 int leftcounter = 0;
@@ -92,12 +137,23 @@ bool isBlocked(int cm)
 
 void loop()
 {
+  PROFILE_LOOP_TICK();
+  telemetryPump();
+  serialCommandPoll();
+  flightRecorderTick();
+  if (batteryUpdate()) telemetrySendBattery(batteryMillivolts(), millis());
+
+  SensorFrame frame = SensorFrame();
+  frame.tMs = millis();
   PathColour colour = getColour();
   int cm = getDistance();
 
-  Serial.print(colour);
-  Serial.print(" ");
-  Serial.println(cm);
+  frame.redPW = redPW;
+  frame.greenPW = greenPW;
+  frame.bluePW = bluePW;
+  frame.distanceCm = cm;
+  frame.colour = colour;
+  telemetrySendSensor(&frame, robotstate);
 
   switch (robotstate)
   {
@@ -105,54 +161,54 @@ void loop()
   
     if (isBlocked(cm))
     {
-      robotstate = STATE_AVOID_OBSTACLE;
+      setRobotState(STATE_AVOID_OBSTACLE);
     } 
     else 
     
     if (colour == PATH_RED || colour == PATH_BLUE || colour == PATH_BLACK)
     {
       moveForward();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
     }
     else if (colour == PATH_WHITE)
     {
-      robotstate = STATE_CHECK_LEFT;
+      setRobotState(STATE_CHECK_LEFT);
     }
     else if (colour == PATH_BLUE)
     {
       // add flag for pickup dropoff
-      robotstate = STATE_BLOCK_PICKUP;
+      setRobotState(STATE_BLOCK_PICKUP);
     }
     break;
 
   case STATE_CHECK_LEFT:
     // rotate up to 90 degrees left
     moveLeft();
-    delay(120);
+    delay(batteryScaleMs(120));
     stopMotors();
 
     if (colour == PATH_RED)
     {
-      robotstate = STATE_FOLLOW_RED;
+      setRobotState(STATE_FOLLOW_RED);
     }
 
     leftcounter++;
     if (leftcounter >= 25)
     {
       leftcounter = 0;
-      robotstate = STATE_CHECK_RIGHT;
+      setRobotState(STATE_CHECK_RIGHT);
     }
     break;
 
   case STATE_CHECK_RIGHT:
     moveRight();
-    delay(120);
+    delay(batteryScaleMs(120));
     stopMotors();
 
     if (colour == PATH_RED)
     {
-      robotstate = STATE_FOLLOW_RED;
+      setRobotState(STATE_FOLLOW_RED);
     }
     break;
 
@@ -160,7 +216,7 @@ void loop()
     for (int i = 0; i < 8; i++)
     {
       moveLeft();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
       delay(150);
     }
@@ -168,7 +224,7 @@ void loop()
     for (int i = 0; i < 15; i++)
     {
       moveForward();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
       delay(50);
     }
@@ -176,7 +232,7 @@ void loop()
     for (int i = 0; i < 8; i++)
     {
       moveRight();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
       delay(150);
     }
@@ -184,7 +240,7 @@ void loop()
     for (int i = 0; i < 20; i++)
     {
       moveForward();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
       delay(50);
     }
@@ -192,7 +248,7 @@ void loop()
     for (int i = 0; i < 8; i++)
     {
       moveRight();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
       delay(50);
     }
@@ -200,7 +256,7 @@ void loop()
     for (int i = 0; i < 15; i++)
     {
       moveForward();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
       delay(50);
     }
@@ -208,12 +264,12 @@ void loop()
     for (int i = 0; i < 8; i++)
     {
       moveLeft();
-      delay(150);
+      delay(batteryScaleMs(150));
       stopMotors();
       delay(150);
     }
 
-    robotstate = STATE_FOLLOW_RED;
+    setRobotState(STATE_FOLLOW_RED);
     break;
   }
 
@@ -225,6 +281,7 @@ void loop()
 // white = 0, red = 1, green = 2, blue = 3, black = 4
 PathColour getColour()
 {
+  PROFILE_SCOPE("colour");
   redPW = getRedPW();
   greenPW = getGreenPW();
   bluePW = getBluePW();
@@ -331,6 +388,7 @@ void stopMotors()
 
 int getDistance()
 {
+  PROFILE_SCOPE("range");
   digitalWrite(TRIGPIN, LOW);
   delayMicroseconds(2);
   digitalWrite(TRIGPIN, HIGH);
@@ -0,0 +1,233 @@
+/**
+ * Integer colour classifiers - see colour_classifier.h
+ */
+
+#include <Arduino.h>
+#include "colour_classifier.h"
+
+#ifdef UTRA_COLOUR_MODEL
+#include "colour_model.h"
+
+static const uint8_t MODEL_LABELS[] PROGMEM = COLOUR_MODEL_LABELS;
+#ifdef COLOUR_MODEL_TREE
+static const ColourTreeNode MODEL_TREE[] PROGMEM = COLOUR_MODEL_TREE;
+const ColourModel COLOUR_MODEL = { COLOUR_MODEL_CLASSES, MODEL_LABELS, NULL, MODEL_TREE };
+#else
+static const ColourLinearTerm MODEL_LINEAR[] PROGMEM = COLOUR_MODEL_LINEAR;
+const ColourModel COLOUR_MODEL = { COLOUR_MODEL_CLASSES, MODEL_LABELS, MODEL_LINEAR, NULL };
+#endif
+#endif
+
+// ========== Readings ==========
+static uint8_t confidenceFromMargin(uint32_t marginQ8) {
+  uint32_t c = marginQ8 * 255 / COLOUR_FULL_MARGIN_Q8;
+  return (uint8_t)min(c, (uint32_t)255);
+}
+
+// (far - near) / far in Q8; 0 when near is not below far.
+static uint32_t relativeGap(uint16_t near, uint16_t far) {
+  return far > near ? ((uint32_t)(far - near) << 8) / far : 0;
+}
+
+// Light on each channel is 1 / width.
+static void widthShares(const uint16_t width[3], ColourReading *out) {
+  uint32_t inv[3], sum = 0;
+  for (uint8_t c = 0; c < 3; c++) {
+    inv[c] = 65535UL / max(width[c], (uint16_t)1);
+    sum += inv[c];
+  }
+  for (uint8_t c = 0; c < 3; c++) out->share[c] = (uint8_t)(inv[c] * 255 / sum);
+}
+
+void colourReadThresholds(uint16_t red, uint16_t green, uint16_t blue, uint16_t whiteUs,
+                          uint16_t blackUs, ColourReading *out) {
+  uint16_t width[3] = { red, green, blue };
+  uint16_t lo = min(red, min(green, blue));
+  uint16_t hi = max(red, max(green, blue));
+  widthShares(width, out);
+  if (lo > blackUs) {
+    out->colour = COLOUR_BLACK;
+    out->confidence = confidenceFromMargin(relativeGap(blackUs, lo));
+    return;
+  }
+  if (hi < whiteUs) {
+    out->colour = COLOUR_WHITE;
+    out->confidence = confidenceFromMargin(relativeGap(hi, whiteUs));
+    return;
+  }
+  uint8_t d = lo == red ? 0 : (lo == green ? 1 : 2);
+  uint16_t second = hi;
+  for (uint8_t c = 0; c < 3; c++) {
+    if (c != d && width[c] < second) second = width[c];
+  }
+  out->colour = COLOUR_RED + d;
+  // away from the runner-up channel, from white and from black
+  uint32_t margin = relativeGap(lo, second);
+  margin = min(margin, relativeGap(whiteUs, hi + 1));
+  margin = min(margin, relativeGap(lo, blackUs + 1));
+  out->confidence = confidenceFromMargin(margin);
+}
+
+// ========== Adaptive white/black references ==========
+const uint16_t ADAPT_WIDTH_MAX = 4095;     // keeps the Q8 division in 32 bits
+const uint16_t WHITE_LEVEL = 141;          // every channel above: white (0.55)
+const uint16_t WHITE_CONFIDENT = 179;      // ... and learn from it (0.70)
+const uint16_t BLACK_LEVEL = 77;           // every channel below: black (0.30)
+const uint16_t BLACK_CONFIDENT = 38;       // ... and learn from it (0.15)
+const uint8_t ATTACK_SHIFT = 2;            // reading beyond the reference: follow fast
+const uint8_t RELEASE_SHIFT = 5;           // inside it: drift back slowly
+const uint16_t MIN_SPAN_US = 4;            // black stays this far above white
+
+void colourTrackerBegin(ColourTracker *t, uint16_t whiteUs, uint16_t blackUs) {
+  for (uint8_t c = 0; c < 3; c++) {
+    t->whiteQ4[c] = min(whiteUs, ADAPT_WIDTH_MAX) << 4;
+    t->blackQ4[c] = min(blackUs, ADAPT_WIDTH_MAX) << 4;
+  }
+}
+
+void colourNormalize(const ColourTracker *t, const uint16_t width[3], uint16_t reflectance[3]) {
+  for (uint8_t c = 0; c < 3; c++) {
+    uint32_t w = min(width[c], ADAPT_WIDTH_MAX);
+    uint32_t white = (t->whiteQ4[c] + 8) >> 4;
+    uint32_t black = max((uint32_t)((t->blackQ4[c] + 8) >> 4), white + MIN_SPAN_US);
+    if (w == 0 || w >= black) {
+      reflectance[c] = 0;
+    } else if (w <= white) {
+      reflectance[c] = COLOUR_REFLECTANCE_ONE;
+    } else {
+      // (1/w - 1/black) / (1/white - 1/black)
+      reflectance[c] = (uint16_t)((white * (black - w) << 8) / (w * (black - white)));
+    }
+  }
+}
+
+static void track(uint16_t *referenceQ4, uint16_t width, bool beyond) {
+  int32_t diff = ((int32_t)min(width, ADAPT_WIDTH_MAX) << 4) - *referenceQ4;
+  *referenceQ4 += (int16_t)(diff >> (beyond ? ATTACK_SHIFT : RELEASE_SHIFT));
+}
+
+void colourReadAdaptive(ColourTracker *t, uint16_t red, uint16_t green, uint16_t blue, ColourReading *out) {
+  uint16_t width[3] = { red, green, blue };
+  uint16_t refl[3];
+  colourNormalize(t, width, refl);
+  uint16_t lo = min(refl[0], min(refl[1], refl[2]));
+  uint16_t hi = max(refl[0], max(refl[1], refl[2]));
+
+  if (lo >= WHITE_CONFIDENT) {
+    for (uint8_t c = 0; c < 3; c++) track(&t->whiteQ4[c], width[c], width[c] < (t->whiteQ4[c] >> 4));
+  } else if (hi <= BLACK_CONFIDENT && red != 0 && green != 0 && blue != 0) {
+    // a timeout says nothing about how dark black is
+    for (uint8_t c = 0; c < 3; c++) track(&t->blackQ4[c], width[c], width[c] > (t->blackQ4[c] >> 4));
+  }
+
+  uint16_t sum = refl[0] + refl[1] + refl[2];
+  for (uint8_t c = 0; c < 3; c++) out->share[c] = sum ? (uint8_t)((uint32_t)refl[c] * 255 / sum) : 85;
+  if (lo >= WHITE_LEVEL) {
+    out->colour = COLOUR_WHITE;
+    out->confidence = confidenceFromMargin(lo - WHITE_LEVEL);
+    return;
+  }
+  if (hi <= BLACK_LEVEL) {
+    out->colour = COLOUR_BLACK;
+    out->confidence = confidenceFromMargin(BLACK_LEVEL - hi);
+    return;
+  }
+  uint8_t d = hi == refl[0] ? 0 : (hi == refl[1] ? 1 : 2);
+  uint16_t second = lo;
+  for (uint8_t c = 0; c < 3; c++) {
+    if (c != d && refl[c] > second) second = refl[c];
+  }
+  out->colour = COLOUR_RED + d;
+  uint16_t margin = min((uint16_t)(hi - second), (uint16_t)(WHITE_LEVEL - lo));
+  out->confidence = confidenceFromMargin(min(margin, (uint16_t)(hi - BLACK_LEVEL)));
+}
+
+uint8_t colourClassifyAdaptive(ColourTracker *t, uint16_t red, uint16_t green, uint16_t blue) {
+  ColourReading r;
+  colourReadAdaptive(t, red, green, blue, &r);
+  return r.colour;
+}
+
+// ========== Trained models ==========
+uint8_t colourModelClass(const ColourModel *model, uint16_t red, uint16_t green, uint16_t blue) {
+  uint16_t width[3] = { min(red, COLOUR_WIDTH_MAX), min(green, COLOUR_WIDTH_MAX),
+                        min(blue, COLOUR_WIDTH_MAX) };
+  if (model->tree != NULL) {
+    int8_t i = 0;
+    while (i >= 0) {
+      ColourTreeNode node;
+      memcpy_P(&node, &model->tree[i], sizeof(node));
+      i = width[node.channel] < node.threshold ? node.below : node.above;
+    }
+    return (uint8_t)~i;
+  }
+
+  uint8_t best = 0;
+  int32_t bestScore = 0;
+  for (uint8_t k = 0; k < model->classes; k++) {
+    ColourLinearTerm term;
+    memcpy_P(&term, &model->linear[k], sizeof(term));
+    int32_t score = term.bias;
+    for (uint8_t c = 0; c < 3; c++) score += (int32_t)term.weight[c] * width[c];
+    if (k == 0 || score > bestScore) {
+      bestScore = score;
+      best = k;
+    }
+  }
+  return best;
+}
+
+uint8_t colourClassify(const ColourModel *model, uint16_t red, uint16_t green, uint16_t blue) {
+  return pgm_read_byte(&model->labels[colourModelClass(model, red, green, blue)]);
+}
+
+void colourReadModel(const ColourModel *model, uint16_t red, uint16_t green, uint16_t blue,
+                     ColourReading *out) {
+  uint16_t width[3] = { min(red, COLOUR_WIDTH_MAX), min(green, COLOUR_WIDTH_MAX),
+                        min(blue, COLOUR_WIDTH_MAX) };
+  widthShares(width, out);
+  uint32_t mean = ((uint32_t)width[0] + width[1] + width[2]) / 3 + 1;
+  uint32_t marginUs = 0;
+  uint8_t k;
+  if (model->tree != NULL) {
+    marginUs = COLOUR_WIDTH_MAX;
+    int8_t i = 0;
+    while (i >= 0) {
+      ColourTreeNode node;
+      memcpy_P(&node, &model->tree[i], sizeof(node));
+      uint16_t w = width[node.channel];
+      if (node.below != node.above) {
+        marginUs = min(marginUs, (uint32_t)(w < node.threshold ? node.threshold - w : w - node.threshold + 1));
+      }
+      i = w < node.threshold ? node.below : node.above;
+    }
+    k = (uint8_t)~i;
+  } else {
+    // Gap between the two best scores over the L1 norm of their weight
+    // difference: a lower bound on how far any one channel must move.
+    int32_t best = 0, runnerUp = 0;
+    ColourLinearTerm bestTerm = ColourLinearTerm(), runnerTerm = ColourLinearTerm();
+    k = 0;
+    for (uint8_t j = 0; j < model->classes; j++) {
+      ColourLinearTerm term;
+      memcpy_P(&term, &model->linear[j], sizeof(term));
+      int32_t score = term.bias;
+      for (uint8_t c = 0; c < 3; c++) score += (int32_t)term.weight[c] * width[c];
+      if (j == 0 || score > best) {
+        runnerUp = best;
+        runnerTerm = bestTerm;
+        best = score;
+        bestTerm = term;
+        k = j;
+      } else if (j == 1 || score > runnerUp) {
+        runnerUp = score;
+        runnerTerm = term;
+      }
+    }
+    uint32_t norm = 0;
+    for (uint8_t c = 0; c < 3; c++) norm += abs((int32_t)bestTerm.weight[c] - runnerTerm.weight[c]);
+    marginUs = model->classes < 2 ? COLOUR_WIDTH_MAX : (uint32_t)(best - runnerUp) / max(norm, (uint32_t)1);
+  }
+  out->colour = pgm_read_byte(&model->labels[k]);
+  out->confidence = confidenceFromMargin(min(marginUs, (uint32_t)COLOUR_WIDTH_MAX) * 256 / mean);
+}
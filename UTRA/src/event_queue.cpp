@@ -0,0 +1,53 @@
+/**
+ * Interrupt-to-loop event queues - see event_queue.h
+ *
+ * Loads and stores of the indices go through the __atomic builtins: on the
+ * AVR they are the plain single-byte lds/sts plus a compiler barrier, and on
+ * the host they also order the slot copy against the index for the
+ * threaded stress check.
+ */
+
+#include "event_queue.h"
+
+static_assert(UTRA_EVENT_QUEUE_SIZE <= 128 && 256 % UTRA_EVENT_QUEUE_SIZE == 0,
+              "UTRA_EVENT_QUEUE_SIZE must be a power of two up to 128");
+
+const uint8_t INDEX_MASK = UTRA_EVENT_QUEUE_SIZE - 1;
+
+void eventQueueInit(EventQueue *q) {
+  q->head = 0;
+  q->tail = 0;
+  q->dropped = 0;
+}
+
+bool eventPush(EventQueue *q, const Event *e) {
+  uint8_t head = q->head;
+  uint8_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+  if ((uint8_t)(head - tail) >= EVENT_QUEUE_SIZE) {
+    __atomic_store_n(&q->dropped, (uint8_t)(q->dropped + 1), __ATOMIC_RELAXED);
+    return false;
+  }
+  q->slots[head & INDEX_MASK] = *e;
+  __atomic_store_n(&q->head, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+  return true;
+}
+
+bool eventPop(EventQueue *q, Event *e) {
+  uint8_t tail = q->tail;
+  uint8_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+  if (head == tail) return false;
+  *e = q->slots[tail & INDEX_MASK];
+  __atomic_store_n(&q->tail, (uint8_t)(tail + 1), __ATOMIC_RELEASE);
+  return true;
+}
+
+uint8_t eventPending(const EventQueue *q) {
+  return (uint8_t)(__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - q->tail);
+}
+
+uint8_t eventDroppedSince(const EventQueue *q, uint8_t *seen) {
+  uint8_t now = __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+  uint8_t n = (uint8_t)(now - *seen);
+  *seen = now;
+  return n;
+}
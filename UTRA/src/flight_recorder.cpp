@@ -0,0 +1,218 @@
+/**
+ * Flight recorder - see flight_recorder.h
+ */
+
+#include <Arduino.h>
+#include "flight_recorder.h"
+#include "serial_command.h"
+#include "telemetry.h"
+
+#if defined(UTRA_RECORDER_EEPROM) && defined(__AVR__)
+#include <avr/eeprom.h>
+#define RECORDER_HAS_EEPROM 1
+#endif
+
+// ========== RAM ring ==========
+static uint8_t ramSlots[UTRA_RECORDER_SLOTS][RECORDER_RECORD_LEN];
+static uint16_t ramHead = 0;   // next slot to write
+static uint16_t ramCount = 0;
+static unsigned long lastRamSampleMs = 0;
+static bool ramSampleKept = false;   // the line record goes where its sensor record went
+
+static uint8_t recordLen(uint8_t type) {
+  switch (type) {
+    case TELEMETRY_SENSOR: return TELEMETRY_SENSOR_LEN;
+    case TELEMETRY_STATE:  return TELEMETRY_STATE_LEN;
+    case TELEMETRY_LINE:   return TELEMETRY_LINE_LEN;
+    default:               return 0;
+  }
+}
+
+// Both record types keep the low 16 bits of their timestamp at bytes 2..3.
+static uint16_t recordTime16(const uint8_t *rec) {
+  return (uint16_t)(rec[2] | (rec[3] << 8));
+}
+
+// ========== EEPROM log ==========
+#ifdef RECORDER_HAS_EEPROM
+const uint8_t EEPROM_SLOT_LEN = RECORDER_RECORD_LEN + 3;  // [seq][record][crc16]
+const uint8_t EEPROM_CRC_AT = RECORDER_RECORD_LEN + 1;
+const uint16_t EEPROM_SLOTS = (E2END + 1) / EEPROM_SLOT_LEN;
+const uint8_t SEQ_ERASED = 0xFF;
+
+static uint16_t eepromHead = 0;      // next slot to write = oldest slot
+static uint8_t eepromSeq = 1;
+static uint8_t stateStage[RECORDER_RECORD_LEN];
+static uint8_t sampleStage[RECORDER_RECORD_LEN];
+static bool hasStateStage = false;
+static bool hasSampleStage = false;
+static unsigned long lastSampleSpillMs = 0;
+static uint8_t slotBuf[EEPROM_SLOT_LEN];
+static uint8_t slotWriteIdx = 0;
+static bool slotWriting = false;
+
+static uint8_t nextSeq(uint8_t s) {
+  return s >= 254 ? 1 : s + 1;
+}
+
+static uint8_t *slotAddr(uint16_t slot, uint8_t offset) {
+  return (uint8_t *)(uintptr_t)(slot * EEPROM_SLOT_LEN + offset);
+}
+
+// The log is a chain of consecutive sequence numbers; the first break (or
+// erased slot) marks where the previous run stopped writing.
+static void findEepromHead() {
+  uint8_t prev = eeprom_read_byte(slotAddr(0, 0));
+  if (prev == SEQ_ERASED) {
+    eepromHead = 0;
+    eepromSeq = 1;
+    return;
+  }
+  for (uint16_t i = 1; i < EEPROM_SLOTS; i++) {
+    uint8_t s = eeprom_read_byte(slotAddr(i, 0));
+    if (s != nextSeq(prev)) {
+      eepromHead = i;
+      eepromSeq = nextSeq(prev);
+      return;
+    }
+    prev = s;
+  }
+  eepromHead = 0;
+  eepromSeq = nextSeq(prev);
+}
+#endif
+
+void flightRecorderLog(const uint8_t *payload, uint8_t len) {
+  if (len > RECORDER_RECORD_LEN) return;
+  bool keep = true;
+  if (payload[0] == TELEMETRY_SENSOR) {
+    ramSampleKept = ramCount == 0 || millis() - lastRamSampleMs >= UTRA_RECORDER_RAM_INTERVAL_MS;
+    if (ramSampleKept) lastRamSampleMs = millis();
+    keep = ramSampleKept;
+  } else if (payload[0] == TELEMETRY_LINE) {
+    keep = ramSampleKept;
+  }
+  if (keep) {
+    memcpy(ramSlots[ramHead], payload, len);
+    ramHead = (ramHead + 1) % UTRA_RECORDER_SLOTS;
+    if (ramCount < UTRA_RECORDER_SLOTS) ramCount++;
+  }
+
+#ifdef RECORDER_HAS_EEPROM
+  if (payload[0] == TELEMETRY_STATE) {
+    memcpy(stateStage, payload, len);
+    hasStateStage = true;
+  } else if (millis() - lastSampleSpillMs >= UTRA_RECORDER_EEPROM_INTERVAL_MS) {
+    memcpy(sampleStage, payload, len);
+    hasSampleStage = true;
+    lastSampleSpillMs = millis();
+  }
+#endif
+}
+
+void flightRecorderTick() {
+#ifdef RECORDER_HAS_EEPROM
+  if (!slotWriting) {
+    const uint8_t *src = NULL;
+    if (hasStateStage) { src = stateStage; hasStateStage = false; }
+    else if (hasSampleStage) { src = sampleStage; hasSampleStage = false; }
+    if (src == NULL) return;
+    slotBuf[0] = eepromSeq;
+    memcpy(slotBuf + 1, src, RECORDER_RECORD_LEN);
+    uint16_t crc = telemetryCrc16(slotBuf, EEPROM_CRC_AT);
+    slotBuf[EEPROM_CRC_AT] = (uint8_t)crc;
+    slotBuf[EEPROM_CRC_AT + 1] = (uint8_t)(crc >> 8);
+    slotWriteIdx = 1;
+    slotWriting = true;
+  }
+  if (!eeprom_is_ready()) return;
+
+  // Payload first, sequence byte last: a slot torn by power loss keeps its
+  // old sequence number, reads as the oldest entry and fails its CRC.
+  uint8_t idx = slotWriteIdx < EEPROM_SLOT_LEN ? slotWriteIdx : 0;
+  eeprom_update_byte(slotAddr(eepromHead, idx), slotBuf[idx]);
+  if (idx == 0) {
+    slotWriting = false;
+    eepromHead = (eepromHead + 1) % EEPROM_SLOTS;
+    eepromSeq = nextSeq(eepromSeq);
+  } else {
+    slotWriteIdx++;
+  }
+#endif
+}
+
+static void sendDumpMarker(uint8_t type, RecorderSource source, uint16_t count) {
+  uint8_t rec[4];
+  rec[0] = type;
+  rec[1] = (uint8_t)source;
+  rec[2] = (uint8_t)count;
+  rec[3] = (uint8_t)(count >> 8);
+  telemetrySendRecord(rec, type == TELEMETRY_DUMP_BEGIN ? 4 : 2, TELEMETRY_PRIO_CRITICAL);
+}
+
+static void dumpRam(uint32_t lastMs) {
+  uint16_t now16 = (uint16_t)millis();
+  uint16_t oldest = (ramHead + UTRA_RECORDER_SLOTS - ramCount) % UTRA_RECORDER_SLOTS;
+  uint16_t count = 0;
+
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) sendDumpMarker(TELEMETRY_DUMP_BEGIN, RECORDER_SOURCE_RAM, count);
+    for (uint16_t i = 0; i < ramCount; i++) {
+      const uint8_t *rec = ramSlots[(oldest + i) % UTRA_RECORDER_SLOTS];
+      uint8_t len = recordLen(rec[0]);
+      if (len == 0) continue;
+      if (lastMs != 0 && (uint16_t)(now16 - recordTime16(rec)) > lastMs) continue;
+      if (pass == 0) count++;
+      else telemetrySendRecord(rec, len, TELEMETRY_PRIO_CRITICAL);
+    }
+  }
+  sendDumpMarker(TELEMETRY_DUMP_END, RECORDER_SOURCE_RAM, 0);
+}
+
+static void dumpEeprom() {
+#ifdef RECORDER_HAS_EEPROM
+  sendDumpMarker(TELEMETRY_DUMP_BEGIN, RECORDER_SOURCE_EEPROM, EEPROM_SLOTS);
+  uint8_t buf[EEPROM_SLOT_LEN];
+  for (uint16_t i = 0; i < EEPROM_SLOTS; i++) {
+    uint16_t slot = (eepromHead + i) % EEPROM_SLOTS;
+    eeprom_read_block(buf, slotAddr(slot, 0), EEPROM_SLOT_LEN);
+    if (buf[0] == SEQ_ERASED) continue;
+    uint16_t crc = (uint16_t)(buf[EEPROM_CRC_AT] | (buf[EEPROM_CRC_AT + 1] << 8));
+    if (telemetryCrc16(buf, EEPROM_CRC_AT) != crc) continue;
+    uint8_t len = recordLen(buf[1]);
+    if (len != 0) telemetrySendRecord(buf + 1, len, TELEMETRY_PRIO_CRITICAL);
+  }
+#else
+  sendDumpMarker(TELEMETRY_DUMP_BEGIN, RECORDER_SOURCE_EEPROM, 0);
+#endif
+  sendDumpMarker(TELEMETRY_DUMP_END, RECORDER_SOURCE_EEPROM, 0);
+}
+
+void flightRecorderDump(uint32_t lastMs, RecorderSource source) {
+  if (source == RECORDER_SOURCE_EEPROM) {
+    dumpEeprom();
+  } else {
+    // Past what the ring holds (and the 16-bit timestamps' ~65 s), send it all.
+    dumpRam(lastMs > RECORDER_RAM_SPAN_MS || lastMs > 65000UL ? 0 : lastMs);
+  }
+  telemetryFlush();
+}
+
+static void onDumpCommand(const char *args) {
+  if (strncmp(args, "eeprom", 6) == 0) {
+    flightRecorderDump(0, RECORDER_SOURCE_EEPROM);
+  } else {
+    flightRecorderDump((uint32_t)atol(args) * 1000UL, RECORDER_SOURCE_RAM);
+  }
+}
+
+void flightRecorderBegin() {
+  ramHead = 0;
+  ramCount = 0;
+  ramSampleKept = false;
+#ifdef RECORDER_HAS_EEPROM
+  findEepromHead();
+#endif
+  telemetrySetTap(flightRecorderLog);
+  serialCommandRegister("dump", onDumpCommand);
+}
@@ -0,0 +1,48 @@
+/**
+ * HAL backend for the Uno - thin forwards to the Arduino core.
+ * The sketches still call the core directly, so this is only built with
+ * -DUTRA_HAL_AVR: its Servo objects would otherwise each claim a Servo
+ * slot and RAM on the Uno for nothing.
+ */
+
+#if defined(ARDUINO_ARCH_AVR) && defined(UTRA_HAL_AVR)
+
+#include <Arduino.h>
+#include <Servo.h>
+#include "hal.h"
+
+static Servo servos[HAL_SERVO_MAX];
+static uint8_t servoCount = 0;
+
+void halPinMode(uint8_t pin, uint8_t mode) { pinMode(pin, mode); }
+void halDigitalWrite(uint8_t pin, uint8_t value) { digitalWrite(pin, value); }
+int halDigitalRead(uint8_t pin) { return digitalRead(pin); }
+int halAnalogRead(uint8_t pin) { return analogRead(pin); }
+void halAnalogWrite(uint8_t pin, int value) { analogWrite(pin, value); }
+
+unsigned long halPulseIn(uint8_t pin, uint8_t state, unsigned long timeoutUs) {
+  return pulseIn(pin, state, timeoutUs);
+}
+
+unsigned long halMillis() { return millis(); }
+unsigned long halMicros() { return micros(); }
+void halDelay(unsigned long ms) { delay(ms); }
+void halDelayMicroseconds(unsigned int us) { delayMicroseconds(us); }
+
+int halServoAttach(uint8_t pin) {
+  if (servoCount >= HAL_SERVO_MAX) return -1;
+  servos[servoCount].attach(pin);
+  return servoCount++;
+}
+
+void halServoWrite(int channel, int degrees) {
+  if (channel >= 0 && channel < servoCount) servos[channel].write(degrees);
+}
+
+void halSerialBegin(unsigned long baud) { Serial.begin(baud); }
+size_t halSerialWrite(const uint8_t *data, size_t len) { return Serial.write(data, len); }
+int halSerialAvailableForWrite() { return Serial.availableForWrite(); }
+int halSerialAvailable() { return Serial.available(); }
+int halSerialRead() { return Serial.read(); }
+
+#endif
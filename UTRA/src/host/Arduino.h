@@ -0,0 +1,117 @@
+/**
+ * Arduino API for host builds ([env:native]).
+ * Only what the sketches actually use, implemented on top of hal.h so the
+ * host backend (hal_host.cpp) decides what pins, time and serial mean.
+ */
+
+#ifndef UTRA_HOST_ARDUINO_H
+#define UTRA_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+#include "hal.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+// Uno (ATmega328P) timer outputs, as in the AVR core's pins_arduino.h
+#define digitalPinHasPWM(p) ((p) == 3 || (p) == 5 || (p) == 6 || (p) == 9 || (p) == 10 || (p) == 11)
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define memcpy_P memcpy
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+template <class A, class B>
+inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B>
+inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+
+inline void pinMode(uint8_t pin, uint8_t mode) { halPinMode(pin, mode); }
+inline void digitalWrite(uint8_t pin, uint8_t value) { halDigitalWrite(pin, value); }
+inline int digitalRead(uint8_t pin) { return halDigitalRead(pin); }
+inline int analogRead(uint8_t pin) { return halAnalogRead(pin); }
+inline void analogWrite(uint8_t pin, int value) { halAnalogWrite(pin, value); }
+inline unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000UL) {
+  return halPulseIn(pin, state, timeout);
+}
+inline unsigned long millis() { return halMillis(); }
+inline unsigned long micros() { return halMicros(); }
+inline void delay(unsigned long ms) { halDelay(ms); }
+inline void delayMicroseconds(unsigned int us) { halDelayMicroseconds(us); }
+
+class String {
+ public:
+  String(const char *s = "") : s_(s) {}
+  String(const std::string &s) : s_(s) {}
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  bool operator==(const char *o) const { return s_ == o; }
+
+ private:
+  std::string s_;
+};
+
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud) { halSerialBegin(baud); }
+  size_t write(uint8_t b) { return halSerialWrite(&b, 1); }
+  size_t write(const uint8_t *data, size_t len) { return halSerialWrite(data, len); }
+  int availableForWrite() { return halSerialAvailableForWrite(); }
+  int available() { return halSerialAvailable(); }
+  int read() { return halSerialRead(); }
+
+  size_t print(const char *s) { return halSerialWrite((const uint8_t *)s, strlen(s)); }
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(double v) { return printFormatted("%.2f", v); }
+  template <class T>
+  size_t print(T v) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "unsupported print type");
+    return printFormatted("%lld", (long long)v);
+  }
+  template <class T>
+  size_t println(T v) { size_t n = print(v); return n + println(); }
+  size_t println() { return print("\r\n"); }
+
+ private:
+  template <class T>
+  size_t printFormatted(const char *fmt, T v) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), fmt, v);
+    return halSerialWrite((const uint8_t *)buf, n > 0 ? (size_t)n : 0);
+  }
+};
+
+extern HardwareSerial Serial;
+
+// Arduino entry points, provided by the sketch
+void setup();
+void loop();
+
+#endif
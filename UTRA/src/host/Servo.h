@@ -0,0 +1,23 @@
+/**
+ * Servo library for host builds, backed by the HAL servo channels.
+ */
+
+#ifndef UTRA_HOST_SERVO_H
+#define UTRA_HOST_SERVO_H
+
+#include "hal.h"
+
+class Servo {
+ public:
+  uint8_t attach(int pin) {
+    channel_ = halServoAttach((uint8_t)pin);
+    return channel_ < 0 ? 0 : (uint8_t)channel_;
+  }
+  void write(int degrees) { halServoWrite(channel_, degrees); }
+  bool attached() const { return channel_ >= 0; }
+
+ private:
+  int channel_ = -1;
+};
+
+#endif
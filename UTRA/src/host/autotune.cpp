@@ -0,0 +1,367 @@
+/**
+ * Host autotuner - see autotune.h
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "autotune.h"
+#include "montecarlo.h"
+#include "sim_batch.h"
+#include "sim_programs.h"
+#include "tunable.h"
+
+const double TOUCH_PENALTY_MS = 5000.0;
+const double FAIL_PENALTY_MS = 120000.0;
+const double PROGRESS_CREDIT_MS = 100000.0;  // taken off the fail penalty for finishing every state
+const double DISTANCE_CREDIT_MS_PER_CM = 2.0;
+const double DISTANCE_CREDIT_MAX_MS = 2000.0;  // below one state's share, so only a tie-break
+const double ES_SIGMA_START = 0.3;       // in units of each parameter's range
+const double ES_SIGMA_MIN = 0.02;
+
+typedef struct {
+  const char *file;
+  const char *name;
+  long minValue, maxValue, defaultValue;
+} Param;
+
+typedef struct {
+  std::vector<long> values;
+  int completed;          // runs out of Problem::seeds that finished
+  double meanMs;          // completion time, mean over the runs that finished
+  double touches;         // per run
+  double score;           // mean over the seeds
+} Candidate;
+
+typedef struct {
+  const SimProgram *program;
+  std::vector<Param> params;
+  std::vector<std::string> passArgs;   // forwarded to every run
+  unsigned long maxMs;
+  int seeds;              // runs per candidate, seeds 1..seeds, the same for every candidate
+} Problem;
+
+// An unfinished run is credited for how far through the program's state
+// machines it got, and a little for distance covered, never enough to
+// rank it with a run that finished.
+static double scoreRun(const SimProgram *program, const SimRunResult &r, unsigned long maxMs) {
+  if (!r.parsed) return FAIL_PENALTY_MS * 2 + maxMs;
+  double score = r.complete ? (double)r.timeMs : (double)maxMs + FAIL_PENALTY_MS;
+  if (!r.complete) {
+    score -= simProgramProgress(program, r.machine, r.state) * PROGRESS_CREDIT_MS;
+    score -= std::min(r.distanceCm * DISTANCE_CREDIT_MS_PER_CM, DISTANCE_CREDIT_MAX_MS);
+  }
+  return score + r.touches * TOUCH_PENALTY_MS;
+}
+
+// Every candidate runs on the same seeds, so candidates are compared on
+// the same noise draws rather than on their luck.
+static void evaluate(const Problem &problem, std::vector<Candidate> *batch, WorkPool *pool) {
+  std::vector<SimRunArgs> runs;
+  for (size_t i = 0; i < batch->size(); i++) {
+    SimRunArgs args;
+    args.push_back("--program");
+    args.push_back(problem.program->name);
+    args.push_back("--max-ms");
+    args.push_back(std::to_string(problem.maxMs));
+    args.insert(args.end(), problem.passArgs.begin(), problem.passArgs.end());
+    for (size_t p = 0; p < problem.params.size(); p++) {
+      args.push_back("--set");
+      const Param &param = problem.params[p];
+      args.push_back(std::string(param.file) + ":" + param.name + "=" + std::to_string((*batch)[i].values[p]));
+    }
+    for (int s = 0; s < problem.seeds; s++) {
+      SimRunArgs seeded = args;
+      seeded.push_back("--seed");
+      seeded.push_back(std::to_string(s + 1));
+      runs.push_back(seeded);
+    }
+  }
+  std::vector<SimRunResult> results = simBatchRun(runs, pool);
+  for (size_t i = 0; i < batch->size(); i++) {
+    Candidate &c = (*batch)[i];
+    double score = 0, timeMs = 0, touches = 0;
+    c.completed = 0;
+    for (int s = 0; s < problem.seeds; s++) {
+      const SimRunResult &r = results[i * problem.seeds + s];
+      score += scoreRun(problem.program, r, problem.maxMs);
+      touches += r.touches;
+      if (r.complete) {
+        c.completed++;
+        timeMs += r.timeMs;
+      }
+    }
+    c.score = score / problem.seeds;
+    c.touches = touches / problem.seeds;
+    c.meanMs = c.completed > 0 ? timeMs / c.completed : 0.0;
+  }
+}
+
+static long fromUnit(const Param &p, double u) {
+  u = std::max(0.0, std::min(1.0, u));
+  return p.minValue + (long)lround(u * (p.maxValue - p.minValue));
+}
+
+static double toUnit(const Param &p, long v) {
+  return p.maxValue > p.minValue ? (double)(v - p.minValue) / (p.maxValue - p.minValue) : 0.0;
+}
+
+static Candidate defaults(const Problem &problem) {
+  Candidate c;
+  for (size_t p = 0; p < problem.params.size(); p++) c.values.push_back(problem.params[p].defaultValue);
+  return c;
+}
+
+// ========== Strategies ==========
+static std::vector<Candidate> searchGrid(const Problem &problem, int budget, int steps, WorkPool *pool) {
+  std::vector<Candidate> batch;
+  size_t n = problem.params.size();
+  std::vector<int> digit(n, 0);
+  while ((int)batch.size() < budget) {
+    Candidate c;
+    for (size_t p = 0; p < n; p++) {
+      c.values.push_back(fromUnit(problem.params[p], steps > 1 ? (double)digit[p] / (steps - 1) : 0.5));
+    }
+    batch.push_back(c);
+    size_t p = 0;
+    while (p < n && ++digit[p] == steps) digit[p++] = 0;
+    if (p == n) break;
+  }
+  evaluate(problem, &batch, pool);
+  return batch;
+}
+
+static std::vector<Candidate> searchRandom(const Problem &problem, int budget, std::mt19937 *rng,
+                                           WorkPool *pool) {
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::vector<Candidate> batch;
+  for (int i = 0; i < budget; i++) {
+    Candidate c;
+    for (size_t p = 0; p < problem.params.size(); p++) c.values.push_back(fromUnit(problem.params[p], unit(*rng)));
+    batch.push_back(c);
+  }
+  evaluate(problem, &batch, pool);
+  return batch;
+}
+
+// (mu/mu_w, lambda) evolution strategy with a per-parameter step size: a
+// diagonal stand-in for CMA-ES that is enough for a dozen loosely coupled
+// integer constants. One generation is evaluated in parallel.
+static std::vector<Candidate> searchEs(const Problem &problem, int budget, std::mt19937 *rng,
+                                       WorkPool *pool) {
+  size_t n = problem.params.size();
+  int lambda = std::max(4 + (int)(3 * log((double)n)), pool->threads());
+  int mu = lambda / 2;
+  std::vector<double> weights(mu);
+  double wsum = 0;
+  for (int i = 0; i < mu; i++) wsum += weights[i] = log(mu + 0.5) - log(i + 1.0);
+  for (int i = 0; i < mu; i++) weights[i] /= wsum;
+
+  std::vector<double> mean(n), sigma(n, ES_SIGMA_START);
+  for (size_t p = 0; p < n; p++) mean[p] = toUnit(problem.params[p], problem.params[p].defaultValue);
+
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  std::vector<Candidate> all;
+  while ((int)all.size() < budget) {
+    std::vector<Candidate> gen;
+    std::vector<std::vector<double> > points;
+    for (int k = 0; k < lambda && (int)(all.size() + gen.size()) < budget; k++) {
+      std::vector<double> x(n);
+      Candidate c;
+      for (size_t p = 0; p < n; p++) {
+        x[p] = std::max(0.0, std::min(1.0, mean[p] + sigma[p] * gauss(*rng)));
+        c.values.push_back(fromUnit(problem.params[p], x[p]));
+      }
+      points.push_back(x);
+      gen.push_back(c);
+    }
+    evaluate(problem, &gen, pool);
+
+    std::vector<int> order(gen.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+    std::sort(order.begin(), order.end(), [&gen](int a, int b) { return gen[a].score < gen[b].score; });
+    int selected = std::min(mu, (int)gen.size());
+    for (size_t p = 0; p < n; p++) {
+      double newMean = 0, spread = 0, used = 0;
+      for (int i = 0; i < selected; i++) {
+        newMean += weights[i] * points[order[i]][p];
+        used += weights[i];
+      }
+      newMean /= used;
+      for (int i = 0; i < selected; i++) {
+        double d = points[order[i]][p] - mean[p];
+        spread += weights[i] * d * d / used;
+      }
+      mean[p] = newMean;
+      sigma[p] = std::max(ES_SIGMA_MIN, 0.7 * sigma[p] + 0.3 * sqrt(spread) * 1.5);
+    }
+    all.insert(all.end(), gen.begin(), gen.end());
+    printf("  generation: %zu runs, best so far %.0f\n", all.size(),
+           std::min_element(all.begin(), all.end(), [](const Candidate &a, const Candidate &b) {
+             return a.score < b.score;
+           })->score);
+  }
+  return all;
+}
+
+// ========== Output ==========
+static const char *headerName(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash != NULL ? slash + 1 : path;
+}
+
+static bool writeHeader(const char *path, const Problem &problem, const Candidate &best,
+                        const Candidate &baseline, const char *strategy, size_t evaluations) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "/**\n");
+  fprintf(f, " * Generated by the host autotuner (program tune) - do not edit by hand.\n");
+  fprintf(f, " * program=%s strategy=%s evaluations=%zu\n", problem.program->name, strategy, evaluations);
+  fprintf(f, " * score %.0f (%d/%d complete, mean %.0f ms, %.2f touches); defaults scored %.0f\n",
+          best.score, best.completed, problem.seeds, best.meanMs, best.touches, baseline.score);
+  fprintf(f, " * Build with -DUTRA_USE_TUNED -DUTRA_TUNED_HEADER='\"%s\"' to use these values.\n",
+          headerName(path));
+  fprintf(f, " */\n\n");
+  fprintf(f, "#ifndef UTRA_TUNED_CONSTANTS_H\n#define UTRA_TUNED_CONSTANTS_H\n\n");
+  fprintf(f, "#define UTRA_TUNED_ENTRIES \\\n");
+  for (size_t p = 0; p < problem.params.size(); p++) {
+    fprintf(f, "  { \"%s\", \"%s\", %ld }, \\\n", problem.params[p].file, problem.params[p].name,
+            best.values[p]);
+  }
+  fprintf(f, "\n#endif\n");
+  fclose(f);
+  return true;
+}
+
+static void collectParams(Problem *problem, const char *only) {
+  for (int i = 0; i < tunableCount(); i++) {
+    const TunableInfo *t = tunableAt(i);
+    bool wanted = false;
+    for (int s = 0; s < SIM_PROGRAM_MAX_SOURCES && problem->program->sources[s] != NULL; s++) {
+      if (tunableDeclaredIn(i, problem->program->sources[s])) wanted = true;
+    }
+    // --params narrows the program's own constants, by NAME or file:NAME.
+    if (wanted && only != NULL) {
+      std::string list = std::string(",") + only + ",";
+      wanted = list.find(std::string(",") + t->name + ",") != std::string::npos ||
+               list.find(std::string(",") + t->file + ":" + t->name + ",") != std::string::npos;
+    }
+    if (wanted) {
+      Param p = { t->file, t->name, t->minValue, t->maxValue, t->value };
+      problem->params.push_back(p);
+    }
+  }
+}
+
+int autotuneMain(int argc, char **argv) {
+  const char *programName = "obstacle";
+  const char *strategy = "es";
+  const char *only = NULL;
+  const char *outPath = NULL;
+  int budget = 200, jobs = 0, gridSteps = 3;
+  unsigned long seed = 1;
+  Problem problem;
+  problem.maxMs = 120000;
+  problem.seeds = 5;
+  bool noise = true;
+  std::map<std::string, std::string> variation;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--program") == 0 && hasValue) programName = argv[++i];
+    else if (strcmp(argv[i], "--strategy") == 0 && hasValue) strategy = argv[++i];
+    else if (strcmp(argv[i], "--budget") == 0 && hasValue) budget = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--jobs") == 0 && hasValue) jobs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--grid-steps") == 0 && hasValue) gridSteps = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--params") == 0 && hasValue) only = argv[++i];
+    else if (strcmp(argv[i], "--seed") == 0 && hasValue) seed = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--max-ms") == 0 && hasValue) problem.maxMs = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--out") == 0 && hasValue) outPath = argv[++i];
+    else if (strcmp(argv[i], "--seeds") == 0 && hasValue) problem.seeds = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--no-noise") == 0) noise = false;
+    else if (montecarloIsVariationFlag(argv[i]) && hasValue) {
+      variation[argv[i]] = argv[i + 1];
+      i++;
+    }
+    else if ((strcmp(argv[i], "--floor") == 0 || strcmp(argv[i], "--shapes") == 0) && hasValue) {
+      problem.passArgs.push_back(argv[i]);
+      problem.passArgs.push_back(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s tune [--program NAME] [--strategy grid|random|es] [--budget N] "
+              "[--jobs N] [--grid-steps K] [--params A,B] [--seed S] [--max-ms N] "
+              "[--floor FILE] [--shapes FILE] [--out FILE] [--seeds N] [--no-noise] "
+              "[--colour-noise F] ... (see montecarlo)\n", argv[0]);
+      return 2;
+    }
+  }
+
+  problem.program = simFindProgram(programName);
+  if (problem.program == NULL) {
+    fprintf(stderr, "unknown program %s\n", programName);
+    return 2;
+  }
+  // The montecarlo spread, with any flag given here in place of its default.
+  if (noise) {
+    SimRunArgs spread;
+    montecarloVariationArgs(&spread);
+    for (size_t a = 0; a + 1 < spread.size(); a += 2) {
+      if (variation.count(spread[a]) == 0) variation[spread[a]] = spread[a + 1];
+    }
+  }
+  for (std::map<std::string, std::string>::const_iterator it = variation.begin(); it != variation.end(); ++it) {
+    problem.passArgs.push_back(it->first);
+    problem.passArgs.push_back(it->second);
+  }
+  std::string defaultOut = std::string("include/tuned_") + programName + ".h";
+  if (outPath == NULL) outPath = defaultOut.c_str();
+  collectParams(&problem, only);
+  if (problem.params.empty()) {
+    fprintf(stderr, "no tunable constants for %s\n", programName);
+    return 2;
+  }
+
+  WorkPool pool(jobs);
+  std::mt19937 rng(seed);
+  printf("tuning %s: %zu constants, %s, budget %d x %d seeds, %d threads\n", programName,
+         problem.params.size(), strategy, budget, problem.seeds, pool.threads());
+
+  std::vector<Candidate> baseline(1, defaults(problem));
+  evaluate(problem, &baseline, &pool);
+
+  std::vector<Candidate> all;
+  if (strcmp(strategy, "grid") == 0) all = searchGrid(problem, budget, gridSteps, &pool);
+  else if (strcmp(strategy, "random") == 0) all = searchRandom(problem, budget, &rng, &pool);
+  else if (strcmp(strategy, "es") == 0) all = searchEs(problem, budget, &rng, &pool);
+  else {
+    fprintf(stderr, "unknown strategy %s\n", strategy);
+    return 2;
+  }
+  all.push_back(baseline[0]);
+  std::sort(all.begin(), all.end(), [](const Candidate &a, const Candidate &b) { return a.score < b.score; });
+
+  printf("defaults: score %.0f (%d/%d complete, mean %.0f ms)\n", baseline[0].score, baseline[0].completed,
+         problem.seeds, baseline[0].meanMs);
+  for (size_t i = 0; i < all.size() && i < 5; i++) {
+    printf("#%zu score %.0f (%d/%d complete, mean %.0f ms, %.2f touches):", i + 1, all[i].score,
+           all[i].completed, problem.seeds, all[i].meanMs, all[i].touches);
+    for (size_t p = 0; p < problem.params.size(); p++) {
+      printf(" %s:%s=%ld", problem.params[p].file, problem.params[p].name, all[i].values[p]);
+    }
+    printf("\n");
+  }
+  if (!(all[0].score < baseline[0].score)) {
+    printf("no candidate beat the defaults; %s left unchanged\n", outPath);
+    return 1;
+  }
+  if (!writeHeader(outPath, problem, all[0], baseline[0], strategy, all.size())) return 1;
+  printf("wrote %s\n", outPath);
+  return 0;
+}
@@ -0,0 +1,27 @@
+/**
+ * Host autotuner for the TUNABLE constants (see tunable.h).
+ *
+ *   program tune [--program NAME] [--strategy grid|random|es] [--budget N]
+ *                [--jobs N] [--grid-steps K] [--params A,B,...] [--seed S]
+ *                [--max-ms N] [--floor FILE] [--shapes FILE] [--out FILE]
+ *                [--seeds N] [--no-noise] [--colour-noise F] ...
+ *
+ * The program defaults to obstacle, the one that completes on its default
+ * course. Each candidate is run on --seeds seeds (5) with the montecarlo
+ * spread (montecarlo.h; its flags override it here, --no-noise drops it),
+ * and scored by the mean over those runs of completion time plus
+ * penalties for obstacle touches and for not finishing (less the further
+ * through its state machines the program got, with distance driven as a
+ * tie-break). --budget counts candidates. Only the program's own sketches' constants are searched,
+ * each under its file:NAME entry. The best candidate is written to
+ * include/tuned_<program>.h (or --out) for -DUTRA_USE_TUNED, but only if it
+ * scores strictly better than the defaults; otherwise the file is left
+ * alone and tune exits 1.
+ */
+
+#ifndef UTRA_HOST_AUTOTUNE_H
+#define UTRA_HOST_AUTOTUNE_H
+
+int autotuneMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * Host side of the microbenchmarks - see bench_host.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "bench_host.h"
+#include "hal_host.h"
+
+typedef struct {
+  std::string unit;
+  std::map<std::string, double> perCall;
+} BenchReport;
+
+static void collect(const BenchResult *r, void *ctx) {
+  std::vector<BenchResult> *results = (std::vector<BenchResult> *)ctx;
+  results->push_back(*r);
+  printf("  %-24s %10.2f %s\n", r->name, r->perCall, benchUnit());
+}
+
+static bool writeJson(const char *path, const std::vector<BenchResult> &results) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "{\"target\": \"%s\", \"unit\": \"%s\", \"results\": [", benchTarget(), benchUnit());
+  for (size_t i = 0; i < results.size(); i++) {
+    fprintf(f, "%s\n    {\"name\": \"%s\", \"per_call\": %.2f, \"iterations\": %lu}", i ? "," : "",
+            results[i].name, results[i].perCall, (unsigned long)results[i].iterations);
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  return true;
+}
+
+// Reads the format writeJson() and benchPrintJson() produce: one result
+// object per line. Anything before the opening brace (serial monitor noise)
+// is skipped.
+static bool readJson(const char *path, BenchReport *report) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    const char *p = strstr(line, "\"unit\": \"");
+    if (p != NULL) {
+      p += 9;
+      report->unit.assign(p, strcspn(p, "\""));
+    }
+    p = strstr(line, "\"name\": \"");
+    const char *v = strstr(line, "\"per_call\": ");
+    if (p != NULL && v != NULL) {
+      p += 9;
+      report->perCall[std::string(p, strcspn(p, "\""))] = strtod(v + 12, NULL);
+    }
+  }
+  fclose(f);
+  return !report->perCall.empty();
+}
+
+int benchMain(int argc, char **argv) {
+  const char *filter = NULL;
+  const char *jsonPath = NULL;
+  const char *basePath = NULL;
+  double threshold = 10.0;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--filter") == 0 && hasValue) filter = argv[++i];
+    else if (strcmp(argv[i], "--json") == 0 && hasValue) jsonPath = argv[++i];
+    else if (strcmp(argv[i], "--compare") == 0 && hasValue) basePath = argv[++i];
+    else if (strcmp(argv[i], "--threshold") == 0 && hasValue) threshold = strtod(argv[++i], NULL);
+    else {
+      fprintf(stderr, "usage: %s bench [--filter TEXT] [--json FILE] [--compare BASE.json] "
+              "[--threshold PCT]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  hostReset();   // driveMotor() writes pins
+  std::vector<BenchResult> results;
+  printf("bench (%s, %s per call):\n", benchTarget(), benchUnit());
+  benchRunAll(filter, collect, &results);
+  if (jsonPath != NULL && !writeJson(jsonPath, results)) return 1;
+  if (basePath == NULL) return 0;
+
+  BenchReport base;
+  if (!readJson(basePath, &base)) {
+    fprintf(stderr, "%s: no results\n", basePath);
+    return 1;
+  }
+  if (base.unit != benchUnit()) {
+    fprintf(stderr, "%s is in %s, this run is in %s\n", basePath, base.unit.c_str(), benchUnit());
+    return 1;
+  }
+  int regressions = 0;
+  printf("against %s (threshold %.0f%%):\n", basePath, threshold);
+  for (size_t i = 0; i < results.size(); i++) {
+    std::map<std::string, double>::const_iterator it = base.perCall.find(results[i].name);
+    if (it == base.perCall.end()) {
+      printf("  %-24s new\n", results[i].name);
+      continue;
+    }
+    double change = it->second > 0 ? 100.0 * (results[i].perCall - it->second) / it->second : 0.0;
+    bool regressed = change > threshold;
+    if (regressed) regressions++;
+    printf("  %-24s %10.2f -> %10.2f  %+6.1f%%%s\n", results[i].name, it->second, results[i].perCall,
+           change, regressed ? "  REGRESSION" : "");
+  }
+  return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+/**
+ * Host side of the microbenchmarks (see bench.h).
+ *
+ *   program bench [--filter TEXT] [--json FILE] [--compare BASE.json]
+ *                 [--threshold PCT]
+ *
+ * --compare reads an earlier report (host or the Uno's serial output saved
+ * to a file), prints the change per kernel and exits non-zero when any
+ * kernel got slower by more than the threshold (default 10%).
+ */
+
+#ifndef UTRA_HOST_BENCH_HOST_H
+#define UTRA_HOST_BENCH_HOST_H
+
+int benchMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,500 @@
+/**
+ * Colour classifier trainer - see colour_train.h
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "colour_classifier.h"
+#include "colour_train.h"
+#include "trace_replay.h"
+#include "tunable.h"
+
+const int COLOUR_LABEL_COUNT = 5;
+static const char *const LABEL_NAMES[COLOUR_LABEL_COUNT] = { "white", "red", "green", "blue", "black" };
+const int HOLDOUT_EVERY = 5;
+const int TREE_MIN_LEAF = 5;
+const int TREE_MAX_DEPTH = 6;            // int8_t child indices
+const double WEIGHT_LIMIT = 16383.0;     // with widths <= COLOUR_WIDTH_MAX, three
+const double BIAS_LIMIT = 536870912.0;   // products plus the bias stay in int32
+
+typedef struct {
+  uint16_t width[3];
+  int label;                              // PathColour
+} ColourSample;
+
+// A quantised model plus the storage its ColourModel points into.
+typedef struct {
+  std::vector<uint8_t> labels;
+  std::vector<ColourLinearTerm> linear;
+  std::vector<ColourTreeNode> tree;
+  ColourModel model;
+} TrainedModel;
+
+// ========== Data ==========
+static int parseLabel(const std::string &text) {
+  for (int i = 0; i < COLOUR_LABEL_COUNT; i++) {
+    if (strcasecmp(text.c_str(), LABEL_NAMES[i]) == 0) return i;
+  }
+  char *end;
+  long n = strtol(text.c_str(), &end, 10);
+  if (end != text.c_str() && *end == '\0' && n >= 0 && n < COLOUR_LABEL_COUNT) return (int)n;
+  return -1;
+}
+
+static std::vector<std::string> splitCsv(const char *line) {
+  std::vector<std::string> fields;
+  std::string field;
+  for (const char *p = line; *p != '\0' && *p != '\n' && *p != '\r'; p++) {
+    if (*p == ',') {
+      fields.push_back(field);
+      field.clear();
+    } else if (*p != ' ') {
+      field += *p;
+    }
+  }
+  fields.push_back(field);
+  return fields;
+}
+
+static bool loadLabelledCsv(const char *path, std::vector<ColourSample> *out, std::string *error) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    *error = strerror(errno);
+    return false;
+  }
+  char line[256];
+  int col[4] = { -1, -1, -1, -1 };
+  static const char *const COLUMNS[4] = { "red_pw", "green_pw", "blue_pw", "label" };
+  if (fgets(line, sizeof(line), f) != NULL) {
+    std::vector<std::string> header = splitCsv(line);
+    for (size_t i = 0; i < header.size(); i++) {
+      for (int c = 0; c < 4; c++) {
+        if (header[i] == COLUMNS[c]) col[c] = (int)i;
+      }
+    }
+  }
+  for (int c = 0; c < 4; c++) {
+    if (col[c] < 0) {
+      *error = std::string("no ") + COLUMNS[c] + " column";
+      fclose(f);
+      return false;
+    }
+  }
+  int lineNo = 1;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineNo++;
+    std::vector<std::string> v = splitCsv(line);
+    if (v.size() == 1 && v[0].empty()) continue;
+    ColourSample s;
+    s.label = (int)v.size() > col[3] ? parseLabel(v[col[3]]) : -1;
+    if (s.label < 0) {
+      *error = "line " + std::to_string(lineNo) + ": bad label";
+      fclose(f);
+      return false;
+    }
+    for (int c = 0; c < 3; c++) {
+      long w = (int)v.size() > col[c] ? atol(v[col[c]].c_str()) : 0;
+      s.width[c] = (uint16_t)std::min(std::max(w, 0L), (long)COLOUR_WIDTH_MAX);
+    }
+    out->push_back(s);
+  }
+  fclose(f);
+  return true;
+}
+
+// LABEL=TRACE: every frame with a reading is that colour.
+static bool loadLabelledTrace(const char *arg, std::vector<ColourSample> *out, std::string *error) {
+  const char *eq = strchr(arg, '=');
+  int label = parseLabel(std::string(arg, eq - arg));
+  if (label < 0) {
+    *error = "bad label";
+    return false;
+  }
+  Trace trace;
+  if (!traceLoad(eq + 1, &trace, error)) return false;
+  for (size_t i = 0; i < trace.samples.size(); i++) {
+    const SensorFrame &f = trace.samples[i].frame;
+    if (f.redPW == 0 && f.greenPW == 0 && f.bluePW == 0) continue;   // sensor timed out
+    ColourSample s = { { std::min(f.redPW, COLOUR_WIDTH_MAX), std::min(f.greenPW, COLOUR_WIDTH_MAX),
+                         std::min(f.bluePW, COLOUR_WIDTH_MAX) }, label };
+    out->push_back(s);
+  }
+  return true;
+}
+
+// ========== Linear models ==========
+static bool invert3(const double m[3][3], double out[3][3]) {
+  double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+               m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+               m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  if (fabs(det) < 1e-12) return false;
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++) {
+      // cofactor of m[c][r], transposed
+      int r0 = (c + 1) % 3, r1 = (c + 2) % 3, c0 = (r + 1) % 3, c1 = (r + 2) % 3;
+      out[r][c] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+    }
+  }
+  return true;
+}
+
+// Nearest centroid (Euclidean, or Mahalanobis with the pooled within-class
+// covariance) as argmax of w.x + b, then scaled into int16 weights.
+static void fitLinear(const std::vector<ColourSample> &data, bool mahalanobis, TrainedModel *m) {
+  size_t k = m->labels.size();
+  std::vector<double> mean(k * 3, 0.0);
+  std::vector<int> count(k, 0);
+  for (size_t i = 0; i < data.size(); i++) {
+    size_t cls = std::find(m->labels.begin(), m->labels.end(), data[i].label) - m->labels.begin();
+    for (int c = 0; c < 3; c++) mean[cls * 3 + c] += data[i].width[c];
+    count[cls]++;
+  }
+  for (size_t cls = 0; cls < k; cls++) {
+    for (int c = 0; c < 3; c++) mean[cls * 3 + c] /= std::max(count[cls], 1);
+  }
+
+  double metric[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+  if (mahalanobis) {
+    double cov[3][3] = { { 0 } };
+    for (size_t i = 0; i < data.size(); i++) {
+      size_t cls = std::find(m->labels.begin(), m->labels.end(), data[i].label) - m->labels.begin();
+      for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+          cov[r][c] += (data[i].width[r] - mean[cls * 3 + r]) * (data[i].width[c] - mean[cls * 3 + c]);
+        }
+      }
+    }
+    double n = std::max((double)data.size() - k, 1.0);
+    double ridge = 1.0 + 1e-3 * (cov[0][0] + cov[1][1] + cov[2][2]) / (3.0 * n);
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 3; c++) cov[r][c] /= n;
+      cov[r][r] += ridge;
+    }
+    if (!invert3(cov, metric)) fprintf(stderr, "covariance is singular, using Euclidean distance\n");
+  }
+
+  std::vector<double> w(k * 3), b(k);
+  double maxW = 1e-9, maxB = 1e-9;
+  for (size_t cls = 0; cls < k; cls++) {
+    const double *mu = &mean[cls * 3];
+    double quad = 0;
+    for (int r = 0; r < 3; r++) {
+      double v = 0;
+      for (int c = 0; c < 3; c++) v += metric[r][c] * mu[c];
+      w[cls * 3 + r] = v;
+      quad += mu[r] * v;
+      maxW = std::max(maxW, fabs(v));
+    }
+    b[cls] = -0.5 * quad;
+    maxB = std::max(maxB, fabs(b[cls]));
+  }
+
+  double scale = std::min(WEIGHT_LIMIT / maxW, BIAS_LIMIT / maxB);
+  m->linear.resize(k);
+  for (size_t cls = 0; cls < k; cls++) {
+    for (int c = 0; c < 3; c++) m->linear[cls].weight[c] = (int16_t)lround(w[cls * 3 + c] * scale);
+    m->linear[cls].bias = (int32_t)llround(b[cls] * scale);
+  }
+}
+
+// ========== Decision tree ==========
+static double gini(const std::vector<int> &counts, int total) {
+  if (total == 0) return 0.0;
+  double g = 1.0;
+  for (size_t i = 0; i < counts.size(); i++) g -= (double)counts[i] * counts[i] / ((double)total * total);
+  return g;
+}
+
+static int majority(const std::vector<ColourSample> &data, const std::vector<int> &idx, const TrainedModel &m) {
+  std::vector<int> counts(m.labels.size(), 0);
+  for (size_t i = 0; i < idx.size(); i++) {
+    counts[std::find(m.labels.begin(), m.labels.end(), data[idx[i]].label) - m.labels.begin()]++;
+  }
+  return (int)(std::max_element(counts.begin(), counts.end()) - counts.begin());
+}
+
+// CART on the raw widths with integer thresholds; returns the node index or
+// ~class for a leaf.
+static int8_t growTree(const std::vector<ColourSample> &data, std::vector<int> idx, int depth, TrainedModel *m) {
+  size_t k = m->labels.size();
+  int leaf = majority(data, idx, *m);
+  if (depth == 0 || (int)idx.size() < 2 * TREE_MIN_LEAF) return (int8_t)~leaf;
+
+  std::vector<int> total(k, 0);
+  for (size_t i = 0; i < idx.size(); i++) {
+    total[std::find(m->labels.begin(), m->labels.end(), data[idx[i]].label) - m->labels.begin()]++;
+  }
+  double parent = gini(total, (int)idx.size());
+  if (parent == 0.0) return (int8_t)~leaf;
+
+  double bestGain = 1e-9;
+  int bestChannel = -1;
+  uint16_t bestThreshold = 0;
+  for (int c = 0; c < 3; c++) {
+    std::sort(idx.begin(), idx.end(), [&data, c](int a, int b) { return data[a].width[c] < data[b].width[c]; });
+    std::vector<int> left(k, 0);
+    for (size_t i = 0; i + 1 < idx.size(); i++) {
+      left[std::find(m->labels.begin(), m->labels.end(), data[idx[i]].label) - m->labels.begin()]++;
+      uint16_t lo = data[idx[i]].width[c], hi = data[idx[i + 1]].width[c];
+      int nLeft = (int)i + 1, nRight = (int)idx.size() - nLeft;
+      if (lo == hi || nLeft < TREE_MIN_LEAF || nRight < TREE_MIN_LEAF) continue;
+      std::vector<int> right(k);
+      for (size_t j = 0; j < k; j++) right[j] = total[j] - left[j];
+      double gain = parent - (nLeft * gini(left, nLeft) + nRight * gini(right, nRight)) / idx.size();
+      if (gain > bestGain) {
+        bestGain = gain;
+        bestChannel = c;
+        bestThreshold = (uint16_t)((lo + hi + 1) / 2);   // lo < threshold <= hi
+      }
+    }
+  }
+  if (bestChannel < 0) return (int8_t)~leaf;
+
+  int8_t self = (int8_t)m->tree.size();
+  ColourTreeNode node = { (uint8_t)bestChannel, bestThreshold, 0, 0 };
+  m->tree.push_back(node);
+  std::vector<int> below, above;
+  for (size_t i = 0; i < idx.size(); i++) {
+    (data[idx[i]].width[bestChannel] < bestThreshold ? below : above).push_back(idx[i]);
+  }
+  int8_t b = growTree(data, below, depth - 1, m);
+  int8_t a = growTree(data, above, depth - 1, m);
+  m->tree[self].below = b;
+  m->tree[self].above = a;
+  // both sides agree: the split only moved impurity around
+  if (b < 0 && b == a) {
+    m->tree.pop_back();
+    return b;
+  }
+  return self;
+}
+
+static void fit(const std::vector<ColourSample> &data, const char *kind, int depth, TrainedModel *m) {
+  m->labels.clear();
+  m->linear.clear();
+  m->tree.clear();
+  for (size_t i = 0; i < data.size(); i++) {
+    if (std::find(m->labels.begin(), m->labels.end(), data[i].label) == m->labels.end()) {
+      m->labels.push_back((uint8_t)data[i].label);
+    }
+  }
+  std::sort(m->labels.begin(), m->labels.end());
+  if (strcmp(kind, "tree") == 0) {
+    std::vector<int> idx(data.size());
+    for (size_t i = 0; i < idx.size(); i++) idx[i] = (int)i;
+    int8_t root = growTree(data, idx, depth, m);
+    if (root < 0) {
+      // a single leaf: one node whose both sides are that class
+      ColourTreeNode node = { 0, 0, root, root };
+      m->tree.push_back(node);
+    }
+  } else {
+    fitLinear(data, strcmp(kind, "mahalanobis") == 0, m);
+  }
+  ColourModel model = { (uint8_t)m->labels.size(), m->labels.data(),
+                        m->linear.empty() ? NULL : m->linear.data(), m->tree.empty() ? NULL : m->tree.data() };
+  m->model = model;
+}
+
+// Distance in us of pulse width from the sample to the nearest decision
+// boundary: for linear models the boundary between the two best classes, for
+// trees the closest threshold on the path taken.
+static double margin(const TrainedModel &m, const ColourSample &s) {
+  if (!m.tree.empty()) {
+    double best = 1e9;
+    int8_t i = 0;
+    while (i >= 0) {
+      const ColourTreeNode &n = m.tree[i];
+      if (n.below == n.above) break;
+      best = std::min(best, fabs((double)s.width[n.channel] - (n.threshold - 0.5)));
+      i = s.width[n.channel] < n.threshold ? n.below : n.above;
+    }
+    return best;
+  }
+  size_t top = 0, second = 1;
+  std::vector<double> score(m.linear.size());
+  for (size_t k = 0; k < m.linear.size(); k++) {
+    score[k] = m.linear[k].bias;
+    for (int c = 0; c < 3; c++) score[k] += (double)m.linear[k].weight[c] * s.width[c];
+  }
+  if (score.size() < 2) return 1e9;
+  if (score[second] > score[top]) std::swap(top, second);
+  for (size_t k = 2; k < score.size(); k++) {
+    if (score[k] > score[top]) {
+      second = top;
+      top = k;
+    } else if (score[k] > score[second]) {
+      second = k;
+    }
+  }
+  double norm = 0;
+  for (int c = 0; c < 3; c++) {
+    double d = (double)m.linear[top].weight[c] - m.linear[second].weight[c];
+    norm += d * d;
+  }
+  return norm > 0 ? (score[top] - score[second]) / sqrt(norm) : 1e9;
+}
+
+// The sketches' getColour() rule with the compiled-in thresholds.
+static int handThresholds(const ColourSample &s, long black, long white) {
+  if (s.width[0] > black && s.width[1] > black && s.width[2] > black) return 4;
+  if (s.width[0] < white && s.width[1] < white && s.width[2] < white) return 0;
+  uint16_t lowest = std::min(s.width[0], std::min(s.width[1], s.width[2]));
+  if (lowest == s.width[0]) return 1;
+  if (lowest == s.width[1]) return 2;
+  return 3;
+}
+
+static long tunableValue(const char *name, long fallback) {
+  for (int i = 0; i < tunableCount(); i++) {
+    if (strcmp(tunableAt(i)->name, name) == 0) return tunableAt(i)->value;
+  }
+  return fallback;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0.0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p / 100.0 * v.size()))];
+}
+
+// ========== Report ==========
+static double report(const TrainedModel &m, const std::vector<ColourSample> &test) {
+  long black = tunableValue("blackThreshold", 100), white = tunableValue("whiteThreshold", 40);
+  int confusion[COLOUR_LABEL_COUNT][COLOUR_LABEL_COUNT] = { { 0 } };
+  std::vector<double> margins[COLOUR_LABEL_COUNT];
+  int correct = 0, handCorrect = 0;
+  for (size_t i = 0; i < test.size(); i++) {
+    const ColourSample &s = test[i];
+    int predicted = colourClassify(&m.model, s.width[0], s.width[1], s.width[2]);
+    confusion[s.label][predicted]++;
+    if (predicted == s.label) {
+      correct++;
+      margins[s.label].push_back(margin(m, s));
+    }
+    if (handThresholds(s, black, white) == s.label) handCorrect++;
+  }
+
+  printf("held-out confusion (rows = label, columns = predicted):\n%8s", "");
+  for (int c = 0; c < COLOUR_LABEL_COUNT; c++) printf("%7s", LABEL_NAMES[c]);
+  printf("\n");
+  for (int r = 0; r < COLOUR_LABEL_COUNT; r++) {
+    int rowTotal = 0;
+    for (int c = 0; c < COLOUR_LABEL_COUNT; c++) rowTotal += confusion[r][c];
+    if (rowTotal == 0) continue;
+    printf("%8s", LABEL_NAMES[r]);
+    for (int c = 0; c < COLOUR_LABEL_COUNT; c++) printf("%7d", confusion[r][c]);
+    printf("\n");
+  }
+  double accuracy = test.empty() ? 0.0 : 100.0 * correct / test.size();
+  printf("accuracy %.1f%% held out; hand thresholds (black %ld, white %ld) %.1f%%\n", accuracy, black,
+         white, test.empty() ? 0.0 : 100.0 * handCorrect / test.size());
+  printf("margin to the nearest boundary, correct held-out samples (us):\n");
+  for (int r = 0; r < COLOUR_LABEL_COUNT; r++) {
+    if (margins[r].empty()) continue;
+    printf("  %-6s min %7.1f  p5 %7.1f  median %7.1f\n", LABEL_NAMES[r], percentile(margins[r], 0),
+           percentile(margins[r], 5), percentile(margins[r], 50));
+  }
+  return accuracy;
+}
+
+// ========== Output ==========
+static bool writeHeader(const char *path, const TrainedModel &m, const char *kind, int depth,
+                        size_t samples, double accuracy) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "/**\n");
+  fprintf(f, " * Generated by the colour trainer (program train-colour) - do not edit by hand.\n");
+  if (m.tree.empty()) fprintf(f, " * model=%s samples=%zu held-out accuracy %.1f%%\n", kind, samples, accuracy);
+  else fprintf(f, " * model=tree depth=%d nodes=%zu samples=%zu held-out accuracy %.1f%%\n", depth,
+               m.tree.size(), samples, accuracy);
+  fprintf(f, " * Build with -DUTRA_COLOUR_MODEL to use it in getColour().\n");
+  fprintf(f, " */\n\n");
+  fprintf(f, "#ifndef UTRA_COLOUR_MODEL_H\n#define UTRA_COLOUR_MODEL_H\n\n");
+  fprintf(f, "#define COLOUR_MODEL_CLASSES %zu\n", m.labels.size());
+  fprintf(f, "#define COLOUR_MODEL_LABELS {");
+  for (size_t k = 0; k < m.labels.size(); k++) fprintf(f, "%s %d", k ? "," : "", m.labels[k]);
+  fprintf(f, " }   //");
+  for (size_t k = 0; k < m.labels.size(); k++) fprintf(f, " %s", LABEL_NAMES[m.labels[k]]);
+  fprintf(f, "\n");
+  if (m.tree.empty()) {
+    fprintf(f, "#define COLOUR_MODEL_LINEAR { \\\n");
+    for (size_t k = 0; k < m.linear.size(); k++) {
+      const ColourLinearTerm &t = m.linear[k];
+      fprintf(f, "  { { %d, %d, %d }, %ld }, \\\n", t.weight[0], t.weight[1], t.weight[2], (long)t.bias);
+    }
+  } else {
+    fprintf(f, "#define COLOUR_MODEL_TREE { \\\n");
+    for (size_t i = 0; i < m.tree.size(); i++) {
+      const ColourTreeNode &n = m.tree[i];
+      fprintf(f, "  { %d, %u, %d, %d }, \\\n", n.channel, n.threshold, n.below, n.above);
+    }
+  }
+  fprintf(f, "}\n\n#endif\n");
+  fclose(f);
+  return true;
+}
+
+int colourTrainMain(int argc, char **argv) {
+  const char *kind = "tree";
+  const char *outPath = "include/colour_model.h";
+  int depth = 4;
+  std::vector<ColourSample> data;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    std::string error;
+    if (strcmp(argv[i], "--model") == 0 && hasValue) {
+      kind = argv[++i];
+    } else if (strcmp(argv[i], "--depth") == 0 && hasValue) {
+      depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+      outPath = argv[++i];
+    } else if (argv[i][0] != '-') {
+      bool ok = strchr(argv[i], '=') != NULL ? loadLabelledTrace(argv[i], &data, &error)
+                                             : loadLabelledCsv(argv[i], &data, &error);
+      if (!ok) {
+        fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+        return 2;
+      }
+    } else {
+      fprintf(stderr, "usage: %s train-colour [--model centroid|mahalanobis|tree] [--depth N] "
+              "[--out FILE] DATA...\n", argv[0]);
+      return 2;
+    }
+  }
+  if (strcmp(kind, "centroid") != 0 && strcmp(kind, "mahalanobis") != 0 && strcmp(kind, "tree") != 0) {
+    fprintf(stderr, "unknown model: %s\n", kind);
+    return 2;
+  }
+  if (depth < 1 || depth > TREE_MAX_DEPTH) {
+    fprintf(stderr, "--depth must be 1..%d\n", TREE_MAX_DEPTH);
+    return 2;
+  }
+  if (data.size() < (size_t)HOLDOUT_EVERY) {
+    fprintf(stderr, "not enough labelled samples (%zu)\n", data.size());
+    return 2;
+  }
+
+  std::vector<ColourSample> train, test;
+  for (size_t i = 0; i < data.size(); i++) {
+    (i % HOLDOUT_EVERY == HOLDOUT_EVERY - 1 ? test : train).push_back(data[i]);
+  }
+  printf("samples: %zu (%zu held out)\n", data.size(), test.size());
+  TrainedModel model;
+  fit(train, kind, depth, &model);
+  double accuracy = report(model, test);
+
+  fit(data, kind, depth, &model);
+  if (!writeHeader(outPath, model, kind, depth, data.size(), accuracy)) return 1;
+  printf("wrote %s (%s, refitted on all %zu samples)\n", outPath, kind, data.size());
+  return 0;
+}
@@ -0,0 +1,25 @@
+/**
+ * Offline trainer for the integer colour classifier (colour_classifier.h).
+ *
+ *   program train-colour [--model centroid|mahalanobis|tree] [--depth N]
+ *                        [--out FILE] DATA...
+ *
+ * DATA is either a CSV with red_pw, green_pw, blue_pw and label columns
+ * (label: white, red, green, blue, black or the PathColour number), or
+ * LABEL=TRACE: a recording taken over one surface (a trace CSV or a raw
+ * telemetry capture, see trace_replay.h) whose every frame is that colour.
+ *
+ * Every fifth sample is held out. The report gives the held-out confusion
+ * matrix of the quantised model, its accuracy against the hand-set
+ * blackThreshold/whiteThreshold rule, and per-class margins: how far (in
+ * us of pulse width) the correctly classified samples sit from a decision
+ * boundary. The model is then refitted on all samples and written as a
+ * colour_model.h (default include/colour_model.h) for -DUTRA_COLOUR_MODEL.
+ */
+
+#ifndef UTRA_HOST_COLOUR_TRAIN_H
+#define UTRA_HOST_COLOUR_TRAIN_H
+
+int colourTrainMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,217 @@
+/**
+ * Course model - see course.h
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include "course.h"
+
+typedef struct {
+  uint8_t r, g, b;
+} Rgb;
+
+static const Rgb TABLE_WHITE = { 235, 235, 235 };
+static const Rgb TAPE_RED = { 210, 40, 40 };
+static const Rgb TAPE_GREEN = { 40, 160, 60 };
+static const Rgb TAPE_BLACK = { 15, 15, 15 };
+
+static Course blankCourse(int width, int height) {
+  Course c;
+  c.width = width;
+  c.height = height;
+  c.rgb.resize((size_t)width * height * 3);
+  for (size_t i = 0; i < c.rgb.size(); i += 3) {
+    c.rgb[i] = TABLE_WHITE.r;
+    c.rgb[i + 1] = TABLE_WHITE.g;
+    c.rgb[i + 2] = TABLE_WHITE.b;
+  }
+  c.startX = 20.0f;
+  c.startY = height / 2.0f;
+  c.startHeadingDeg = 0.0f;
+  c.hasGoal = false;
+  c.goal = CourseRect{ 0, 0, 0, 0 };
+  // arena walls
+  float w = (float)width, h = (float)height;
+  c.segments.push_back(CourseSegment{ 0, 0, w, 0, false });
+  c.segments.push_back(CourseSegment{ w, 0, w, h, false });
+  c.segments.push_back(CourseSegment{ w, h, 0, h, false });
+  c.segments.push_back(CourseSegment{ 0, h, 0, 0, false });
+  return c;
+}
+
+static void setPixel(Course *c, int x, int y, Rgb colour) {
+  if (x < 0 || y < 0 || x >= c->width || y >= c->height) return;
+  size_t i = ((size_t)y * c->width + x) * 3;
+  c->rgb[i] = colour.r;
+  c->rgb[i + 1] = colour.g;
+  c->rgb[i + 2] = colour.b;
+}
+
+static void fillRect(Course *c, float x, float y, float w, float h, Rgb colour) {
+  for (int py = (int)y; py < (int)(y + h); py++) {
+    for (int px = (int)x; px < (int)(x + w); px++) {
+      setPixel(c, px, py, colour);
+    }
+  }
+}
+
+static void fillDisc(Course *c, float cx, float cy, float radius, Rgb colour) {
+  for (int py = (int)(cy - radius); py <= (int)(cy + radius); py++) {
+    for (int px = (int)(cx - radius); px <= (int)(cx + radius); px++) {
+      float dx = px + 0.5f - cx, dy = py + 0.5f - cy;
+      if (dx * dx + dy * dy <= radius * radius) setPixel(c, px, py, colour);
+    }
+  }
+}
+
+static void addBox(Course *c, float x, float y, float w, float h) {
+  c->segments.push_back(CourseSegment{ x, y, x + w, y, true });
+  c->segments.push_back(CourseSegment{ x + w, y, x + w, y + h, true });
+  c->segments.push_back(CourseSegment{ x + w, y + h, x, y + h, true });
+  c->segments.push_back(CourseSegment{ x, y + h, x, y, true });
+}
+
+Course courseChallengeOne() {
+  Course c = blankCourse(360, 200);
+  fillRect(&c, 0, 98, 150, 4, TAPE_GREEN);          // green start line
+  fillRect(&c, 150, 97, 60, 6, TAPE_BLACK);         // ramp lines
+  c.ramps.push_back(CourseRamp{ CourseRect{ 160, 70, 40, 60 }, 15.0f });
+  fillDisc(&c, 270, 100, 60, TAPE_RED);             // platform zones
+  fillDisc(&c, 270, 100, 35, TAPE_GREEN);
+  fillDisc(&c, 270, 100, 15, TAPE_BLACK);
+  c.segments.push_back(CourseSegment{ 340, 40, 340, 160, false });  // platform back wall
+  return c;
+}
+
+Course courseObstacle() {
+  Course c = blankCourse(400, 200);
+  fillRect(&c, 10, 98, 320, 4, TAPE_RED);
+  fillRect(&c, 330, 85, 30, 30, TAPE_BLACK);        // finish patch
+  addBox(&c, 180, 90, 20, 20);
+  c.hasGoal = true;
+  c.goal = CourseRect{ 330, 85, 30, 30 };
+  return c;
+}
+
+bool courseLoadFloorPpm(Course *course, const std::string &path, std::string *error) {
+  std::ifstream in(path, std::ios::binary);
+  std::string magic;
+  int w = 0, h = 0, maxval = 0;
+  if (!(in >> magic >> w >> h >> maxval) || magic != "P6" || w <= 0 || h <= 0 || maxval != 255) {
+    *error = path + ": expected a binary PPM (P6, maxval 255)";
+    return false;
+  }
+  in.get();  // single whitespace before the pixel data
+  std::vector<uint8_t> data((size_t)w * h * 3);
+  if (!in.read((char *)data.data(), (std::streamsize)data.size())) {
+    *error = path + ": truncated pixel data";
+    return false;
+  }
+
+  // PPM rows run top to bottom; the course has y up.
+  Course fresh = blankCourse(w, h);
+  for (int y = 0; y < h; y++) {
+    const uint8_t *src = &data[(size_t)(h - 1 - y) * w * 3];
+    std::copy(src, src + (size_t)w * 3, fresh.rgb.begin() + (size_t)y * w * 3);
+  }
+  course->width = fresh.width;
+  course->height = fresh.height;
+  course->rgb.swap(fresh.rgb);
+  return true;
+}
+
+bool courseLoadShapes(Course *course, const std::string &path, std::string *error) {
+  std::ifstream in(path);
+  if (!in) {
+    *error = path + ": cannot open";
+    return false;
+  }
+  course->segments.clear();
+  course->ramps.clear();
+  course->hasGoal = false;
+
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    std::istringstream ss(line);
+    std::string kind;
+    if (!(ss >> kind) || kind[0] == '#') continue;
+    float a, b, c, d, e;
+    bool ok = true;
+    if (kind == "wall" && (ss >> a >> b >> c >> d)) {
+      course->segments.push_back(CourseSegment{ a, b, c, d, false });
+    } else if (kind == "box" && (ss >> a >> b >> c >> d)) {
+      addBox(course, a, b, c, d);
+    } else if (kind == "ramp" && (ss >> a >> b >> c >> d >> e)) {
+      course->ramps.push_back(CourseRamp{ CourseRect{ a, b, c, d }, e });
+    } else if (kind == "start" && (ss >> a >> b >> c)) {
+      course->startX = a;
+      course->startY = b;
+      course->startHeadingDeg = c;
+    } else if (kind == "goal" && (ss >> a >> b >> c >> d)) {
+      course->hasGoal = true;
+      course->goal = CourseRect{ a, b, c, d };
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      *error = path + ":" + std::to_string(lineNo) + ": cannot parse '" + line + "'";
+      return false;
+    }
+  }
+  return true;
+}
+
+void courseReflectance(const Course *course, float x, float y, float *r, float *g, float *b) {
+  int px = (int)floorf(x), py = (int)floorf(y);
+  Rgb c = TABLE_WHITE;
+  if (px >= 0 && py >= 0 && px < course->width && py < course->height) {
+    size_t i = ((size_t)py * course->width + px) * 3;
+    c = Rgb{ course->rgb[i], course->rgb[i + 1], course->rgb[i + 2] };
+  }
+  *r = c.r / 255.0f;
+  *g = c.g / 255.0f;
+  *b = c.b / 255.0f;
+}
+
+bool courseInRect(const CourseRect &r, float x, float y) {
+  return x >= r.x && x < r.x + r.w && y >= r.y && y < r.y + r.h;
+}
+
+float coursePitchDeg(const Course *course, float x, float y) {
+  for (const CourseRamp &ramp : course->ramps) {
+    if (courseInRect(ramp.area, x, y)) return ramp.pitchDeg;
+  }
+  return 0.0f;
+}
+
+float courseRayCast(const Course *course, float x, float y, float headingRad, float maxRange) {
+  float dx = cosf(headingRad), dy = sinf(headingRad);
+  float best = maxRange;
+  for (const CourseSegment &s : course->segments) {
+    float ex = s.x2 - s.x1, ey = s.y2 - s.y1;
+    float denom = dx * ey - dy * ex;
+    if (fabsf(denom) < 1e-6f) continue;
+    float wx = s.x1 - x, wy = s.y1 - y;
+    float t = (wx * ey - wy * ex) / denom;   // along the ray
+    float u = (wx * dy - wy * dx) / denom;   // along the segment
+    if (t >= 0.0f && u >= 0.0f && u <= 1.0f && t < best) best = t;
+  }
+  return best;
+}
+
+bool courseTouchesObstacle(const Course *course, float x, float y, float radius) {
+  for (const CourseSegment &s : course->segments) {
+    if (!s.obstacle) continue;
+    float ex = s.x2 - s.x1, ey = s.y2 - s.y1;
+    float len2 = ex * ex + ey * ey;
+    float t = len2 > 0.0f ? ((x - s.x1) * ex + (y - s.y1) * ey) / len2 : 0.0f;
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+    float cx = s.x1 + t * ex - x, cy = s.y1 + t * ey - y;
+    if (cx * cx + cy * cy <= radius * radius) return true;
+  }
+  return false;
+}
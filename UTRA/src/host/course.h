@@ -0,0 +1,64 @@
+/**
+ * Course model for the host simulator.
+ * The floor is an RGB raster at 1 cm per pixel holding diffuse reflectance
+ * per channel (what the TCS3200 sees); walls and obstacles are line segments
+ * (what the HC-SR04 sees). Ramps are rectangles with a pitch.
+ *
+ * Floors can be loaded from a binary PPM (P6) and shapes from a text file:
+ *   wall x1 y1 x2 y2          one segment
+ *   box  x y w h              obstacle (4 segments, counts touches)
+ *   ramp x y w h pitchDeg     incline
+ *   start x y headingDeg
+ *   goal x y w h
+ * Coordinates are cm, x right, y up, headings counter-clockwise from +x.
+ */
+
+#ifndef UTRA_HOST_COURSE_H
+#define UTRA_HOST_COURSE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+typedef struct {
+  float x1, y1, x2, y2;
+  bool obstacle;   // touching it is a penalty; walls are just walls
+} CourseSegment;
+
+typedef struct {
+  float x, y, w, h;
+} CourseRect;
+
+typedef struct {
+  CourseRect area;
+  float pitchDeg;
+} CourseRamp;
+
+typedef struct {
+  int width, height;                // cm
+  std::vector<uint8_t> rgb;         // width * height * 3, row 0 at y = 0
+  std::vector<CourseSegment> segments;
+  std::vector<CourseRamp> ramps;
+  float startX, startY, startHeadingDeg;
+  bool hasGoal;
+  CourseRect goal;
+} Course;
+
+// Built-in layouts: green line -> black ramp lines -> red/green/black platform,
+// and the red-line obstacle course with a black finish patch.
+Course courseChallengeOne();
+Course courseObstacle();
+
+bool courseLoadFloorPpm(Course *course, const std::string &path, std::string *error);
+bool courseLoadShapes(Course *course, const std::string &path, std::string *error);
+
+// Reflectance 0..1 per channel; outside the raster reads as the white table.
+void courseReflectance(const Course *course, float x, float y, float *r, float *g, float *b);
+float coursePitchDeg(const Course *course, float x, float y);
+// Distance to the nearest segment along the ray, or maxRange when nothing is hit.
+float courseRayCast(const Course *course, float x, float y, float headingRad, float maxRange);
+// Whether a circle of the given radius overlaps an obstacle segment.
+bool courseTouchesObstacle(const Course *course, float x, float y, float radius);
+bool courseInRect(const CourseRect &r, float x, float y);
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * Event queue stress check - see event_stress.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "event_queue.h"
+#include "event_stress.h"
+
+const int MAX_SOURCES = 8;
+const int PACED_MAX_YIELDS = 1000;
+
+typedef struct {
+  unsigned long received;
+  unsigned long lost;        // sequence gaps
+  unsigned long torn;
+  unsigned long reordered;
+  uint32_t lastSeq;
+  uint8_t droppedSeen;
+} SourceCheck;
+
+typedef struct {
+  unsigned long sent, received, lost, torn, reordered, miscounted;
+  bool ok;
+} PhaseResult;
+
+static uint16_t checkValue(uint32_t seq) {
+  return (uint16_t)(seq * 40503u);
+}
+
+static void spin(long ns) {
+  if (ns <= 0) return;
+  std::chrono::steady_clock::time_point until =
+      std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+  while (std::chrono::steady_clock::now() < until) {}
+}
+
+// Paced producers give the consumer the CPU while their queue is full, up to
+// PACED_MAX_YIELDS times per event, then push anyway and let it drop.
+static void produce(EventQueue *q, uint8_t source, uint32_t events, long periodNs, bool paced,
+                    std::atomic<int> *running) {
+  for (uint32_t seq = 1; seq <= events; seq++) {
+    spin(periodNs);
+    for (int y = 0; paced && y < PACED_MAX_YIELDS && eventPending(q) >= EVENT_QUEUE_SIZE; y++) {
+      std::this_thread::yield();
+    }
+    Event e;
+    e.type = (uint8_t)(seq % 3);
+    e.source = source;
+    e.value = checkValue(seq);
+    e.tUs = seq;
+    eventPush(q, &e);
+  }
+  running->fetch_sub(1);
+}
+
+static void check(const Event &e, uint8_t source, SourceCheck *c) {
+  c->received++;
+  if (e.source != source || e.type != e.tUs % 3 || e.value != checkValue(e.tUs)) {
+    c->torn++;
+    return;
+  }
+  if (e.tUs <= c->lastSeq) {
+    c->reordered++;
+    return;
+  }
+  c->lost += e.tUs - c->lastSeq - 1;
+  c->lastSeq = e.tUs;
+}
+
+static PhaseResult runPhase(int sources, uint32_t events, long periodNs, long delayNs, bool paced) {
+  EventQueue queues[MAX_SOURCES];
+  SourceCheck checks[MAX_SOURCES];
+  for (int k = 0; k < sources; k++) {
+    eventQueueInit(&queues[k]);
+    memset(&checks[k], 0, sizeof(checks[k]));
+  }
+
+  std::atomic<int> running(sources);
+  std::vector<std::thread> producers;
+  for (int k = 0; k < sources; k++) {
+    producers.push_back(std::thread(produce, &queues[k], (uint8_t)k, events, periodNs, paced, &running));
+  }
+
+  // loop(): drain each source's queue in turn until the producers are done
+  // and nothing is left. An empty pass hands the CPU back to the producers.
+  bool idle = false;
+  while (!idle) {
+    bool finished = running.load() == 0;
+    idle = true;
+    for (int k = 0; k < sources; k++) {
+      Event e;
+      while (eventPop(&queues[k], &e)) {
+        check(e, (uint8_t)k, &checks[k]);
+        idle = false;
+        spin(delayNs);
+      }
+    }
+    if (idle && !finished) {
+      idle = false;
+      std::this_thread::yield();
+    }
+  }
+  for (size_t k = 0; k < producers.size(); k++) producers[k].join();
+
+  PhaseResult r = PhaseResult();
+  for (int k = 0; k < sources; k++) {
+    SourceCheck *c = &checks[k];
+    c->lost += events - c->lastSeq;   // dropped after the last delivered event
+    // The counter is 8 bits and wraps, so it can only be checked mod 256.
+    uint8_t dropped = eventDroppedSince(&queues[k], &c->droppedSeen);
+    if (dropped != (uint8_t)c->lost) r.miscounted++;
+    r.received += c->received;
+    r.lost += c->lost;
+    r.torn += c->torn;
+    r.reordered += c->reordered;
+  }
+  r.sent = events * (unsigned long)sources;
+  r.ok = r.torn == 0 && r.reordered == 0 && r.miscounted == 0 && r.received + r.lost == r.sent;
+  return r;
+}
+
+static bool report(const char *phase, int sources, const PhaseResult &r, const char *failure) {
+  bool ok = r.ok && failure == NULL;
+  printf("event-stress phase=%s sources=%d queue=%u events=%lu received=%lu dropped=%lu "
+         "delivered=%.1f%% torn=%lu reordered=%lu miscounted=%lu result=%s%s%s\n", phase, sources,
+         EVENT_QUEUE_SIZE, r.sent, r.received, r.lost, 100.0 * r.received / r.sent, r.torn,
+         r.reordered, r.miscounted, ok ? "pass" : "FAIL", failure != NULL ? " " : "",
+         failure != NULL ? failure : "");
+  return ok;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: program event-stress [--events N] [--sources K] [--period-ns NS]\n"
+                  "                            [--consumer-delay-ns NS] [--min-delivered F]\n");
+}
+
+int eventStressMain(int argc, char **argv) {
+  uint32_t events = 1000000;
+  int sources = 3;
+  long periodNs = 100;
+  long delayNs = 1000;
+  double minDelivered = 0.99;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(a, "--events") == 0 && hasValue) events = (uint32_t)strtoul(argv[++i], NULL, 10);
+    else if (strcmp(a, "--sources") == 0 && hasValue) sources = atoi(argv[++i]);
+    else if (strcmp(a, "--period-ns") == 0 && hasValue) periodNs = atol(argv[++i]);
+    else if (strcmp(a, "--consumer-delay-ns") == 0 && hasValue) delayNs = atol(argv[++i]);
+    else if (strcmp(a, "--min-delivered") == 0 && hasValue) minDelivered = atof(argv[++i]);
+    else {
+      usage();
+      return 2;
+    }
+  }
+  if (sources < 1 || sources > MAX_SOURCES || events == 0) {
+    usage();
+    return 2;
+  }
+
+  PhaseResult paced = runPhase(sources, events, periodNs, 0, true);
+  bool ok = report("paced", sources, paced,
+                   paced.received < minDelivered * paced.sent ? "(below --min-delivered)" : NULL);
+  PhaseResult overflow = runPhase(sources, events, periodNs, delayNs, false);
+  ok = report("overflow", sources, overflow,
+              overflow.lost == 0 ? "(queues never overflowed)" : NULL) && ok;
+  return ok ? 0 : 1;
+}
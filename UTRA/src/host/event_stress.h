@@ -0,0 +1,31 @@
+/**
+ * Stress check for the interrupt-to-loop event queues (event_queue.h).
+ *
+ *   program event-stress [--events N] [--sources K] [--period-ns NS]
+ *                        [--consumer-delay-ns NS] [--min-delivered F]
+ *
+ * Runs K producer threads, one queue each, standing in for K ISRs firing
+ * every --period-ns (default 100), and the main thread draining them
+ * round-robin as loop() would. Two phases of N events per source:
+ *  - paced: a producer whose queue is full yields to the consumer before
+ *    pushing, so nearly everything is delivered and the wrap path runs
+ *    under contention. Fails if less than --min-delivered (default 0.99)
+ *    of the events arrive;
+ *  - overflow: producers run free and the consumer spends
+ *    --consumer-delay-ns (default 1000) on each event, so the queues stay
+ *    full and the drop path runs. Fails if nothing was dropped.
+ * Every event carries its sequence number in tUs and a check pattern
+ * derived from it in type/source/value, so the consumer catches:
+ *  - torn records: fields from two different events;
+ *  - reordering or duplicates: sequence numbers that do not increase;
+ *  - miscounted drops: gaps that the producer's drop counter does not
+ *    account for.
+ * Prints a summary line per phase and exits non-zero on any failure.
+ */
+
+#ifndef UTRA_HOST_EVENT_STRESS_H
+#define UTRA_HOST_EVENT_STRESS_H
+
+int eventStressMain(int argc, char **argv);
+
+#endif
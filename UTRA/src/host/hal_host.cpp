@@ -0,0 +1,211 @@
+/**
+ * HAL backend for host builds - see hal.h and hal_host.h
+ * All time is virtual (virtual_clock.h): nothing here ever sleeps.
+ */
+
+#include <limits.h>
+#include <deque>
+#include "Arduino.h"
+#include "hal_host.h"
+#include "virtual_clock.h"
+
+HardwareSerial Serial;
+
+typedef struct {
+  int mode;
+  int level;      // driven by the firmware
+  int input;      // driven by sensor models
+  int pwm;
+} HostPin;
+
+static HostPin pins[HOST_PIN_COUNT];
+static int servoPins[HAL_SERVO_MAX];
+static int servoAngles[HAL_SERVO_MAX];
+static int servoCount = 0;
+
+static HostPulseSource pulseSource = NULL;
+static HostAnalogSource analogSource = NULL;
+static HostDigitalSource digitalSource = NULL;
+static HostPinWriteHook pinWriteHook = NULL;
+static HostSerialSink serialSink = NULL;
+static std::deque<uint8_t> serialRx;
+
+static const HostCallCosts DEFAULT_COSTS = { 4, 4, 6, 112 };
+static HostCallCosts costs = DEFAULT_COSTS;
+
+static bool validPin(uint8_t pin) {
+  return pin < HOST_PIN_COUNT;
+}
+
+void hostReset() {
+  for (uint8_t i = 0; i < HOST_PIN_COUNT; i++) {
+    pins[i].mode = INPUT;
+    pins[i].level = LOW;
+    pins[i].input = LOW;
+    pins[i].pwm = -1;
+  }
+  servoCount = 0;
+  pulseSource = NULL;
+  analogSource = NULL;
+  digitalSource = NULL;
+  pinWriteHook = NULL;
+  serialSink = NULL;
+  serialRx.clear();
+  costs = DEFAULT_COSTS;
+  vclockReset();
+}
+
+HostCallCosts *hostCallCosts() {
+  return &costs;
+}
+
+void hostDriveInput(uint8_t pin, int level) {
+  if (validPin(pin)) pins[pin].input = level ? HIGH : LOW;
+}
+
+void hostSetPulseSource(HostPulseSource source) { pulseSource = source; }
+void hostSetAnalogSource(HostAnalogSource source) { analogSource = source; }
+void hostSetDigitalSource(HostDigitalSource source) { digitalSource = source; }
+void hostSetPinWriteHook(HostPinWriteHook hook) { pinWriteHook = hook; }
+void hostSetSerialSink(HostSerialSink sink) { serialSink = sink; }
+
+void hostSerialInject(const char *text) {
+  while (*text) serialRx.push_back((uint8_t)*text++);
+}
+
+int hostPinMode(uint8_t pin) { return validPin(pin) ? pins[pin].mode : INPUT; }
+int hostPinLevel(uint8_t pin) { return validPin(pin) ? pins[pin].level : LOW; }
+int hostPwmValue(uint8_t pin) { return validPin(pin) ? pins[pin].pwm : -1; }
+int hostServoAngle(int channel) { return channel >= 0 && channel < servoCount ? servoAngles[channel] : -1; }
+int hostServoPin(int channel) { return channel >= 0 && channel < servoCount ? servoPins[channel] : -1; }
+
+// ========== GPIO / PWM ==========
+void halPinMode(uint8_t pin, uint8_t mode) {
+  if (validPin(pin)) pins[pin].mode = mode;
+}
+
+void halDigitalWrite(uint8_t pin, uint8_t value) {
+  vclockAdvanceBy(costs.digitalIoUs);
+  if (!validPin(pin)) return;
+  pins[pin].level = value ? HIGH : LOW;
+  pins[pin].pwm = -1;
+  if (pinWriteHook) pinWriteHook(pin);
+}
+
+static int inputLevel(uint8_t pin) {
+  if (!validPin(pin)) return LOW;
+  return pins[pin].mode == OUTPUT ? pins[pin].level : pins[pin].input;
+}
+
+int halDigitalRead(uint8_t pin) {
+  vclockAdvanceBy(costs.digitalIoUs);
+  if (digitalSource) return digitalSource(pin);
+  return inputLevel(pin);
+}
+
+int halAnalogRead(uint8_t pin) {
+  vclockAdvanceBy(costs.analogReadUs);
+  return analogSource ? analogSource(pin) : 0;
+}
+
+// Same semantics as the AVR core: 0 and 255 become plain digital levels.
+void halAnalogWrite(uint8_t pin, int value) {
+  vclockAdvanceBy(costs.analogWriteUs);
+  if (!validPin(pin)) return;
+  value = constrain(value, 0, 255);
+  pins[pin].pwm = value;
+  pins[pin].level = value >= 128 ? HIGH : LOW;
+  if (pinWriteHook) pinWriteHook(pin);
+}
+
+// ========== Pulse timing ==========
+typedef struct {
+  uint8_t pin;
+  int level;
+} PinWait;
+
+static bool pinAtLevel(void *ctx) {
+  PinWait *w = (PinWait *)ctx;
+  return inputLevel(w->pin) == w->level;
+}
+
+// A pulse source answers with the pulse width directly and says how long the
+// call blocks (see HostPulseSource). Without one, pulseIn() follows the edges
+// sensor models schedule on the virtual clock, with the AVR core's semantics:
+// finish any pulse in progress, wait for the start, time it to the end.
+unsigned long halPulseIn(uint8_t pin, uint8_t state, unsigned long timeoutUs) {
+  if (pulseSource) {
+    unsigned long blocked = ULONG_MAX;
+    unsigned long width = pulseSource(pin, state, timeoutUs, &blocked);
+    if (blocked == ULONG_MAX) blocked = width != 0 ? width : timeoutUs;
+    vclockAdvanceBy(blocked);
+    return width;
+  }
+
+  uint64_t deadline = vclockNowUs() + timeoutUs;
+  int active = state ? HIGH : LOW;
+  PinWait idle = { pin, !active };
+  PinWait on = { pin, active };
+  if (!vclockWaitUntil(pinAtLevel, &idle, deadline)) return 0;
+  if (!vclockWaitUntil(pinAtLevel, &on, deadline)) return 0;
+  uint64_t start = vclockNowUs();
+  if (!vclockWaitUntil(pinAtLevel, &idle, deadline)) return 0;
+  return (unsigned long)(vclockNowUs() - start);
+}
+
+// ========== Clock ==========
+unsigned long halMicros() {
+  vclockAdvanceBy(costs.clockReadUs);
+  return (unsigned long)vclockNowUs();
+}
+
+unsigned long halMillis() {
+  vclockAdvanceBy(costs.clockReadUs);
+  return (unsigned long)(vclockNowUs() / 1000ULL);
+}
+
+void halDelay(unsigned long ms) {
+  vclockAdvanceBy((uint64_t)ms * 1000ULL);
+}
+
+void halDelayMicroseconds(unsigned int us) {
+  vclockAdvanceBy(us);
+}
+
+// ========== Servo ==========
+int halServoAttach(uint8_t pin) {
+  if (servoCount >= HAL_SERVO_MAX) return -1;
+  servoPins[servoCount] = pin;
+  servoAngles[servoCount] = 90;
+  return servoCount++;
+}
+
+void halServoWrite(int channel, int degrees) {
+  if (channel >= 0 && channel < servoCount) servoAngles[channel] = constrain(degrees, 0, 180);
+}
+
+// ========== Serial ==========
+void halSerialBegin(unsigned long baud) {
+  (void)baud;
+}
+
+size_t halSerialWrite(const uint8_t *data, size_t len) {
+  if (serialSink) serialSink(data, len);
+  return len;
+}
+
+// The host "UART" drains instantly.
+int halSerialAvailableForWrite() {
+  return 64;
+}
+
+int halSerialAvailable() {
+  return (int)serialRx.size();
+}
+
+int halSerialRead() {
+  if (serialRx.empty()) return -1;
+  uint8_t b = serialRx.front();
+  serialRx.pop_front();
+  return b;
+}
@@ -0,0 +1,59 @@
+/**
+ * Host-only side of the HAL: hooks that let tools and simulators stand in
+ * for the robot's sensors and observe its actuators.
+ * Every hook is optional; without one, inputs read as idle (LOW, 0, pulse
+ * timeout) and outputs are only recorded in the pin table.
+ */
+
+#ifndef UTRA_HAL_HOST_H
+#define UTRA_HAL_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+const uint8_t HOST_PIN_COUNT = 20;   // D0..D13, A0..A5
+
+// Returns the pulse width (0 = none) and may set how long the call blocks;
+// left alone, that is the width, or the whole timeout when there is no pulse.
+typedef unsigned long (*HostPulseSource)(uint8_t pin, uint8_t state, unsigned long timeoutUs,
+                                         unsigned long *blockedUs);
+typedef int (*HostAnalogSource)(uint8_t pin);
+typedef int (*HostDigitalSource)(uint8_t pin);
+typedef void (*HostPinWriteHook)(uint8_t pin);
+typedef void (*HostSerialSink)(const uint8_t *data, size_t len);
+
+void hostSetPulseSource(HostPulseSource source);
+void hostSetAnalogSource(HostAnalogSource source);
+void hostSetDigitalSource(HostDigitalSource source);
+void hostSetPinWriteHook(HostPinWriteHook hook);
+void hostSetSerialSink(HostSerialSink sink);
+
+// Level seen by digitalRead()/pulseIn() on an input pin. Sensor models call
+// this from virtual-clock events to produce edges.
+void hostDriveInput(uint8_t pin, int level);
+
+// CPU time charged to the virtual clock per HAL call, roughly what the call
+// costs on a 16 MHz Uno, so busy-wait loops on millis() still make progress.
+typedef struct {
+  unsigned long clockReadUs;    // millis()/micros()
+  unsigned long digitalIoUs;    // digitalWrite()/digitalRead()
+  unsigned long analogWriteUs;
+  unsigned long analogReadUs;   // one ADC conversion
+} HostCallCosts;
+
+HostCallCosts *hostCallCosts();
+
+// Queues bytes for Serial.read(), e.g. "dump\n".
+void hostSerialInject(const char *text);
+
+// Actuator state as last written by the firmware.
+int hostPinMode(uint8_t pin);
+int hostPinLevel(uint8_t pin);
+int hostPwmValue(uint8_t pin);   // -1 if the pin was only driven digitally
+int hostServoAngle(int channel);
+int hostServoPin(int channel);
+
+// Back to power-on state: pins, servos, hooks and serial buffers.
+void hostReset();
+
+#endif
@@ -0,0 +1,305 @@
+/**
+ * Host entry point for [env:native].
+ * Runs a firmware program against the course simulator on the virtual clock
+ * until it reports done or the virtual time limit passes, then prints one
+ * summary line of key=value pairs for scripts to pick apart.
+ *
+ *   program [--program main|obstacle|challenge2] [--floor FILE.ppm]
+ *           [--shapes FILE] [--max-ms N] [--serial-out FILE] [--trace FILE]
+ *           [--set NAME=VALUE]... [--list-tunables]
+ *           [--seed N] [--colour-noise F] [--drift F] [--asymmetry F] [--sag F]
+ *           [--range-noise CM] [--start-jitter-cm CM] [--start-jitter-deg DEG]
+ *           [--replay TRACE [--closed-loop]] [--sensor-timing blocking|width|background]
+ *           [--no-accel]
+ *
+ * --no-accel runs without the simulated accelerometer, so the ramp
+ * estimator takes its tape-and-travel path. --set takes file:NAME for one
+ * sketch's constant or a bare NAME for every sketch's (--list-tunables).
+ *
+ * A program whose pin map wires two devices to one pin (see sim_programs.h)
+ * is announced as expected to fail on stderr, and a failed run adds an
+ * expected_failure line naming the conflict.
+ *
+ * A second line reports the loop rate and what the sensor reads cost: the
+ * share of run time spent in them and the reaction distance, the most the
+ * robot travelled between two readings.
+ *
+ *   program tune ...              see autotune.h
+ *   program montecarlo ...        see montecarlo.h
+ *   program bench ...             see bench_host.h
+ *   program train-colour ...      see colour_train.h
+ *   program event-stress ...      see event_stress.h
+ */
+
+// pio test builds src/ with UNIT_TEST defined and brings its own main().
+#ifndef UNIT_TEST
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "Arduino.h"
+#include "hal_host.h"
+#include "autotune.h"
+#include "bench_host.h"
+#include "colour_train.h"
+#include "event_stress.h"
+#include "montecarlo.h"
+#include "robot_sim.h"
+#include "sim_batch.h"
+#include "sim_programs.h"
+#include "state_stats.h"
+#include "trace_replay.h"
+#include "tunable.h"
+#include "virtual_clock.h"
+
+const unsigned long TRACE_PERIOD_US = 50000;
+const unsigned long WATCH_PERIOD_US = 10000;
+
+static FILE *serialOut = NULL;
+static FILE *traceOut = NULL;
+static const SimProgram *program = NULL;
+static unsigned long maxMs = 120000;
+static Trace trace;
+static bool replaying = false;
+static unsigned long loops = 0;
+
+static void writeSerialOut(const uint8_t *data, size_t len) {
+  fwrite(data, 1, len, serialOut);
+}
+
+static void writeTrace(void *ctx, uint64_t nowUs) {
+  (void)ctx;
+  const SimRobotState *s = simState();
+  fprintf(traceOut, "%llu,%.1f,%.1f,%.1f,%.1f,%.1f\n", (unsigned long long)(nowUs / 1000),
+          s->x, s->y, s->headingRad * 180.0f / (float)PI, s->vLeft, s->vRight);
+  vclockSchedule(nowUs + TRACE_PERIOD_US, writeTrace, NULL);
+}
+
+static void finishRun(const char *result) {
+  if (replaying) replayReport();
+  const SimRobotState *s = simState();
+  const StateStats *stage = stateStatsActive();
+  printf("program=%s result=%s time_ms=%lu touches=%d stage=%d.%d x=%.1f y=%.1f heading=%.1f "
+         "distance=%.1f\n",
+         program->name, result, millis(), s->touches, stage ? stage->machine : 0,
+         stage ? stage->current : 0, s->x, s->y, s->headingRad * 180.0f / (float)PI, s->distanceCm);
+  if (program->pinConflict != NULL && strcmp(result, "complete") != 0) {
+    printf("expected_failure: %s\n", program->pinConflict);
+  }
+  const SimSensorStats *st = simSensorStats();
+  float seconds = millis() / 1000.0f;
+  float runUs = seconds > 0.0f ? seconds * 1e6f : 1.0f;
+  printf("timing loops=%lu loop_hz=%.1f colour_reads=%lu colour_busy=%.1f%% colour_reaction_cm=%.1f "
+         "range_reads=%lu range_busy=%.1f%% range_reaction_cm=%.1f\n",
+         loops, seconds > 0.0f ? loops / seconds : 0.0f, st->colourReads,
+         100.0f * st->colourBusyUs / runUs, st->colourGapMaxCm, st->rangeReads,
+         100.0f * st->rangeBusyUs / runUs, st->rangeGapMaxCm);
+  if (serialOut != NULL) fclose(serialOut);
+  if (traceOut != NULL) fclose(traceOut);
+  exit(strcmp(result, "complete") == 0 ? 0 : 1);
+}
+
+// The firmware has blocking loops that never return to loop(), so the time
+// limit and leaving the arena are enforced from the clock, not the caller.
+// While a replay feeds the sensors the arena doesn't, so leaving it is no
+// reason to stop.
+static void watchRun(void *ctx, uint64_t nowUs) {
+  (void)ctx;
+  if (simState()->leftArena && !(replaying && replayFeeding(nowUs))) finishRun("off_course");
+  if (nowUs >= (uint64_t)maxMs * 1000) finishRun("timeout");
+  if (replaying && replayFinished(nowUs)) finishRun("replay_end");
+  vclockSchedule(nowUs + WATCH_PERIOD_US, watchRun, NULL);
+}
+
+static void listTunables() {
+  for (int i = 0; i < tunableCount(); i++) {
+    const TunableInfo *t = tunableAt(i);
+    printf("%s:%s=%ld [%ld, %ld]\n", t->file, t->name, t->value, t->minValue, t->maxValue);
+  }
+}
+
+static bool applySet(const char *assignment) {
+  const char *eq = strchr(assignment, '=');
+  if (eq == NULL) return false;
+  std::string name(assignment, eq - assignment);
+  return tunableSet(name.c_str(), strtol(eq + 1, NULL, 10));
+}
+
+static bool parseVariation(const char *flag, const char *value, SimVariation *v) {
+  if (value == NULL) return false;
+  float f = strtof(value, NULL);
+  if (strcmp(flag, "--colour-noise") == 0) v->colourNoise = f;
+  else if (strcmp(flag, "--drift") == 0) v->drift = f;
+  else if (strcmp(flag, "--asymmetry") == 0) v->asymmetry = f;
+  else if (strcmp(flag, "--sag") == 0) v->sag = f;
+  else if (strcmp(flag, "--range-noise") == 0) v->rangeNoiseCm = f;
+  else if (strcmp(flag, "--start-jitter-cm") == 0) v->startJitterCm = f;
+  else if (strcmp(flag, "--start-jitter-deg") == 0) v->startJitterDeg = f;
+  else return false;
+  return true;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [--program NAME] [--floor FILE.ppm] [--shapes FILE] "
+          "[--max-ms N] [--serial-out FILE] [--trace FILE] [--set NAME=VALUE] [--list-tunables]\n"
+          "       [--seed N] [--colour-noise F] [--drift F] [--asymmetry F] [--sag F]\n"
+          "       [--range-noise CM] [--start-jitter-cm CM] [--start-jitter-deg DEG]\n"
+          "       [--replay TRACE [--closed-loop]] [--sensor-timing blocking|width|background]\n"
+          "       [--no-accel]\n"
+          "       %s tune ...\n"
+          "       %s montecarlo ...\n"
+          "       %s bench ...\n"
+          "       %s train-colour ...\n"
+          "       %s event-stress ...\n", argv0, argv0, argv0, argv0, argv0, argv0);
+  int count;
+  const SimProgram *list = simPrograms(&count);
+  fprintf(stderr, "programs:");
+  for (int i = 0; i < count; i++) fprintf(stderr, " %s", list[i].name);
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+  simBatchSetExecutable(argv[0]);
+  if (argc > 1 && strcmp(argv[1], "tune") == 0) return autotuneMain(argc - 1, argv + 1);
+  if (argc > 1 && strcmp(argv[1], "montecarlo") == 0) return montecarloMain(argc - 1, argv + 1);
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) return benchMain(argc - 1, argv + 1);
+  if (argc > 1 && strcmp(argv[1], "train-colour") == 0) return colourTrainMain(argc - 1, argv + 1);
+  if (argc > 1 && strcmp(argv[1], "event-stress") == 0) return eventStressMain(argc - 1, argv + 1);
+
+  const char *programName = "main";
+  const char *floorPath = NULL;
+  const char *shapesPath = NULL;
+  const char *serialPath = NULL;
+  const char *tracePath = NULL;
+  const char *replayPath = NULL;
+  bool closedLoop = false;
+  bool noAccel = false;
+  SimVariation variation = SimVariation();
+  bool varied = false;
+  uint32_t seed = 1;
+  SimSensorTiming sensorTiming = SIM_TIMING_BLOCKING;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--max-ms") == 0 && i + 1 < argc) {
+      maxMs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--program") == 0 && i + 1 < argc) {
+      programName = argv[++i];
+    } else if (strcmp(argv[i], "--floor") == 0 && i + 1 < argc) {
+      floorPath = argv[++i];
+    } else if (strcmp(argv[i], "--shapes") == 0 && i + 1 < argc) {
+      shapesPath = argv[++i];
+    } else if (strcmp(argv[i], "--serial-out") == 0 && i + 1 < argc) {
+      serialPath = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (strcmp(argv[i], "--set") == 0 && i + 1 < argc) {
+      if (!applySet(argv[++i])) {
+        fprintf(stderr, "unknown tunable: %s\n", argv[i]);
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (strcmp(argv[i], "--sensor-timing") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "blocking") == 0) sensorTiming = SIM_TIMING_BLOCKING;
+      else if (strcmp(argv[i], "width") == 0) sensorTiming = SIM_TIMING_WIDTH;
+      else if (strcmp(argv[i], "background") == 0) sensorTiming = SIM_TIMING_BACKGROUND;
+      else {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--closed-loop") == 0) {
+      closedLoop = true;
+    } else if (strcmp(argv[i], "--no-accel") == 0) {
+      noAccel = true;
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoul(argv[++i], NULL, 10);
+      varied = true;
+    } else if (parseVariation(argv[i], i + 1 < argc ? argv[i + 1] : NULL, &variation)) {
+      i++;
+      varied = true;
+    } else if (strcmp(argv[i], "--list-tunables") == 0) {
+      listTunables();
+      return 0;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  program = simFindProgram(programName);
+  if (program == NULL) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  Course course = program->course();
+  std::string error;
+  if (floorPath != NULL && !courseLoadFloorPpm(&course, floorPath, &error)) {
+    fprintf(stderr, "%s: %s\n", floorPath, error.c_str());
+    return 2;
+  }
+  if (shapesPath != NULL && !courseLoadShapes(&course, shapesPath, &error)) {
+    fprintf(stderr, "%s: %s\n", shapesPath, error.c_str());
+    return 2;
+  }
+
+  // Replay is judged on state transitions, which need a StateStats machine.
+  if (replayPath != NULL && program->machines[0] == 0) {
+    fprintf(stderr, "--replay: program %s has no state machine to compare transitions with\n",
+            program->name);
+    return 2;
+  }
+  if (replayPath != NULL && !traceLoad(replayPath, &trace, &error)) {
+    fprintf(stderr, "%s: %s\n", replayPath, error.c_str());
+    return 2;
+  }
+
+  SimRobotParams params = simDefaultParams();
+  if (program->maxSpeedCmS > 0.0f) params.maxSpeedCmS = program->maxSpeedCmS;
+  if (varied) simSampleVariation(variation, seed, &params, &course);
+  params.sensorTiming = sensorTiming;
+  params.accelFitted = !noAccel;
+
+  if (program->pinConflict != NULL) {
+    fprintf(stderr, "%s: expected to fail, %s\n", program->name, program->pinConflict);
+  }
+
+  hostReset();
+  simInstall(&course, program->pins, params);
+  if (replayPath != NULL) {
+    replayInstall(&trace, program->pins, closedLoop);
+    replaying = true;
+  }
+  if (serialPath != NULL) {
+    serialOut = fopen(serialPath, "wb");
+    if (serialOut == NULL) {
+      perror(serialPath);
+      return 1;
+    }
+    hostSetSerialSink(writeSerialOut);
+  }
+  if (tracePath != NULL) {
+    traceOut = fopen(tracePath, "w");
+    if (traceOut == NULL) {
+      perror(tracePath);
+      return 1;
+    }
+    fprintf(traceOut, "t_ms,x_cm,y_cm,heading_deg,v_left,v_right\n");
+    writeTrace(NULL, vclockNowUs());
+  }
+
+  const SimRobotState *s = simState();
+  watchRun(NULL, vclockNowUs());
+  program->setup();
+  while (true) {
+    program->loop();
+    loops++;
+    bool done = program->isDone != NULL ? program->isDone()
+                                        : (course.hasGoal && courseInRect(course.goal, s->x, s->y));
+    if (done) finishRun("complete");
+  }
+}
+
+#endif
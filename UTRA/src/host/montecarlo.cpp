@@ -0,0 +1,179 @@
+/**
+ * Monte Carlo robustness runs - see montecarlo.h
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "montecarlo.h"
+#include "sim_batch.h"
+#include "sim_programs.h"
+
+// Default spread: what a practice table and a half-charged pack look like.
+static const char *const DEFAULT_VARIATION[][2] = {
+  { "--colour-noise", "0.05" },
+  { "--drift", "0.10" },
+  { "--asymmetry", "0.06" },
+  { "--sag", "0.05" },
+  { "--range-noise", "1.0" },
+  { "--start-jitter-cm", "2.0" },
+  { "--start-jitter-deg", "3.0" },
+};
+const int DEFAULT_VARIATION_COUNT = sizeof(DEFAULT_VARIATION) / sizeof(DEFAULT_VARIATION[0]);
+
+bool montecarloIsVariationFlag(const char *flag) {
+  for (int i = 0; i < DEFAULT_VARIATION_COUNT; i++) {
+    if (strcmp(flag, DEFAULT_VARIATION[i][0]) == 0) return true;
+  }
+  return false;
+}
+
+void montecarloVariationArgs(SimRunArgs *args) {
+  for (int i = 0; i < DEFAULT_VARIATION_COUNT; i++) {
+    args->push_back(DEFAULT_VARIATION[i][0]);
+    args->push_back(DEFAULT_VARIATION[i][1]);
+  }
+}
+
+// Nearest-rank percentile of a sorted list; rank past the end is a failure.
+static bool percentile(const std::vector<unsigned long> &sorted, size_t total, double pct,
+                       unsigned long *out) {
+  size_t rank = (size_t)ceil(pct / 100.0 * total);
+  if (rank == 0) rank = 1;
+  if (rank > sorted.size()) return false;
+  *out = sorted[rank - 1];
+  return true;
+}
+
+int montecarloMain(int argc, char **argv) {
+  const char *programName = "main";
+  const char *csvPath = NULL;
+  int runs = 1000, jobs = 0;
+  unsigned long seed = 1;
+  std::string maxMs = "120000";
+  SimRunArgs common;
+  std::map<std::string, std::string> variation;
+  for (int i = 0; i < DEFAULT_VARIATION_COUNT; i++) variation[DEFAULT_VARIATION[i][0]] = DEFAULT_VARIATION[i][1];
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--program") == 0 && hasValue) programName = argv[++i];
+    else if (strcmp(argv[i], "--runs") == 0 && hasValue) runs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--jobs") == 0 && hasValue) jobs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && hasValue) seed = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--max-ms") == 0 && hasValue) maxMs = argv[++i];
+    else if (strcmp(argv[i], "--csv") == 0 && hasValue) csvPath = argv[++i];
+    else if (montecarloIsVariationFlag(argv[i]) && hasValue) {
+      variation[argv[i]] = argv[i + 1];
+      i++;
+    } else if ((strcmp(argv[i], "--floor") == 0 || strcmp(argv[i], "--shapes") == 0 ||
+                strcmp(argv[i], "--set") == 0) && hasValue) {
+      common.push_back(argv[i]);
+      common.push_back(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s montecarlo [--program NAME] [--runs N] [--jobs N] [--seed S] "
+              "[--max-ms N] [--floor FILE] [--shapes FILE] [--set NAME=VALUE] [--csv FILE] "
+              "[--colour-noise F] [--drift F] [--asymmetry F] [--sag F] [--range-noise CM] "
+              "[--start-jitter-cm CM] [--start-jitter-deg DEG]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (simFindProgram(programName) == NULL) {
+    fprintf(stderr, "unknown program %s\n", programName);
+    return 2;
+  }
+
+  common.push_back("--program");
+  common.push_back(programName);
+  common.push_back("--max-ms");
+  common.push_back(maxMs);
+  for (std::map<std::string, std::string>::const_iterator it = variation.begin(); it != variation.end(); ++it) {
+    common.push_back(it->first);
+    common.push_back(it->second);
+  }
+  std::vector<SimRunArgs> batch;
+  for (int r = 0; r < runs; r++) {
+    SimRunArgs args = common;
+    args.push_back("--seed");
+    args.push_back(std::to_string(seed + r));
+    batch.push_back(args);
+  }
+
+  WorkPool pool(jobs);
+  printf("montecarlo %s: %d runs on %d threads, seeds %lu..%lu\n", programName, runs, pool.threads(),
+         seed, seed + runs - 1);
+  std::vector<SimRunResult> results = simBatchRun(batch, &pool);
+
+  std::vector<unsigned long> times;
+  std::map<std::pair<int, int>, int> stuck;       // (machine, state) -> failed runs
+  std::map<std::string, int> outcomes;
+  int touchedRuns = 0;
+  long touches = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    const SimRunResult &r = results[i];
+    outcomes[r.parsed ? r.result : "crashed"]++;
+    touches += r.touches;
+    if (r.touches > 0) touchedRuns++;
+    if (r.complete) times.push_back(r.timeMs);
+    else stuck[std::make_pair(r.machine, r.state)]++;
+  }
+  std::sort(times.begin(), times.end());
+
+  size_t total = results.size();
+  printf("completed %zu/%zu (%.1f%%)", times.size(), total, total ? 100.0 * times.size() / total : 0.0);
+  for (std::map<std::string, int>::const_iterator it = outcomes.begin(); it != outcomes.end(); ++it) {
+    if (it->first != "complete") printf(", %s %d", it->first.c_str(), it->second);
+  }
+  printf("\n");
+
+  if (!times.empty()) {
+    const double pcts[] = { 50, 90, 95, 99 };
+    printf("completion ms (completed runs): min %lu", times.front());
+    for (size_t p = 0; p < sizeof(pcts) / sizeof(pcts[0]); p++) {
+      unsigned long v = 0;
+      percentile(times, times.size(), pcts[p], &v);
+      printf(" p%.0f %lu", pcts[p], v);
+    }
+    printf(" max %lu\n", times.back());
+  }
+  unsigned long p95;
+  if (percentile(times, total, 95, &p95)) printf("p95 over all runs: %lu ms\n", p95);
+  else printf("p95 over all runs: not finished (failure rate above 5%%)\n");
+  printf("obstacle touches: %.2f per run, %.1f%% of runs touched\n", total ? (double)touches / total : 0.0,
+         total ? 100.0 * touchedRuns / total : 0.0);
+
+  if (!stuck.empty()) {
+    printf("failed runs by last state:\n");
+    std::vector<std::pair<int, std::pair<int, int> > > order;
+    for (std::map<std::pair<int, int>, int>::const_iterator it = stuck.begin(); it != stuck.end(); ++it) {
+      order.push_back(std::make_pair(it->second, it->first));
+    }
+    std::sort(order.rbegin(), order.rend());
+    for (size_t i = 0; i < order.size(); i++) {
+      int machine = order[i].second.first, state = order[i].second.second;
+      printf("  %d.%d %-26s %5d  %5.1f%% of runs\n", machine, state, simStateName(machine, state),
+             order[i].first, 100.0 * order[i].first / total);
+    }
+  }
+
+  if (csvPath != NULL) {
+    FILE *csv = fopen(csvPath, "w");
+    if (csv == NULL) {
+      perror(csvPath);
+      return 1;
+    }
+    fprintf(csv, "seed,result,time_ms,touches,machine,state,x_cm,y_cm\n");
+    for (size_t i = 0; i < results.size(); i++) {
+      const SimRunResult &r = results[i];
+      fprintf(csv, "%lu,%s,%lu,%d,%d,%d,%.1f,%.1f\n", seed + i, r.parsed ? r.result.c_str() : "crashed",
+              r.timeMs, r.touches, r.machine, r.state, r.x, r.y);
+    }
+    fclose(csv);
+  }
+  return 0;
+}
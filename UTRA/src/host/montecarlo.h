@@ -0,0 +1,28 @@
+/**
+ * Monte Carlo robustness runs over the simulator.
+ *
+ *   program montecarlo [--program NAME] [--runs N] [--jobs N] [--seed S]
+ *                      [--max-ms N] [--floor FILE] [--shapes FILE]
+ *                      [--set NAME=VALUE]... [--csv FILE]
+ *                      [--colour-noise F] [--drift F] [--asymmetry F] [--sag F]
+ *                      [--range-noise CM] [--start-jitter-cm CM]
+ *                      [--start-jitter-deg DEG]
+ *
+ * Each run draws its own sensor noise, lighting drift, motor asymmetry,
+ * battery sag and start pose from its seed (see SimVariation). The report
+ * gives completion-time percentiles, the p95 counting failures as never
+ * finishing, and where the failed runs were stuck, by state.
+ */
+
+#ifndef UTRA_HOST_MONTECARLO_H
+#define UTRA_HOST_MONTECARLO_H
+
+#include "sim_batch.h"
+
+int montecarloMain(int argc, char **argv);
+// True for the flags that set the spread (--colour-noise ... --start-jitter-deg).
+bool montecarloIsVariationFlag(const char *flag);
+// The default spread as run arguments, without --seed, for other batch tools.
+void montecarloVariationArgs(SimRunArgs *args);
+
+#endif
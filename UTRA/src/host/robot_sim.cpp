@@ -0,0 +1,391 @@
+/**
+ * Differential-drive robot model - see robot_sim.h
+ */
+
+#include <math.h>
+#include <random>
+#include "Arduino.h"
+#include "hal_host.h"
+#include "ramp_estimator.h"
+#include "robot_sim.h"
+#include "virtual_clock.h"
+
+// --- TCS3200: output frequency at 100% scaling ---
+const float TCS_FULL_HZ = 100000.0f;   // perfect reflector
+const float TCS_DARK_HZ = 15000.0f;    // no reflection
+// --- HC-SR04 ---
+const float SOUND_CM_PER_US = 0.0343f;
+const float ULTRASONIC_MAX_CM = 400.0f;
+const float ULTRASONIC_CONE_RAD = 10.0f * (float)PI / 180.0f;
+const unsigned long ECHO_NO_TARGET_US = 38000;  // echo held high when nothing answers
+// --- IR reflectance array (phototransistor to 5 V, read as it darkens) ---
+const float LINE_RAW_WHITE = 60.0f;    // perfect reflector
+const float LINE_RAW_DARK = 980.0f;    // no reflection
+
+static const Course *course = NULL;
+static SimPinMap pins;
+static SimRobotParams params;
+static SimRobotState state;
+static uint64_t lastStepUs = 0;
+static float driveLeft, driveRight;   // signed enable duty the pins ask for
+static std::mt19937 rng;
+static std::mt19937 phaseRng;   // separate, so timing does not shift the noise draws
+static SimSensorStats stats;
+static float lastColourCm, lastRangeCm;
+static int filterS2, filterS3;
+static uint64_t filterChangedUs;
+static bool filterSettling;
+
+SimRobotParams simDefaultParams() {
+  SimRobotParams p;
+  p.maxSpeedCmS = 45.0f;
+  p.motorLagS = 0.08f;
+  p.slip = 0.05f;
+  p.deadbandPwm = 40.0f;
+  p.trackWidthCm = 14.0f;
+  p.colourOffsetCm = 8.0f;
+  p.rangeOffsetCm = 9.0f;
+  p.lineOffsetCm = 9.0f;
+  p.linePitchCm = 0.95f;
+  p.bodyRadiusCm = 9.0f;
+  p.rampLossPer10Deg = 0.25f;
+  p.servoCenterDeg = 90.0f;
+  p.physicsStepMs = 2.0f;
+  p.accelFitted = true;
+  p.colourNoise = 0.0f;
+  p.colourGain = 1.0f;
+  p.colourDriftPerMin = 0.0f;
+  p.rangeNoiseCm = 0.0f;
+  p.leftGain = 1.0f;
+  p.rightGain = 1.0f;
+  p.sagPerMin = 0.0f;
+  p.batteryVolts = 7.2f;
+  p.batteryDivider = 3.0f;
+  p.sensorTiming = SIM_TIMING_BLOCKING;
+  p.seed = 1;
+  return p;
+}
+
+void simSampleVariation(const SimVariation &v, uint32_t seed, SimRobotParams *params, Course *course) {
+  std::mt19937 draw(seed);
+  std::uniform_real_distribution<float> sym(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+  params->seed = seed;
+  params->colourNoise = v.colourNoise;
+  params->rangeNoiseCm = v.rangeNoiseCm;
+  params->colourGain = 1.0f + v.drift * sym(draw);
+  params->colourDriftPerMin = v.drift * sym(draw);
+  float split = v.asymmetry / 2.0f * sym(draw);
+  params->leftGain = 1.0f + split;
+  params->rightGain = 1.0f - split;
+  params->sagPerMin = v.sag * unit(draw);
+  course->startX += v.startJitterCm * gauss(draw);
+  course->startY += v.startJitterCm * gauss(draw);
+  course->startHeadingDeg += v.startJitterDeg * gauss(draw);
+}
+
+static float minutes(uint64_t us) {
+  return us / 60e6f;
+}
+
+static float noise(float stddev) {
+  if (stddev <= 0.0f) return 0.0f;
+  std::normal_distribution<float> gauss(0.0f, stddev);
+  return gauss(rng);
+}
+
+const SimRobotState *simState() {
+  return &state;
+}
+
+const SimSensorStats *simSensorStats() {
+  return &stats;
+}
+
+static int level(int pin) {
+  return pin >= 0 ? hostPinLevel((uint8_t)pin) : LOW;
+}
+
+// Effective duty 0..255 on an L298N enable pin, with the AVR core's
+// behaviour for analogWrite() on pins without a timer output.
+static float enableDuty(int pin) {
+  if (pin < 0) return 255.0f;
+  int pwm = hostPwmValue((uint8_t)pin);
+  if (pwm >= 0 && digitalPinHasPWM(pin)) return (float)pwm;
+  return level(pin) ? 255.0f : 0.0f;
+}
+
+// Fraction of the starting pack voltage left.
+static float batteryLevel() {
+  float level = 1.0f - params.sagPerMin * minutes(vclockNowUs());
+  return level < 0.5f ? 0.5f : level;
+}
+
+float simBatteryVolts() {
+  return params.batteryVolts * batteryLevel();
+}
+
+// Signed enable duty a wheel's pins ask for; 0 when they brake or coast.
+static float wheelDrive(int a, int b, int enable) {
+  int dir = (level(a) && !level(b)) ? 1 : ((!level(a) && level(b)) ? -1 : 0);
+  return dir * enableDuty(enable);
+}
+
+static float wheelTarget(float drive, float pitchDeg) {
+  float duty = fabsf(drive);
+  if (duty <= params.deadbandPwm) return 0.0f;
+  float frac = (duty - params.deadbandPwm) / (255.0f - params.deadbandPwm);
+  float loss = 1.0f - params.rampLossPer10Deg * fabsf(pitchDeg) / 10.0f;
+  if (loss < 0.0f) loss = 0.0f;
+  float dir = drive > 0.0f ? 1.0f : -1.0f;
+  return dir * frac * params.maxSpeedCmS * (1.0f - params.slip) * loss * batteryLevel();
+}
+
+static void integrate(float dt) {
+  float pitch = coursePitchDeg(course, state.x, state.y);
+  // Ramps rise along +x: driving the other way is downhill for the IMU.
+  state.pitchDeg = pitch * cosf(state.headingRad);
+  simulatedAccelSetPitch(state.pitchDeg);
+
+  float tl = wheelTarget(driveLeft, pitch) * params.leftGain;
+  float tr = wheelTarget(driveRight, pitch) * params.rightGain;
+  float k = params.motorLagS > 0.0f ? 1.0f - expf(-dt / params.motorLagS) : 1.0f;
+  state.vLeft += (tl - state.vLeft) * k;
+  state.vRight += (tr - state.vRight) * k;
+
+  float v = (state.vLeft + state.vRight) / 2.0f;
+  float w = (state.vRight - state.vLeft) / params.trackWidthCm;
+  state.headingRad += w * dt;
+  state.x += v * cosf(state.headingRad) * dt;
+  state.y += v * sinf(state.headingRad) * dt;
+  state.distanceCm += fabsf(v) * dt;
+
+  bool touching = courseTouchesObstacle(course, state.x, state.y, params.bodyRadiusCm);
+  if (touching && !state.touching) state.touches++;
+  state.touching = touching;
+  if (state.x < 0 || state.y < 0 || state.x >= course->width || state.y >= course->height) {
+    state.leftArena = true;
+  }
+}
+
+// Brings the robot up to nowUs in steps of at most physicsStepMs. Pin writes
+// and sensor reads call this first, so one that lands a few microseconds
+// earlier or later moves the robot by that much, not by a whole step.
+static void advanceTo(uint64_t nowUs) {
+  uint64_t stepUs = (uint64_t)(params.physicsStepMs * 1000.0f);
+  if (stepUs == 0) stepUs = 1;
+  while (lastStepUs < nowUs) {
+    uint64_t dtUs = nowUs - lastStepUs < stepUs ? nowUs - lastStepUs : stepUs;
+    integrate(dtUs / 1e6f);
+    lastStepUs += dtUs;
+  }
+}
+
+// Keeps the robot moving while the firmware blocks and writes nothing.
+static void physicsStep(void *ctx, uint64_t nowUs) {
+  (void)ctx;
+  advanceTo(nowUs);
+  vclockSchedule(nowUs + (uint64_t)(params.physicsStepMs * 1000.0f), physicsStep, NULL);
+}
+
+unsigned long simColourPulseUs() {
+  advanceTo(vclockNowUs());
+  float scale;
+  int s0 = level(pins.s0), s1 = level(pins.s1);
+  if (!s0 && !s1) return 0;                 // powered down
+  else if (!s0 && s1) scale = 0.02f;
+  else if (s0 && !s1) scale = 0.20f;
+  else scale = 1.0f;
+
+  float sx = state.x + cosf(state.headingRad) * params.colourOffsetCm;
+  float sy = state.y + sinf(state.headingRad) * params.colourOffsetCm;
+  float r, g, b;
+  courseReflectance(course, sx, sy, &r, &g, &b);
+
+  int s2 = level(pins.s2), s3 = level(pins.s3);
+  float refl;
+  if (!s2 && !s3) refl = r;
+  else if (s2 && s3) refl = g;
+  else if (!s2 && s3) refl = b;
+  else refl = (r + g + b) / 3.0f;            // clear
+  float gain = params.colourGain + params.colourDriftPerMin * minutes(vclockNowUs());
+  refl *= gain * (1.0f + noise(params.colourNoise));
+  if (refl < 0.0f) refl = 0.0f;
+
+  float hz = (TCS_DARK_HZ + TCS_FULL_HZ * refl) * scale;
+  return (unsigned long)(1e6f / (2.0f * hz));  // 50% duty: LOW half-period
+}
+
+float simRangeCm() {
+  advanceTo(vclockNowUs());
+  float heading = state.headingRad;
+  if (pins.servo >= 0) {
+    for (int ch = 0; ch < HAL_SERVO_MAX; ch++) {
+      if (hostServoPin(ch) == pins.servo) {
+        heading += (hostServoAngle(ch) - params.servoCenterDeg) * (float)PI / 180.0f;
+        break;
+      }
+    }
+  }
+  float sx = state.x + cosf(state.headingRad) * params.rangeOffsetCm;
+  float sy = state.y + sinf(state.headingRad) * params.rangeOffsetCm;
+  float best = ULTRASONIC_MAX_CM;
+  for (int i = -1; i <= 1; i++) {
+    float d = courseRayCast(course, sx, sy, heading + i * ULTRASONIC_CONE_RAD, ULTRASONIC_MAX_CM);
+    if (d < best) best = d;
+  }
+  if (best < ULTRASONIC_MAX_CM) best += noise(params.rangeNoiseCm);
+  return best > 0.0f ? best : 0.0f;
+}
+
+unsigned long simEchoPulseUs() {
+  float cm = simRangeCm();
+  return cm < ULTRASONIC_MAX_CM ? (unsigned long)(cm * 2.0f / SOUND_CM_PER_US) : 0;
+}
+
+// IR sees the floor as the mean of the three channels, under the same
+// lighting gain and noise as the colour sensor.
+int simLineRaw(int channel) {
+  advanceTo(vclockNowUs());
+  float lateral = (channel - (pins.lineCount - 1) / 2.0f) * params.linePitchCm;
+  float c = cosf(state.headingRad), s = sinf(state.headingRad);
+  float sx = state.x + c * params.lineOffsetCm + s * lateral;   // right of the heading
+  float sy = state.y + s * params.lineOffsetCm - c * lateral;
+  float r, g, b;
+  courseReflectance(course, sx, sy, &r, &g, &b);
+  float gain = params.colourGain + params.colourDriftPerMin * minutes(vclockNowUs());
+  float refl = (r + g + b) / 3.0f * gain * (1.0f + noise(params.colourNoise));
+  if (refl < 0.0f) refl = 0.0f;
+  if (refl > 1.0f) refl = 1.0f;
+  return (int)(LINE_RAW_DARK - (LINE_RAW_DARK - LINE_RAW_WHITE) * refl);
+}
+
+int simAnalogRead(uint8_t pin) {
+  if (pins.battery >= 0 && (int)pin == pins.battery) {
+    int raw = (int)(simBatteryVolts() / params.batteryDivider / 5.0f * 1023.0f + 0.5f);
+    return raw > 1023 ? 1023 : raw;
+  }
+  int channel = (int)pin - pins.lineFirst;
+  if (pins.lineCount <= 0 || channel < 0 || channel >= pins.lineCount) return 0;
+  return simLineRaw(channel);
+}
+
+// The motors run on the old levels up to the write, then on the new ones.
+static void watchMotorPins(uint8_t pin) {
+  int p = (int)pin;
+  if (p != pins.leftA && p != pins.leftB && p != pins.leftEnable &&
+      p != pins.rightA && p != pins.rightB && p != pins.rightEnable) {
+    return;
+  }
+  advanceTo(vclockNowUs());
+  driveLeft = wheelDrive(pins.leftA, pins.leftB, pins.leftEnable);
+  driveRight = wheelDrive(pins.rightA, pins.rightB, pins.rightEnable);
+}
+
+// The firmware's colour read switches the S2/S3 filter and then waits for
+// the output to settle before pulseIn(); that wait is charged to the read.
+static void watchFilterPins(uint8_t pin) {
+  if ((int)pin != pins.s2 && (int)pin != pins.s3) return;
+  int s2 = level(pins.s2), s3 = level(pins.s3);
+  if (s2 == filterS2 && s3 == filterS3) return;
+  filterS2 = s2;
+  filterS3 = s3;
+  filterChangedUs = vclockNowUs();
+  filterSettling = true;
+}
+
+static void watchPins(uint8_t pin) {
+  watchMotorPins(pin);
+  watchFilterPins(pin);
+}
+
+// SIM_TIMING_BLOCKING follows the AVR core's pulseIn() against the real
+// parts. The TCS3200 output is a free-running 50% square wave, so the call
+// lands anywhere in a period and waits for the next falling edge before it
+// times the LOW half. The HC-SR04 raises echo after its burst and holds it
+// for the round trip, or for ECHO_NO_TARGET_US when nothing answers; any of
+// that past the timeout costs the whole timeout and reads as 0.
+unsigned long simPulseCost(uint8_t pin, unsigned long width, unsigned long timeoutUs,
+                           unsigned long *blockedUs) {
+  uint64_t now = vclockNowUs();
+  bool colour = (int)pin == pins.sOut;
+  if (!colour && (int)pin != pins.echo) return 0;
+  unsigned long leadUs = SIM_ECHO_START_US;
+  unsigned long pulseUs = width != 0 ? width : ECHO_NO_TARGET_US;
+  if (colour) {
+    std::uniform_real_distribution<float> phase(0.0f, 1.0f);
+    leadUs = (unsigned long)(phase(phaseRng) * 2.0f * width);
+    pulseUs = width;
+  }
+
+  if (width > timeoutUs) width = 0;
+  unsigned long blocked = width != 0 ? width : timeoutUs;
+  if (params.sensorTiming == SIM_TIMING_BLOCKING) {
+    if (pulseUs == 0 || leadUs + pulseUs > timeoutUs) {
+      width = 0;
+      blocked = timeoutUs;
+    } else {
+      width = pulseUs;
+      blocked = leadUs + pulseUs;
+    }
+  } else if (params.sensorTiming == SIM_TIMING_BACKGROUND) {
+    blocked = 0;
+  }
+  *blockedUs = blocked;
+
+  if (colour) {
+    stats.colourReads++;
+    stats.colourBusyUs += blocked;
+    if (filterSettling) stats.colourBusyUs += now - filterChangedUs;
+    filterSettling = false;
+    if (stats.colourReads > 1 && state.distanceCm - lastColourCm > stats.colourGapMaxCm) {
+      stats.colourGapMaxCm = state.distanceCm - lastColourCm;
+    }
+    lastColourCm = state.distanceCm;
+  } else {
+    stats.rangeReads++;
+    stats.rangeBusyUs += blocked;
+    if (stats.rangeReads > 1 && state.distanceCm - lastRangeCm > stats.rangeGapMaxCm) {
+      stats.rangeGapMaxCm = state.distanceCm - lastRangeCm;
+    }
+    lastRangeCm = state.distanceCm;
+  }
+  return width;
+}
+
+unsigned long simPulseIn(uint8_t pin, uint8_t level, unsigned long timeoutUs, unsigned long *blockedUs) {
+  (void)level;
+  unsigned long width = 0;
+  if (pin == pins.sOut) {
+    width = simColourPulseUs();
+  } else if (pin == pins.echo) {
+    width = simEchoPulseUs();
+  }
+  return simPulseCost(pin, width, timeoutUs, blockedUs);
+}
+
+void simInstall(const Course *c, const SimPinMap &p, const SimRobotParams &rp) {
+  course = c;
+  pins = p;
+  params = rp;
+  state = SimRobotState();
+  state.x = c->startX;
+  state.y = c->startY;
+  state.headingRad = c->startHeadingDeg * (float)PI / 180.0f;
+  lastStepUs = vclockNowUs();
+  driveLeft = wheelDrive(pins.leftA, pins.leftB, pins.leftEnable);
+  driveRight = wheelDrive(pins.rightA, pins.rightB, pins.rightEnable);
+  rng.seed(rp.seed);
+  phaseRng.seed(rp.seed ^ 0x9e3779b9u);
+  stats = SimSensorStats();
+  filterS2 = level(pins.s2);
+  filterS3 = level(pins.s3);
+  filterSettling = false;
+  hostSetPulseSource(simPulseIn);
+  hostSetPinWriteHook(watchPins);
+  hostSetAnalogSource(simAnalogRead);
+  simulatedAccelSetFitted(rp.accelFitted);
+  vclockSchedule(lastStepUs, physicsStep, NULL);
+}
@@ -0,0 +1,127 @@
+/**
+ * Differential-drive robot model for the host simulator.
+ * Reads the L298N pins the firmware drives, integrates wheel speeds with a
+ * first-order motor lag and slip on the virtual clock, and answers the
+ * firmware's pulseIn() calls for the TCS3200 (from the course floor raster)
+ * and the HC-SR04 (by ray casting against the course segments), blocking
+ * the caller for as long as those reads take on the real parts, plus
+ * analogRead() on an optional IR reflectance array and the pack voltage
+ * divider. Wheel speed follows the pack voltage as it sags.
+ */
+
+#ifndef UTRA_HOST_ROBOT_SIM_H
+#define UTRA_HOST_ROBOT_SIM_H
+
+#include <stdint.h>
+#include "course.h"
+
+// Pin numbers as the sketch uses them; -1 = not connected / jumpered.
+// A wheel drives forward when its A pin is HIGH and its B pin LOW.
+typedef struct {
+  int leftA, leftB, leftEnable;
+  int rightA, rightB, rightEnable;
+  int s0, s1, s2, s3, sOut;
+  int trig, echo;
+  int servo;          // ultrasonic pan servo
+  int lineFirst, lineCount;  // reflectance array on consecutive analog pins, left to right
+  int battery;        // pack voltage divider
+} SimPinMap;
+
+// What a pulseIn() on the colour or echo pin costs the firmware.
+typedef enum {
+  SIM_TIMING_BLOCKING = 0,  // as on the Uno: wait for the edge, then the pulse
+  SIM_TIMING_WIDTH = 1,     // only the pulse width (the older, optimistic model)
+  SIM_TIMING_BACKGROUND = 2 // nothing, as if timer capture or an ISR measured it
+} SimSensorTiming;
+
+typedef struct {
+  float maxSpeedCmS;      // wheel speed at PWM 255 on the flat
+  float motorLagS;        // first-order time constant
+  float slip;             // fraction of commanded wheel speed lost
+  float deadbandPwm;      // PWM below which the wheel does not turn
+  float trackWidthCm;
+  float colourOffsetCm;   // colour sensor spot ahead of the axle
+  float rangeOffsetCm;    // ultrasonic ahead of the axle
+  float lineOffsetCm;     // reflectance array ahead of the axle
+  float linePitchCm;      // spacing of its channels
+  float bodyRadiusCm;     // for obstacle touches
+  float rampLossPer10Deg; // fraction of speed lost per 10 degrees of incline
+  float servoCenterDeg;   // servo angle at which the ultrasonic faces forward
+  float physicsStepMs;
+  bool accelFitted;       // the simulated MPU-6050 answers (ramp_estimator.h)
+  // run-to-run variation, all neutral by default
+  float colourNoise;      // relative std dev of each colour reading
+  float colourGain;       // lighting: reflectance gain at the start of the run
+  float colourDriftPerMin;// change in that gain per minute
+  float rangeNoiseCm;     // std dev of each ultrasonic reading
+  float leftGain, rightGain;  // motor asymmetry
+  float sagPerMin;        // battery sag: fraction of top speed lost per minute
+  float batteryVolts;     // pack voltage at the start, where maxSpeedCmS holds; sags with it
+  float batteryDivider;   // (R1 + R2) / R2 in front of the battery pin
+  SimSensorTiming sensorTiming;
+  uint32_t seed;
+} SimRobotParams;
+
+// Spread of the variation a Monte Carlo run samples from.
+typedef struct {
+  float colourNoise;      // used as is
+  float drift;            // start gain 1 +/- drift, drift/min +/- drift
+  float asymmetry;        // left/right gain split up to +/- asymmetry/2
+  float sag;              // sag per minute up to this
+  float rangeNoiseCm;     // used as is
+  float startJitterCm;    // std dev of start x and y
+  float startJitterDeg;   // std dev of start heading
+} SimVariation;
+
+typedef struct {
+  float x, y, headingRad;
+  float vLeft, vRight;    // cm/s
+  float pitchDeg;
+  int touches;            // obstacle contacts (rising edges)
+  bool touching;
+  bool leftArena;
+  float distanceCm;       // odometry
+} SimRobotState;
+
+// Where the sensor reads spend the firmware's time, and how far the robot
+// travels between readings: an obstacle or line edge that turns up just after
+// one reading is only seen at the next, so the gap is the reaction distance.
+typedef struct {
+  unsigned long colourReads, rangeReads;
+  uint64_t colourBusyUs;    // pulseIn() plus the settle after each filter change
+  uint64_t rangeBusyUs;
+  float colourGapMaxCm, rangeGapMaxCm;
+} SimSensorStats;
+
+SimRobotParams simDefaultParams();
+// Draws one run's robot and start pose from the spread in v.
+void simSampleVariation(const SimVariation &v, uint32_t seed, SimRobotParams *params, Course *course);
+
+// Installs the HAL hooks and starts the physics tick; call after hostReset().
+void simInstall(const Course *course, const SimPinMap &pins, const SimRobotParams &params);
+const SimRobotState *simState();
+const SimSensorStats *simSensorStats();
+
+// Raw TCS3200 output for the surface under the sensor, as pulseIn() would see
+// it with the current S0-S3 settings. Exposed for record/replay tooling.
+unsigned long simColourPulseUs();
+float simRangeCm();
+// HC-SR04 echo width for simRangeCm() (0 = nothing in range).
+unsigned long simEchoPulseUs();
+// analogRead() of reflectance array channel i (0 = leftmost): higher is darker.
+int simLineRaw(int channel);
+float simBatteryVolts();
+// Trigger to echo rising (the 40 kHz burst): an echo fits under a pulseIn()
+// timeout only if this plus its width does.
+const unsigned long SIM_ECHO_START_US = 460;
+// What pulseIn() returns and blocks for, under params.sensorTiming, when the
+// part puts out a pulse of width us (0 = dark sensor / no echo); other pulse
+// sources use it to keep the timing and the SimSensorStats consistent.
+unsigned long simPulseCost(uint8_t pin, unsigned long width, unsigned long timeoutUs,
+                           unsigned long *blockedUs);
+// The HostPulseSource and HostAnalogSource simInstall() registers, for
+// sources that wrap them.
+unsigned long simPulseIn(uint8_t pin, uint8_t level, unsigned long timeoutUs, unsigned long *blockedUs);
+int simAnalogRead(uint8_t pin);
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * Parallel simulation runs - see sim_batch.h
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_batch.h"
+
+static std::string executable;
+
+void simBatchSetExecutable(const char *argv0) {
+  char path[PATH_MAX];
+  ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (n > 0) {
+    path[n] = '\0';
+    executable = path;
+  } else {
+    executable = argv0;
+  }
+}
+
+static std::string shellQuote(const std::string &s) {
+  std::string out = "'";
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '\'') out += "'\\''";
+    else out += s[i];
+  }
+  return out + "'";
+}
+
+bool simParseSummary(const char *line, SimRunResult *out) {
+  *out = SimRunResult();
+  if (strncmp(line, "program=", 8) != 0) return false;
+  char result[32] = "";
+  const char *p = strstr(line, "result=");
+  if (p == NULL || sscanf(p, "result=%31s", result) != 1) return false;
+  out->result = result;
+  out->complete = out->result == "complete";
+  if ((p = strstr(line, "time_ms=")) != NULL) out->timeMs = strtoul(p + 8, NULL, 10);
+  if ((p = strstr(line, "touches=")) != NULL) out->touches = atoi(p + 8);
+  if ((p = strstr(line, "stage=")) != NULL) sscanf(p, "stage=%d.%d", &out->machine, &out->state);
+  if ((p = strstr(line, " x=")) != NULL) out->x = strtof(p + 3, NULL);
+  if ((p = strstr(line, " y=")) != NULL) out->y = strtof(p + 3, NULL);
+  if ((p = strstr(line, "distance=")) != NULL) out->distanceCm = strtof(p + 9, NULL);
+  out->parsed = true;
+  return true;
+}
+
+static SimRunResult runOne(const SimRunArgs &args) {
+  std::string cmd = shellQuote(executable);
+  for (size_t i = 0; i < args.size(); i++) cmd += " " + shellQuote(args[i]);
+  cmd += " 2>/dev/null";
+
+  SimRunResult result = SimRunResult();
+  FILE *child = popen(cmd.c_str(), "r");
+  if (child == NULL) return result;
+  char line[512];
+  while (fgets(line, sizeof(line), child) != NULL) {
+    if (simParseSummary(line, &result)) break;
+  }
+  while (fgets(line, sizeof(line), child) != NULL) {}
+  pclose(child);
+  return result;
+}
+
+std::vector<SimRunResult> simBatchRun(const std::vector<SimRunArgs> &runs, WorkPool *pool) {
+  std::vector<SimRunResult> results(runs.size());
+  for (size_t i = 0; i < runs.size(); i++) {
+    pool->submit([&runs, &results, i] { results[i] = runOne(runs[i]); });
+  }
+  pool->wait();
+  return results;
+}
@@ -0,0 +1,33 @@
+/**
+ * Runs many simulations in parallel for the host batch tools.
+ * Each run is a separate process of this same executable with its own
+ * arguments (--program, --set, ...). The firmware keeps its state in globals,
+ * so separate processes are the only way to run it concurrently. Results
+ * come back through the summary line host_main prints.
+ */
+
+#ifndef UTRA_HOST_SIM_BATCH_H
+#define UTRA_HOST_SIM_BATCH_H
+
+#include <string>
+#include <vector>
+#include "work_pool.h"
+
+typedef struct {
+  bool parsed;            // summary line found
+  bool complete;
+  std::string result;     // complete | timeout | off_course
+  unsigned long timeMs;
+  int touches;
+  int machine, state;     // last state machine and state entered (0.0 if none)
+  float x, y;
+  float distanceCm;       // odometer: wheel travel, including any spinning on the spot
+} SimRunResult;
+
+typedef std::vector<std::string> SimRunArgs;
+
+void simBatchSetExecutable(const char *argv0);
+bool simParseSummary(const char *line, SimRunResult *out);
+std::vector<SimRunResult> simBatchRun(const std::vector<SimRunArgs> &runs, WorkPool *pool);
+
+#endif
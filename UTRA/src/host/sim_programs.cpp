@@ -0,0 +1,140 @@
+/**
+ * Program table for the host simulator - see sim_programs.h
+ */
+
+#include <string.h>
+#include "Arduino.h"
+#include "Servo.h"
+#include "battery.h"
+#include "colour_classifier.h"
+#include "flight_recorder.h"
+#include "profiler.h"
+#include "serial_command.h"
+#include "stall_detector.h"
+#include "state_stats.h"
+#include "telemetry.h"
+#include "tunable.h"
+#include "sim_programs.h"
+
+// Headers above are already included, so the sketches' own #includes are
+// no-ops inside the namespaces.
+namespace obstacle_sketch {
+#include "../old_challengeTwo.ino"
+}
+
+namespace challenge2_sketch {
+#include "../challenge2.c"
+}
+
+bool isChallengeOneComplete();
+bool isChallengeTwoComplete();
+
+static bool mainDone() {
+  return isChallengeOneComplete() && isChallengeTwoComplete();
+}
+
+static bool obstacleDone() {
+  return obstacle_sketch::robotState == obstacle_sketch::STATE_END;
+}
+
+// Pin maps follow each program's own motor polarity, and the model reads
+// the pins as wired, so a pin shared between two devices shows up in
+// simulation as it would on the robot (SimProgram::pinConflict). The main
+// build's S1 is tied to GND, hence -1.
+//
+// The obstacle sketch's timed turns and bypass legs are dead reckoned at
+// CRUISE_CM_PER_S (25 cm/s), so it runs on motors that reach that after
+// slip rather than the default 45 cm/s, which turn ~160 degrees per
+// 90-degree TURN_LEFT_MS. The main build runs on the same motors.
+static const SimProgram programs[] = {
+  { "main", setup, loop, mainDone, courseChallengeOne,
+    { 10, 9, 11,   5, 6, 3,   2, -1, 4, 13, 12,   7, 8,   -1,   A1, 5,   A0 },
+    { "old_challenge_one.cpp", "old_challenge_one_part_two.cpp" },
+    { STATE_MACHINE_CHALLENGE_ONE, STATE_MACHINE_CHALLENGE_TWO },
+    26.3f, NULL },
+  { "obstacle", obstacle_sketch::setup, obstacle_sketch::loop, obstacleDone, courseObstacle,
+    { 10, 9, 11,   12, 8, 3,   2, 7, 4, 5, 6,   A4, A5,   A3,   -1, 0,   A0 },
+    { "old_challengeTwo.ino", NULL },
+    { STATE_MACHINE_OBSTACLE, 0 },
+    26.3f, NULL },
+  { "challenge2", challenge2_sketch::setup, challenge2_sketch::loop, NULL, courseObstacle,
+    { 10, 9, -1,   12, 11, -1,   2, 3, 4, 5, 6,   A4, A5,   -1,   -1, 0,   A0 },
+    { NULL, NULL },
+    { STATE_MACHINE_CHALLENGE2, 0 },
+    0.0f, NULL },
+};
+
+const SimProgram *simPrograms(int *count) {
+  *count = sizeof(programs) / sizeof(programs[0]);
+  return programs;
+}
+
+const SimProgram *simFindProgram(const char *name) {
+  int count;
+  const SimProgram *list = simPrograms(&count);
+  for (int i = 0; i < count; i++) {
+    if (strcmp(list[i].name, name) == 0) return &list[i];
+  }
+  return NULL;
+}
+
+// Same order as the firmware enums, indexed by StateMachineId.
+static const char *const CHALLENGE_ONE_STATES[] = {
+  "STAGE1_GREEN_PATH", "STAGE2_RAMP_ASCENT", "STAGE3_PLATFORM_DETECTED", "STAGE4_PLATFORM_NAV", "DONE"
+};
+static const char *const CHALLENGE_TWO_STATES[] = {
+  "FIND_WALL_ANGLE", "ALIGN_TO_WALL", "RETURN_TO_RAMP", "DESCEND_RAMP", "FIND_GREEN_LINE",
+  "FOLLOW_GREEN_HOME", "DONE"
+};
+static const char *const OBSTACLE_STATES[] = {
+  "FOLLOW_RED", "AVOID_LEFT", "AVOID_FORWARD1", "AVOID_RIGHT1", "AVOID_FORWARD2", "AVOID_RIGHT2",
+  "AVOID_FORWARD3", "ALIGN_LEFT", "TURN_RIGHT_INTERSECTION", "END"
+};
+static const char *const CHALLENGE2_STATES[] = {
+  "FOLLOW_RED", "CHECK_LEFT", "CHECK_RIGHT", "AVOID_OBSTACLE", "BLOCK_PICKUP", "BLOCK_DROPOFF",
+  "FINISHED"
+};
+
+static const char *const *stateNames(int machine, int *count) {
+  if (machine == STATE_MACHINE_CHALLENGE_ONE) {
+    *count = sizeof(CHALLENGE_ONE_STATES) / sizeof(CHALLENGE_ONE_STATES[0]);
+    return CHALLENGE_ONE_STATES;
+  } else if (machine == STATE_MACHINE_CHALLENGE_TWO) {
+    *count = sizeof(CHALLENGE_TWO_STATES) / sizeof(CHALLENGE_TWO_STATES[0]);
+    return CHALLENGE_TWO_STATES;
+  } else if (machine == STATE_MACHINE_OBSTACLE) {
+    *count = sizeof(OBSTACLE_STATES) / sizeof(OBSTACLE_STATES[0]);
+    return OBSTACLE_STATES;
+  } else if (machine == STATE_MACHINE_CHALLENGE2) {
+    *count = sizeof(CHALLENGE2_STATES) / sizeof(CHALLENGE2_STATES[0]);
+    return CHALLENGE2_STATES;
+  }
+  *count = 0;
+  return NULL;
+}
+
+const char *simStateName(int machine, int state) {
+  int count;
+  const char *const *names = stateNames(machine, &count);
+  return names != NULL && state >= 0 && state < count ? names[state] : "?";
+}
+
+int simStateCount(int machine) {
+  int count;
+  stateNames(machine, &count);
+  return count;
+}
+
+// Each machine gets an equal share; within it, a state's share is its
+// position in the enum, which for these sketches is the order they run in.
+float simProgramProgress(const SimProgram *program, int machine, int state) {
+  int used = 0, index = -1;
+  for (int m = 0; m < SIM_PROGRAM_MAX_MACHINES && program->machines[m] != 0; m++) {
+    if (program->machines[m] == machine) index = m;
+    used++;
+  }
+  int count = simStateCount(machine);
+  if (index < 0 || count == 0 || state < 0) return 0.0f;
+  if (state >= count) state = count - 1;
+  return (index + (float)state / count) / used;
+}
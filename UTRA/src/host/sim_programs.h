@@ -0,0 +1,41 @@
+/**
+ * Firmware programs the host simulator can run.
+ * "main" is the Uno build (challenge one then part two); "obstacle" and
+ * "challenge2" are the standalone sketches, compiled into their own
+ * namespaces so their globals do not collide with the main build.
+ */
+
+#ifndef UTRA_HOST_SIM_PROGRAMS_H
+#define UTRA_HOST_SIM_PROGRAMS_H
+
+#include "course.h"
+#include "robot_sim.h"
+
+const int SIM_PROGRAM_MAX_SOURCES = 2;
+const int SIM_PROGRAM_MAX_MACHINES = 2;
+
+typedef struct {
+  const char *name;
+  void (*setup)();
+  void (*loop)();
+  bool (*isDone)();       // NULL: done when the robot reaches the course goal
+  Course (*course)();     // default course when no --floor/--shapes is given
+  SimPinMap pins;
+  const char *sources[SIM_PROGRAM_MAX_SOURCES];  // whose TUNABLEs belong to it
+  int machines[SIM_PROGRAM_MAX_MACHINES];        // StateMachineIds in run order, 0 = unused
+  float maxSpeedCmS;      // wheel speed at PWM 255 its timed moves assume; 0 = simDefaultParams()
+  const char *pinConflict;  // pins wired to two devices, so the run is expected to fail; NULL if none
+} SimProgram;
+
+const SimProgram *simFindProgram(const char *name);
+const SimProgram *simPrograms(int *count);
+// Name of a state as reported by stateStatsActive(), for reports.
+const char *simStateName(int machine, int state);
+// Number of states in a machine, 0 if unknown.
+int simStateCount(int machine);
+// How far through its state machines a program got on reaching a state,
+// from 0 (first state of the first machine) towards 1. 0 if the program
+// has no state machines or the machine is not one of its own.
+float simProgramProgress(const SimProgram *program, int machine, int state);
+
+#endif
@@ -0,0 +1,397 @@
+/**
+ * Recorded trace replay - see trace_replay.h
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "Arduino.h"
+#include "hal_host.h"
+#include "line_array.h"
+#include "sim_programs.h"
+#include "state_stats.h"
+#include "telemetry.h"
+#include "trace_replay.h"
+#include "tunable.h"
+#include "virtual_clock.h"
+
+const uint16_t NO_ECHO_MIN_CM = 9999;      // firmware NO_ECHO_CM and the like
+
+static const Trace *trace = NULL;
+static SimPinMap pins;
+static long lineFloorRaw = 0, lineTapeRaw = 0;   // the array's levels in the firmware
+static bool closedLoop = false;
+static size_t cursor = 0;
+static bool exhausted = false;    // the firmware sent a record past the last one
+static bool colourPending = false;  // blue read since the last record went out
+static std::vector<TraceTransition> replayed;
+static int replayedMachine = 0;
+static uint32_t endMs = 0;
+
+// ========== Loading ==========
+static uint16_t get16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out, size_t outMax) {
+  size_t o = 0;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0) return 0;
+    for (uint8_t k = 1; k < code; k++) {
+      if (i >= len || o >= outMax) return 0;
+      out[o++] = in[i++];
+    }
+    if (code != 0xFF && i < len) {
+      if (o >= outMax) return 0;
+      out[o++] = 0;
+    }
+  }
+  return o;
+}
+
+static void addTransition(Trace *t, uint32_t tMs, uint8_t machine, uint8_t state) {
+  if (!t->transitions.empty() && t->transitions.back().machine == machine &&
+      t->transitions.back().state == state) {
+    return;
+  }
+  TraceTransition tr = { tMs, machine, state };
+  t->transitions.push_back(tr);
+}
+
+void traceDecodeTelemetry(const uint8_t *data, size_t len, Trace *trace) {
+  uint32_t lastMs = 0;
+  bool haveStateRecords = false;
+  uint8_t payload[TELEMETRY_MAX_FRAME];
+  size_t start = 0;
+  trace->perRecord = true;
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] != 0) continue;
+    size_t n = cobsDecode(data + start, i - start, payload, sizeof(payload));
+    start = i + 1;
+    if (n < 3 || telemetryCrc16(payload, n - 2) != get16(payload + n - 2)) continue;
+    n -= 2;
+
+    if (payload[0] == TELEMETRY_STATE && n == TELEMETRY_STATE_LEN) {
+      uint32_t t = get32(payload + 2);
+      if (t < lastMs) continue;               // post-run dump of what was already streamed
+      lastMs = t;
+      if (!haveStateRecords) trace->transitions.clear();
+      haveStateRecords = true;
+      addTransition(trace, t, payload[6], payload[1]);
+    } else if (payload[0] == TELEMETRY_SENSOR && n == TELEMETRY_SENSOR_LEN) {
+      // 16-bit timestamps, unwrapped against the last full time seen
+      uint32_t t = (lastMs & 0xFFFF0000UL) | get16(payload + 2);
+      if (t + 0x8000UL < lastMs) t += 0x10000UL;
+      if (!trace->samples.empty() && t < trace->samples.back().frame.tMs) continue;
+      lastMs = t;
+      TraceSample s = TraceSample();
+      s.frame.tMs = t;
+      s.state = payload[1];
+      s.frame.redPW = get16(payload + 4);
+      s.frame.greenPW = get16(payload + 6);
+      s.frame.bluePW = get16(payload + 8);
+      s.frame.colour = payload[10];
+      s.frame.distanceCm = get16(payload + 11);
+      trace->samples.push_back(s);
+      if (!haveStateRecords) addTransition(trace, t, 0, s.state);
+    } else if (payload[0] == TELEMETRY_LINE && n == TELEMETRY_LINE_LEN) {
+      // Follows the sensor record of the same frame.
+      if (trace->samples.empty()) continue;
+      SensorFrame *f = &trace->samples.back().frame;
+      if ((uint16_t)f->tMs != get16(payload + 2)) continue;
+      f->linePos = (int16_t)get16(payload + 4);
+      f->lineWidth = get16(payload + 6);
+      trace->hasLine = true;
+    }
+  }
+}
+
+static bool loadCsv(FILE *f, Trace *trace, std::string *error) {
+  char line[256];
+  int lineNo = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineNo++;
+    if (line[0] == '#' || line[0] == '\n' || (lineNo == 1 && strncmp(line, "t_ms", 4) == 0)) continue;
+    unsigned long t, r, g, b, cm, state = 0;
+    int fields = sscanf(line, "%lu,%lu,%lu,%lu,%lu,%lu", &t, &r, &g, &b, &cm, &state);
+    if (fields < 5) {
+      *error = "bad row at line " + std::to_string(lineNo);
+      return false;
+    }
+    TraceSample s = TraceSample();
+    s.frame.tMs = t;
+    s.frame.redPW = (uint16_t)r;
+    s.frame.greenPW = (uint16_t)g;
+    s.frame.bluePW = (uint16_t)b;
+    s.frame.distanceCm = (uint16_t)cm;
+    s.frame.colour = 0;
+    s.state = (uint8_t)state;
+    if (!trace->samples.empty() && t < trace->samples.back().frame.tMs) {
+      *error = "time goes backwards at line " + std::to_string(lineNo);
+      return false;
+    }
+    trace->samples.push_back(s);
+    if (fields == 6) addTransition(trace, t, 0, s.state);
+  }
+  return true;
+}
+
+bool traceLoad(const char *path, Trace *trace, std::string *error) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    *error = strerror(errno);
+    return false;
+  }
+  *trace = Trace();
+  size_t len = strlen(path);
+  bool ok = true;
+  if (len > 4 && strcmp(path + len - 4, ".csv") == 0) {
+    ok = loadCsv(f, trace, error);
+  } else {
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    traceDecodeTelemetry(data.data(), data.size(), trace);
+  }
+  fclose(f);
+  if (ok && trace->samples.empty()) {
+    *error = "no sensor frames";
+    ok = false;
+  }
+  return ok;
+}
+
+// ========== Replay ==========
+// The frame a read at nowUs answers from, or NULL past the end of the trace.
+static const SensorFrame *frameAt(uint64_t nowUs, bool colour) {
+  const std::vector<TraceSample> &s = trace->samples;
+  if (trace->perRecord) {
+    // A read goes into the next record the firmware sends, the next one in
+    // the trace; recordSent() moves the cursor on. A colour read after the
+    // blue of a set that has not gone out yet starts the set after it (the
+    // pipelined obstacle build reads on before its control step sends).
+    // Reads past the last record hold it, so the loop that ended the run
+    // can finish; the replay ends when a record goes out past it.
+    if (exhausted || s.empty()) return NULL;
+    size_t next = cursor + (colour && colourPending ? 1 : 0);
+    return &s[next < s.size() ? next : s.size() - 1].frame;
+  }
+  if (nowUs > (uint64_t)endMs * 1000) return NULL;
+  uint32_t nowMs = (uint32_t)(nowUs / 1000);
+  while (cursor + 1 < s.size() && s[cursor + 1].frame.tMs <= nowMs) cursor++;
+  return &s[cursor].frame;
+}
+
+static bool pastEnd(uint64_t nowUs) {
+  return trace->perRecord ? exhausted : nowUs > (uint64_t)endMs * 1000;
+}
+
+static void noteState(uint32_t tMs, uint8_t machine, uint8_t state) {
+  if (pastEnd(vclockNowUs())) return;
+  replayedMachine = machine;
+  if (!replayed.empty() && replayed.back().machine == machine && replayed.back().state == state) {
+    return;
+  }
+  TraceTransition tr = { tMs, machine, state };
+  replayed.push_back(tr);
+}
+
+// Telemetry tap: the replayed firmware's own state records are its
+// transitions, so two machines switching in the same millisecond (main's
+// challenge one handing over to part two) both count.
+static void recordSent(const uint8_t *payload, uint8_t len) {
+  if (len == TELEMETRY_STATE_LEN && payload[0] == TELEMETRY_STATE) {
+    noteState(get32(payload + 2), payload[6], payload[1]);
+  } else if (trace->perRecord && len == TELEMETRY_SENSOR_LEN && payload[0] == TELEMETRY_SENSOR) {
+    if (++cursor > trace->samples.size()) exhausted = true;
+    colourPending = false;
+  }
+}
+
+// The distance the firmware logs for an echo of us, by the active sketch's
+// own conversion: part two rounds duration / 2 / 29.1, challenge2.c keeps
+// duration * 340 / 200, the obstacle sketch truncates duration * 34 / 2000.
+static uint16_t echoCm(unsigned long us) {
+  const StateStats *active = stateStatsActive();
+  int machine = active != NULL ? active->machine : 0;
+  if (machine == STATE_MACHINE_CHALLENGE_TWO) return (uint16_t)(us / 2.0f / 29.1f + 0.5f);
+  if (machine == STATE_MACHINE_CHALLENGE2) return (uint16_t)(us * 340 / 200);
+  return (uint16_t)(us * 34 / 2000);
+}
+
+// An echo the firmware converts back to exactly the distance it logged.
+// The simulated robot's own echo when it agrees (the replay is following the
+// recorded run, so its timing is the recording's to the microsecond);
+// otherwise none for a no-echo reading, or the middle of the widths that
+// convert to cm but no later than the timeout allows - the recorded echo
+// fitted under it.
+static unsigned long echoWidthUs(uint16_t cm, unsigned long timeoutUs) {
+  unsigned long simUs = simEchoPulseUs();
+  bool simHeard = simUs != 0 && simUs + SIM_ECHO_START_US <= timeoutUs;
+  if (simHeard ? echoCm(simUs) == cm : cm >= NO_ECHO_MIN_CM) return simUs;
+  if (cm >= NO_ECHO_MIN_CM) return 0;
+  unsigned long lo = 0, shortest = 1;   // echoCm(lo) < cm <= echoCm(shortest)
+  while (echoCm(shortest) < cm) {
+    lo = shortest;
+    shortest *= 2;
+  }
+  while (shortest - lo > 1) {
+    unsigned long mid = lo + (shortest - lo) / 2;
+    if (echoCm(mid) < cm) lo = mid;
+    else shortest = mid;
+  }
+  unsigned long longest = shortest;
+  while (echoCm(longest + 1) == cm) longest++;
+  unsigned long width = (shortest + longest) / 2;
+  if (timeoutUs > SIM_ECHO_START_US && width > timeoutUs - SIM_ECHO_START_US) {
+    width = timeoutUs - SIM_ECHO_START_US;
+  }
+  return width > shortest ? width : shortest;
+}
+
+static unsigned long replayPulseIn(uint8_t pin, uint8_t level, unsigned long timeoutUs,
+                                   unsigned long *blockedUs) {
+  uint64_t now = vclockNowUs();
+  const SensorFrame *f = frameAt(now, pin == pins.sOut);
+  if (f == NULL) {
+    return closedLoop ? simPulseIn(pin, level, timeoutUs, blockedUs) : 0;
+  }
+  unsigned long width = 0;
+  if (pin == pins.sOut) {
+    // Draw the sim's reading too, so its noise stays in step with the
+    // recording's and its echoes line up (echoWidthUs()).
+    simColourPulseUs();
+    int s2 = hostPinLevel((uint8_t)pins.s2), s3 = hostPinLevel((uint8_t)pins.s3);
+    if (!s2 && !s3) width = f->redPW;
+    else if (s2 && s3) width = f->greenPW;
+    else if (!s2 && s3) {
+      width = f->bluePW;
+      colourPending = true;
+    }
+    else width = (f->redPW + f->greenPW + f->bluePW) / 3;
+  } else if (pin == pins.echo) {
+    width = echoWidthUs(f->distanceCm, timeoutUs);
+  }
+  return simPulseCost(pin, width, timeoutUs, blockedUs);
+}
+
+// Q8 of a line lineWidth wide at linePos that lies left of x (Q8 from the
+// array centre), rounded so that adjacent channels' shares add up to it.
+static long lineLeftOf(const SensorFrame *f, float x) {
+  float covered = x - (f->linePos - f->lineWidth / 2.0f);
+  if (covered <= 0.0f) return 0;
+  return lroundf(covered < f->lineWidth ? covered : f->lineWidth);
+}
+
+// A channel is covered by the share of the line over its pitch. The
+// firmware's estimate takes that coverage back from the reading between its
+// floor and tape levels, so the recorded width comes back exactly and the
+// position to within rounding.
+static int lineRawFor(const SensorFrame *f, int channel) {
+  float left = (channel - pins.lineCount / 2.0f) * LINE_PITCH_Q8;
+  long cover = lineLeftOf(f, left + LINE_PITCH_Q8) - lineLeftOf(f, left);
+  long span = lineTapeRaw - lineFloorRaw;
+  return (int)(lineFloorRaw + (cover * span + LINE_PITCH_Q8 - 1) / LINE_PITCH_Q8);
+}
+
+static int replayAnalogRead(uint8_t pin) {
+  // Read the sim too, so its noise stays in step with the recording's.
+  int raw = simAnalogRead(pin);
+  int channel = (int)pin - pins.lineFirst;
+  if (!trace->hasLine || lineTapeRaw <= lineFloorRaw || channel < 0 || channel >= pins.lineCount) {
+    return raw;
+  }
+  const SensorFrame *f = frameAt(vclockNowUs(), false);
+  return f != NULL ? lineRawFor(f, channel) : raw;
+}
+
+// The current value of a tunable, or fallback when file doesn't declare it.
+static long tunableIn(const char *file, const char *name, long fallback) {
+  for (int i = 0; i < tunableCount(); i++) {
+    if (strcmp(tunableAt(i)->name, name) == 0 && tunableDeclaredIn(i, file)) return tunableAt(i)->value;
+  }
+  return fallback;
+}
+
+void replayInstall(const Trace *t, const SimPinMap &p, bool closed) {
+  trace = t;
+  pins = p;
+  closedLoop = closed;
+  cursor = 0;
+  exhausted = false;
+  colourPending = false;
+  replayed.clear();
+  // Run on for the longest recorded loop, so the loop that read the last
+  // frame gets to act on it.
+  uint32_t longest = 0;
+  for (size_t i = 1; i < t->samples.size(); i++) {
+    uint32_t gap = t->samples[i].frame.tMs - t->samples[i - 1].frame.tMs;
+    if (gap > longest) longest = gap;
+  }
+  endMs = t->samples.back().frame.tMs + longest;
+  hostSetPulseSource(replayPulseIn);
+  lineFloorRaw = tunableIn("old_challenge_one.cpp", "LINE_FLOOR_RAW", 0);
+  lineTapeRaw = tunableIn("old_challenge_one.cpp", "LINE_TAPE_RAW", 0);
+  hostSetAnalogSource(replayAnalogRead);
+  telemetrySetHostTap(recordSent);
+}
+
+uint32_t replayEndMs() {
+  return endMs;
+}
+
+bool replayFeeding(uint64_t nowUs) {
+  return !pastEnd(nowUs);
+}
+
+bool replayFinished(uint64_t nowUs) {
+  return !closedLoop && pastEnd(nowUs);
+}
+
+void replayReport() {
+  const std::vector<TraceTransition> &rec = trace->transitions;
+  printf("replay: %zu frames over %.1f s, %zu recorded transitions, %zu replayed\n",
+         trace->samples.size(),
+         (trace->samples.back().frame.tMs - trace->samples.front().frame.tMs) / 1000.0,
+         rec.size(), replayed.size());
+
+  // Pair each recorded transition with the next replayed one into the same
+  // state of the same machine (any machine where the trace doesn't say).
+  size_t j = 0;
+  int matched = 0;
+  long latencySum = 0, worst = 0;
+  for (size_t i = 0; i < rec.size(); i++) {
+    size_t k = j;
+    while (k < replayed.size() && (replayed[k].state != rec[i].state ||
+                                   (rec[i].machine != 0 && replayed[k].machine != rec[i].machine))) {
+      k++;
+    }
+    int machine = rec[i].machine != 0 ? rec[i].machine : replayedMachine;
+    const char *name = simStateName(machine, rec[i].state);
+    if (k == replayed.size()) {
+      printf("  recorded t=%7lu %-26s replayed: never\n", (unsigned long)rec[i].tMs, name);
+      continue;
+    }
+    long latency = (long)replayed[k].tMs - (long)rec[i].tMs;
+    printf("  recorded t=%7lu %-26s replayed t=%7lu (%+ld ms)\n", (unsigned long)rec[i].tMs, name,
+           (unsigned long)replayed[k].tMs, latency);
+    matched++;
+    latencySum += latency;
+    if (labs(latency) > labs(worst)) worst = latency;
+    j = k + 1;
+  }
+  if (matched > 0) {
+    printf("matched %d/%zu, latency mean %+ld ms, worst %+ld ms\n", matched, rec.size(),
+           latencySum / matched, worst);
+  } else {
+    printf("matched 0/%zu\n", rec.size());
+  }
+}
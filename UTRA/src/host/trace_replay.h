@@ -0,0 +1,72 @@
+/**
+ * Replays recorded sensor traces through the firmware on the host.
+ *
+ * A trace is either a raw serial capture of the telemetry stream (COBS
+ * frames, as written by --serial-out or captured from the robot, including
+ * flight recorder dumps) or a CSV with the columns
+ *   t_ms,red_pw,green_pw,blue_pw,distance_cm[,state]
+ * While the trace lasts, pulseIn() on the colour and echo pins answers from
+ * a recorded frame, blocking as long as the simulator's sensor timing says
+ * that read takes, so the state machines make the decisions they would have
+ * made on the robot. A telemetry capture has one sensor record per record
+ * the firmware sent, so each read answers from the record the replayed
+ * firmware sends next, and the run stays in step with the recording
+ * whatever the timing. A CSV is a signal over time: each read answers from
+ * the row at the current virtual time (sample and hold).
+ * When the capture has line records (-DUTRA_LINE_ARRAY), analogRead() on the
+ * reflectance array's pins answers with a line of the recorded width at the
+ * recorded position, on the floor and tape levels of challenge one's
+ * LINE_FLOOR_RAW / LINE_TAPE_RAW, so the followers steer as they did;
+ * otherwise the array reads the simulated floor.
+ * Replay compares state transitions, so it refuses programs without a
+ * StateStats machine (SimProgram.machines).
+ * Closed-loop replay hands the sensors to the simulator when the trace ends,
+ * from wherever the simulated robot got to by driving those decisions.
+ *
+ * Replaying a --serial-out capture with the recording's --seed and variation
+ * flags reproduces the run, pose and touches included: the simulated robot
+ * follows the recorded one, so its echoes and sensor timing are the
+ * recording's to the microsecond. Without them the trace still drives the
+ * same decisions, but the pipelined build's read order can drift from it.
+ */
+
+#ifndef UTRA_HOST_TRACE_REPLAY_H
+#define UTRA_HOST_TRACE_REPLAY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "robot_sim.h"
+#include "sensor_frame.h"
+
+typedef struct {
+  SensorFrame frame;
+  uint8_t state;          // state byte of the sensor record
+} TraceSample;
+
+typedef struct {
+  uint32_t tMs;
+  uint8_t machine;        // StateMachineId; 0 where the trace doesn't say (sensor records, CSV)
+  uint8_t state;
+} TraceTransition;
+
+typedef struct {
+  std::vector<TraceSample> samples;
+  std::vector<TraceTransition> transitions;  // from state records, else from samples
+  bool perRecord;         // samples are the firmware's sensor records, in send order
+  bool hasLine;           // line records: linePos/lineWidth are the array's readings
+} Trace;
+
+bool traceLoad(const char *path, Trace *trace, std::string *error);
+// Decodes a telemetry capture; frames failing COBS or CRC are skipped.
+void traceDecodeTelemetry(const uint8_t *data, size_t len, Trace *trace);
+
+// Call after simInstall(); the trace must outlive the run.
+void replayInstall(const Trace *trace, const SimPinMap &pins, bool closedLoop);
+uint32_t replayEndMs();
+bool replayFeeding(uint64_t nowUs);    // the sensors still answer from the trace
+bool replayFinished(uint64_t nowUs);   // open-loop replay has run out of trace
+// Recorded vs replayed transitions with their latency, to stdout.
+void replayReport();
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * Tunable constant registry for host builds - see tunable.h
+ * Registration happens during static initialisation, so the table is plain
+ * zero-initialised storage rather than a container with a constructor.
+ * Entries are keyed on name and declaring file, so each sketch keeps its
+ * own default and range for a constant another sketch also declares.
+ */
+
+#include <string.h>
+#include "tunable.h"
+
+const int TUNABLE_MAX = 96;
+
+typedef struct {
+  TunableInfo info;
+  void *var;
+  void (*store)(void *var, long value);
+} TunableVar;
+
+static TunableVar vars[TUNABLE_MAX];
+static int varCount = 0;
+
+static const char *baseName(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash != NULL ? slash + 1 : path;
+}
+
+long tunableRegister(const char *name, const char *file, void *var,
+                     void (*store)(void *var, long value), long value, long minValue, long maxValue) {
+  if (varCount < TUNABLE_MAX) {
+    TunableVar *v = &vars[varCount++];
+    v->info.name = name;
+    v->info.file = baseName(file);
+    v->info.value = value;
+    v->info.minValue = minValue;
+    v->info.maxValue = maxValue;
+    v->var = var;
+    v->store = store;
+  }
+  return value;
+}
+
+bool tunableSet(const char *name, long value) {
+  const char *colon = strchr(name, ':');
+  size_t fileLen = colon != NULL ? (size_t)(colon - name) : 0;
+  const char *bare = colon != NULL ? colon + 1 : name;
+  bool found = false;
+  for (int i = 0; i < varCount; i++) {
+    const TunableInfo *t = &vars[i].info;
+    if (strcmp(t->name, bare) != 0) continue;
+    if (colon != NULL && (strlen(t->file) != fileLen || strncmp(t->file, name, fileLen) != 0)) continue;
+    vars[i].store(vars[i].var, value);
+    vars[i].info.value = value;
+    found = true;
+  }
+  return found;
+}
+
+int tunableCount() {
+  return varCount;
+}
+
+const TunableInfo *tunableAt(int index) {
+  return index >= 0 && index < varCount ? &vars[index].info : NULL;
+}
+
+bool tunableDeclaredIn(int index, const char *file) {
+  const TunableInfo *t = tunableAt(index);
+  return t != NULL && strcmp(t->file, baseName(file)) == 0;
+}
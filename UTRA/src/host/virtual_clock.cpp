@@ -0,0 +1,102 @@
+/**
+ * Discrete-event virtual clock - see virtual_clock.h
+ */
+
+#include <queue>
+#include <unordered_set>
+#include <vector>
+#include "virtual_clock.h"
+
+typedef struct {
+  uint64_t atUs;
+  uint64_t seq;      // keeps same-time events in scheduling order
+  int id;
+  VClockCallback cb;
+  void *ctx;
+} VClockEvent;
+
+struct LaterFirst {
+  bool operator()(const VClockEvent &a, const VClockEvent &b) const {
+    return a.atUs != b.atUs ? a.atUs > b.atUs : a.seq > b.seq;
+  }
+};
+
+static std::priority_queue<VClockEvent, std::vector<VClockEvent>, LaterFirst> events;
+static std::unordered_set<int> pending;     // scheduled, not yet fired or dropped
+static std::unordered_set<int> cancelled;   // pending ids to drop when they reach the top
+static uint64_t nowUs = 0;
+static uint64_t nextSeq = 0;
+static int nextId = 1;
+
+void vclockReset() {
+  events = decltype(events)();
+  pending.clear();
+  cancelled.clear();
+  nowUs = 0;
+  nextSeq = 0;
+  nextId = 1;
+}
+
+uint64_t vclockNowUs() {
+  return nowUs;
+}
+
+int vclockSchedule(uint64_t atUs, VClockCallback cb, void *ctx) {
+  VClockEvent e = { atUs, nextSeq++, nextId++, cb, ctx };
+  events.push(e);
+  pending.insert(e.id);
+  return e.id;
+}
+
+// An id that already fired (or was never issued) has nothing to drop; keeping
+// it would grow the set for the rest of the run.
+void vclockCancel(int id) {
+  if (pending.count(id)) cancelled.insert(id);
+}
+
+static void dropCancelled() {
+  while (!events.empty() && cancelled.count(events.top().id)) {
+    cancelled.erase(events.top().id);
+    pending.erase(events.top().id);
+    events.pop();
+  }
+}
+
+bool vclockNextEventUs(uint64_t *atUs) {
+  dropCancelled();
+  if (events.empty()) return false;
+  *atUs = events.top().atUs;
+  return true;
+}
+
+static void fireNext() {
+  VClockEvent e = events.top();
+  events.pop();
+  pending.erase(e.id);
+  if (e.atUs > nowUs) nowUs = e.atUs;
+  e.cb(e.ctx, nowUs);
+}
+
+void vclockAdvanceTo(uint64_t targetUs) {
+  uint64_t at;
+  while (vclockNextEventUs(&at) && at <= targetUs) {
+    fireNext();
+  }
+  if (targetUs > nowUs) nowUs = targetUs;
+}
+
+void vclockAdvanceBy(uint64_t us) {
+  vclockAdvanceTo(nowUs + us);
+}
+
+bool vclockWaitUntil(VClockPredicate pred, void *ctx, uint64_t deadlineUs) {
+  uint64_t at;
+  while (!pred(ctx)) {
+    if (!vclockNextEventUs(&at) || at > deadlineUs) {
+      if (deadlineUs > nowUs) nowUs = deadlineUs;
+      return pred(ctx);
+    }
+    fireNext();
+  }
+  return true;
+}
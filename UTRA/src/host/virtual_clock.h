@@ -0,0 +1,36 @@
+/**
+ * Discrete-event virtual clock for host builds.
+ * millis()/micros()/delay()/pulseIn() all run on this clock instead of wall
+ * time: delays jump straight to their deadline, firing any events scheduled
+ * in between, so a two-minute course run costs only the CPU time of the
+ * firmware logic itself.
+ *
+ * Sensor models schedule callbacks (typically input-pin edges) with
+ * vclockSchedule(); the HAL waits on those edges in pulseIn().
+ */
+
+#ifndef UTRA_VIRTUAL_CLOCK_H
+#define UTRA_VIRTUAL_CLOCK_H
+
+#include <stdint.h>
+
+typedef void (*VClockCallback)(void *ctx, uint64_t nowUs);
+typedef bool (*VClockPredicate)(void *ctx);
+
+void vclockReset();
+uint64_t vclockNowUs();
+
+// Returns an id for vclockCancel(). Events in the past fire on the next advance.
+int vclockSchedule(uint64_t atUs, VClockCallback cb, void *ctx);
+void vclockCancel(int id);
+bool vclockNextEventUs(uint64_t *atUs);
+
+// Fires every event up to targetUs in time order, then sets now = targetUs.
+void vclockAdvanceTo(uint64_t targetUs);
+void vclockAdvanceBy(uint64_t us);
+
+// Advances event by event until pred() holds or deadlineUs is reached.
+// Returns whether pred() held; now is the time it became true (or the deadline).
+bool vclockWaitUntil(VClockPredicate pred, void *ctx, uint64_t deadlineUs);
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Work-stealing thread pool - see work_pool.h
+ */
+
+#include "work_pool.h"
+
+WorkPool::WorkPool(int threads) {
+  if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+  if (threads <= 0) threads = 1;
+  for (int i = 0; i < threads; i++) queues_.push_back(new Queue);
+  for (int i = 0; i < threads; i++) workers_.push_back(std::thread(&WorkPool::run, this, i));
+}
+
+WorkPool::~WorkPool() {
+  {
+    std::lock_guard<std::mutex> guard(stateLock_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (size_t i = 0; i < workers_.size(); i++) workers_[i].join();
+  for (size_t i = 0; i < queues_.size(); i++) delete queues_[i];
+}
+
+void WorkPool::submit(std::function<void()> task) {
+  int target;
+  {
+    std::lock_guard<std::mutex> guard(stateLock_);
+    pending_++;
+    target = nextQueue_;
+    nextQueue_ = (nextQueue_ + 1) % (int)queues_.size();
+  }
+  {
+    std::lock_guard<std::mutex> guard(queues_[target]->lock);
+    queues_[target]->tasks.push_back(task);
+  }
+  wake_.notify_one();
+}
+
+void WorkPool::wait() {
+  std::unique_lock<std::mutex> guard(stateLock_);
+  idle_.wait(guard, [this] { return pending_ == 0; });
+}
+
+bool WorkPool::take(int self, std::function<void()> *task) {
+  {
+    Queue *own = queues_[self];
+    std::lock_guard<std::mutex> guard(own->lock);
+    if (!own->tasks.empty()) {
+      *task = own->tasks.back();
+      own->tasks.pop_back();
+      return true;
+    }
+  }
+  int n = (int)queues_.size();
+  for (int i = 1; i < n; i++) {
+    Queue *victim = queues_[(self + i) % n];
+    std::lock_guard<std::mutex> guard(victim->lock);
+    if (!victim->tasks.empty()) {
+      *task = victim->tasks.front();
+      victim->tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkPool::run(int self) {
+  std::function<void()> task;
+  while (true) {
+    if (take(self, &task)) {
+      task();
+      std::lock_guard<std::mutex> guard(stateLock_);
+      if (--pending_ == 0) idle_.notify_all();
+      continue;
+    }
+    std::unique_lock<std::mutex> guard(stateLock_);
+    if (stopping_) return;
+    // A submit that lands between take() and here notifies before we
+    // wait; the timeout bounds how long such a task sits unclaimed.
+    wake_.wait_for(guard, std::chrono::milliseconds(5));
+  }
+}
@@ -0,0 +1,47 @@
+/**
+ * Work-stealing thread pool for host batch tools.
+ * Every worker owns a deque: it takes its own newest task first and, when
+ * empty, steals the oldest task from another worker. Submitted tasks are
+ * dealt round-robin, so uneven run times (a timeout costs far more than a
+ * quick finish) even out through stealing instead of a shared queue lock.
+ */
+
+#ifndef UTRA_HOST_WORK_POOL_H
+#define UTRA_HOST_WORK_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkPool {
+ public:
+  explicit WorkPool(int threads);  // threads <= 0: one per core
+  ~WorkPool();
+
+  void submit(std::function<void()> task);
+  void wait();                      // until every submitted task has run
+  int threads() const { return (int)workers_.size(); }
+
+ private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  bool take(int self, std::function<void()> *task);
+  void run(int self);
+
+  std::vector<Queue *> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex stateLock_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  int pending_ = 0;                 // submitted but not finished
+  int nextQueue_ = 0;
+  bool stopping_ = false;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * Reflectance array line position - see line_array.h
+ */
+
+#include <Arduino.h>
+#include "line_array.h"
+
+const uint16_t COVER_FULL_Q8 = 256;
+const uint16_t COVER_NOISE_Q8 = 32;    // below this a channel is reading floor
+const uint16_t SEEN_WIDTH_Q8 = 64;     // a quarter channel of line counts as a line
+
+void lineArrayBegin(LineArray *a, const uint8_t *pins, uint8_t count, uint16_t floorRaw,
+                    uint16_t lineRaw) {
+  a->pins = pins;
+  a->count = min(count, LINE_ARRAY_MAX);
+  a->floorRaw = floorRaw;
+  a->lineRaw = max(lineRaw, (uint16_t)(floorRaw + 1));
+  a->lastPosition = 0;
+}
+
+void lineArrayScan(const LineArray *a, uint16_t raw[]) {
+  for (uint8_t i = 0; i < a->count; i++) raw[i] = (uint16_t)analogRead(a->pins[i]);
+}
+
+void lineArrayEstimate(LineArray *a, const uint16_t raw[], LineReading *out) {
+  uint16_t span = a->lineRaw - a->floorRaw;
+  uint16_t sum = 0;
+  int32_t moment = 0;   // coverage x half pitches from the centre
+  for (uint8_t i = 0; i < a->count; i++) {
+    if (raw[i] <= a->floorRaw) continue;
+    uint32_t cover = ((uint32_t)(raw[i] - a->floorRaw) << 8) / span;
+    if (cover > COVER_FULL_Q8) cover = COVER_FULL_Q8;
+    if (cover < COVER_NOISE_Q8) continue;
+    sum += cover;
+    moment += (int32_t)cover * (2 * i - (a->count - 1));
+  }
+
+  if (sum < SEEN_WIDTH_Q8) {
+    int16_t edge = (int16_t)((a->count - 1) * LINE_PITCH_Q8 / 2);
+    out->width = 0;
+    out->position = a->lastPosition < 0 ? -edge : (a->lastPosition > 0 ? edge : 0);
+    return;
+  }
+  out->width = sum;
+  out->position = (int16_t)(moment * (LINE_PITCH_Q8 / 2) / sum);
+  a->lastPosition = out->position;
+}
+
+void lineArrayRead(LineArray *a, LineReading *out) {
+  uint16_t raw[LINE_ARRAY_MAX];
+  lineArrayScan(a, raw);
+  lineArrayEstimate(a, raw, out);
+}
@@ -1,5 +1,23 @@
 #include <Arduino.h>
+#include "battery.h"
+#include "bench.h"
+#include "flight_recorder.h"
+#include "profiler.h"
+#include "serial_command.h"
+#include "telemetry.h"
 
+#if defined(UTRA_BENCH) && defined(ARDUINO_ARCH_AVR)
+// [env:uno_bench]: report kernel cycle counts instead of running. The bench
+// build's source filter leaves out part two, the recorder and the command
+// parser, so nothing below may reach them.
+void setup() {
+  Serial.begin(115200);
+  benchPrintJson();
+}
+
+void loop() {}
+
+#else
 void initChallengeOne();
 void challengeOne();
 bool isChallengeOneComplete();
@@ -9,20 +27,28 @@ void challengeTwo();
 bool runningPartTwo = false;
 
 void setup() {
-  Serial.begin(9600);
-  Serial.println("UTRA: Challenge One starting...");
+  // Binary telemetry only (telemetry.h); the state records mark where
+  // challenge one and part two start.
+  telemetryBegin();
+  flightRecorderBegin();
+  PROFILER_BEGIN();
   initChallengeOne();
 }
 
 void loop() {
+  PROFILE_LOOP_TICK();
+  telemetryPump();
+  serialCommandPoll();
+  flightRecorderTick();
+  if (batteryUpdate()) telemetrySendBattery(batteryMillivolts(), millis());
   if (!runningPartTwo) {
     challengeOne();
     if (isChallengeOneComplete()) {
       runningPartTwo = true;
-      Serial.println("UTRA: Challenge One Part Two starting...");
       initChallengeTwo();
     }
   } else {
     challengeTwo();
   }
 }
+#endif
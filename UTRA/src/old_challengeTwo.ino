@@ -1,5 +1,15 @@
 // servo
 #include <Servo.h>
+#include "battery.h"
+#include "colour_classifier.h"
+#include "telemetry.h"
+#include "flight_recorder.h"
+#include "pipeline.h"
+#include "serial_command.h"
+#include "profiler.h"
+#include "stall_detector.h"
+#include "state_stats.h"
+#include "tunable.h"
 Servo servo;
 const int SERVOPIN = A3;
 
@@ -8,22 +18,28 @@ const int TRIGPIN = A4;
 const int ECHOPIN = A5;
 long duration;
 
-// dc motor
-const int ENA = 8;   // Enable pin for left motor
-const int ENB = 13;  // Enable pin for right motor
+// pack voltage through the divider (-DUTRA_BATTERY)
+const int BATTERY_PIN = A0;
+
+// dc motor: the enables need timer outputs for the approach slowdown, and
+// Servo takes Timer1 (PWM on 9 and 10), so they sit on Timer2's 11 and 3
+const int ENA = 11;  // Enable pin for left motor (PWM)
+const int ENB = 3;   // Enable pin for right motor (PWM)
 const int IN1 = 9;   // Left motor
 const int IN2 = 10;
-const int IN3 = 11;  // Right motor
+const int IN3 = 8;   // Right motor
 const int IN4 = 12;
 
 // colour sensor
 const int S0 = 2;
-const int S1 = 3;
+const int S1 = 7;
 const int S2 = 4;
 const int S3 = 5;
 const int S_OUT = 6;
-const int blackThreshold = 100;
-const int whiteThreshold = 40;
+TUNABLE(int, blackThreshold, 100, 60, 200);
+TUNABLE(int, whiteThreshold, 40, 10, 80);
+static ColourTracker colourTracker;   // UTRA_COLOUR_ADAPTIVE
+static ColourReading colourReading;   // from the last getColour()
 int redPW = 0;
 int greenPW = 0;
 int bluePW = 0;
@@ -54,36 +70,109 @@ typedef enum {
   TURN_RIGHT_DIR = 1
 } TurnDir;
 
-const int DISTANCE_THRESHOLD_CM = 20;
+TUNABLE(int, DISTANCE_THRESHOLD_CM, 20, 10, 40);
+TUNABLE(int, CRUISE_PWM, 255, 80, 255);   // the timed manoeuvres were tuned with the enables fully on
+TUNABLE(int, APPROACH_MIN_PWM, 70, 40, 160);
+TUNABLE(int, SLOWDOWN_START_CM, 60, 30, 120);
+TUNABLE(int, MIN_TRANSITION_CONFIDENCE, 64, 0, 255);  // colourReading.confidence to change state
+TUNABLE(int, PIVOT_CONFIDENCE, 128, 0, 255);          // less sure of white: arc, don't pivot
+const unsigned long APPROACH_REACTION_MS = 300;
+const int NO_ECHO_CM = 9999;  // fits a 16-bit AVR int
+
+// ultrasonic sweep: servo at SERVO_CENTER_DEG faces straight ahead,
+// larger angles look left
+const int SERVO_CENTER_DEG = 90;
+const int SWEEP_MIN_DEG = 30;
+const int SWEEP_STEP_DEG = 15;
+const int SWEEP_SECTORS = 9;          // 30..150 deg
+const int SWEEP_CENTER_SECTOR = (SERVO_CENTER_DEG - SWEEP_MIN_DEG) / SWEEP_STEP_DEG;
+const int FORWARD_CONE_SECTORS = 1;   // sectors either side of centre treated as "ahead"
+const int RANGE_BIN_CM = 10;
+const int RANGE_BINS = 8;             // grid covers 0..80 cm
+const int OCC_HIT = 3;
+const int OCC_MISS = 1;
+const int OCC_LIMIT = 12;
+const int EDGE_MARGIN_CM = 15;
+const int ROBOT_HALF_WIDTH_CM = 9;
+const int BYPASS_MARGIN_CM = 5;
+const int CRUISE_CM_PER_S = 25;       // measured at CRUISE_PWM
+const unsigned long BYPASS_MIN_MS = 250;
+const unsigned long BYPASS_MAX_MS = 1400;
 const int OBSTACLE_DEBOUNCE_HITS = 3;
 const int WHITE_STREAK_HITS = 6;
-const unsigned long TURN_LEFT_MS = 450;
-const unsigned long TURN_RIGHT_MS = 450;
+const unsigned long WHITE_STREAK_MS = 400;   // a pivot out of the last turn, motor lag included
+TUNABLE(unsigned long, TURN_LEFT_MS, 450, 200, 900);
+TUNABLE(unsigned long, TURN_RIGHT_MS, 450, 200, 900);
 const unsigned long FORWARD1_MS = 700;
 const unsigned long FORWARD2_MS = 700;
-const unsigned long FORWARD3_MS = 900;
-const unsigned long ALIGN_LEFT_MS = 350;
-const unsigned long INTERSECTION_RIGHT_MS = 450;
+TUNABLE(unsigned long, FORWARD3_MS, 900, 300, 1500);
+TUNABLE(unsigned long, ALIGN_LEFT_MS, 350, 100, 800);
+TUNABLE(unsigned long, INTERSECTION_RIGHT_MS, 450, 200, 900);
 const unsigned long COLOR_PULSE_TIMEOUT_US = 10000;
 const unsigned long ECHO_PULSE_TIMEOUT_US = 30000;
 
+// stall recovery when driving forward (-DUTRA_STALL)
+#ifdef UTRA_STALL
+TUNABLE(unsigned long, DRIVE_STALL_WINDOW_MS, 1500, 300, 5000);
+TUNABLE(unsigned long, DRIVE_STALL_BACKOFF_MS, 300, 100, 1000);
+TUNABLE(unsigned long, DRIVE_STALL_PUSH_MS, 250, 0, 1000);  // full-enable run-up per retry
+TUNABLE(int, DRIVE_STALL_MAX_RETRIES, 3, 0, 10);
+StallDetector driveStall;
+unsigned long stallPushEndMs = 0;
+bool stallPushing = false;
+#endif
+
 RobotState robotState = STATE_FOLLOW_RED;
+StateTime robotStateTimes[STATE_END + 1];
+StateStats robotStateStats;
 TurnDir lastTurnDir = TURN_LEFT_DIR;
 unsigned long stateStartMs = 0;
 int obstacleHitCount = 0;
 int whiteStreakCount = 0;
+unsigned long whiteStreakStartMs = 0;
+int lastRangeCm = NO_ECHO_CM;
+unsigned long lastRangeMs = 0;
+long closingSpeedCmS = 0;
+
+// polar occupancy grid around the robot, refreshed every sweep
+int8_t occupancy[SWEEP_SECTORS][RANGE_BINS];
+int sweepRangeCm[SWEEP_SECTORS];
+int sweepSector = SWEEP_CENTER_SECTOR;
+int freshAheadCm = -1;                // this reading, if taken inside the forward cone
+int sweepStep = 1;
+TurnDir bypassDir = TURN_LEFT_DIR;
+unsigned long bypassLateralMs = FORWARD1_MS;
+unsigned long bypassPassMs = FORWARD2_MS;
 
 void setRobotState(RobotState state);
 void followRed(PathColour color);
 bool isObstacleDetected(int cm);
 bool isRed(PathColour color);
 PathColour getColour();
+PathColour classifyColour();
 int getRedPW();
+int getGreenPW();
+int getBluePW();
 void moveForward();
+void moveBackward();
 void moveLeft();
 void moveRight();
+void arcLeft();
+void arcRight();
+bool isConfident();
 void stopMotors();
-int getDistance();
+void writeEnable(int pin, int pwm);
+void setDriveSpeed(int pwm);
+int approachSpeedLimit(int cm, unsigned long ageMs = 0);
+int getDistance(unsigned long timeoutUs = ECHO_PULSE_TIMEOUT_US);
+void resetSweep();
+int updateSweep(int cm);
+void planBypass(int obstacleCm);
+void turnAway();
+void turnBack();
+void updateState(PathColour color, int cm, unsigned long rangeAgeMs, bool colourFresh, bool rangeFresh);
+bool driveStalled(PathColour color, int cm, bool colourFresh, bool rangeFresh);
+void selectFilter(uint8_t filter);   // UTRA_PIPELINE
 
 void setRobotState(RobotState state) {
   robotState = state;
@@ -93,9 +182,19 @@ void setRobotState(RobotState state) {
   }
   if (state != STATE_FOLLOW_RED) {
     whiteStreakCount = 0;
+    // Manoeuvres are timed at cruise speed, so never run them throttled.
+    setDriveSpeed(CRUISE_PWM);
+  }
+#ifdef UTRA_STALL
+  stallBegin(&driveStall, stateStartMs, DRIVE_STALL_WINDOW_MS, DRIVE_STALL_BACKOFF_MS,
+             DRIVE_STALL_MAX_RETRIES);
+  stallPushing = false;
+#endif
+  telemetrySendState(STATE_MACHINE_OBSTACLE, state, stateStartMs);
+  stateStatsEnter(&robotStateStats, state, stateStartMs);
+  if (state == STATE_END) {
+    stateStatsFinish(&robotStateStats, stateStartMs);
   }
-  Serial.print("State: ");
-  Serial.println(state);
 }
 
 bool isObstacleDetected(int cm) {
@@ -107,19 +206,189 @@ bool isObstacleDetected(int cm) {
   return obstacleHitCount >= OBSTACLE_DEBOUNCE_HITS;
 }
 
+// Speed limit that ramps down with range and closing speed so the robot
+// reaches DISTANCE_THRESHOLD_CM already slow instead of stopping there.
+// ageMs is how long ago the range was measured.
+int approachSpeedLimit(int cm, unsigned long ageMs /* = 0 */) {
+  unsigned long now = millis() - ageMs;
+  bool valid = cm > 0 && cm < NO_ECHO_CM;
+
+  if (valid && lastRangeCm < NO_ECHO_CM && now > lastRangeMs) {
+    long rate = (long)(lastRangeCm - cm) * 1000L / (long)(now - lastRangeMs);
+    closingSpeedCmS = (closingSpeedCmS * 3 + rate) / 4;  // light smoothing
+  } else if (!valid) {
+    closingSpeedCmS = 0;
+  }
+  lastRangeCm = valid ? cm : NO_ECHO_CM;
+  lastRangeMs = now;
+
+  if (!valid) {
+    return CRUISE_PWM;
+  }
+
+  // Where we will be after one reaction time at the current closing speed,
+  // counted from when the range was measured.
+  long projectedCm = cm;
+  if (closingSpeedCmS > 0) {
+    projectedCm -= closingSpeedCmS * (long)(APPROACH_REACTION_MS + ageMs) / 1000L;
+  }
+
+  if (projectedCm >= SLOWDOWN_START_CM) {
+    return CRUISE_PWM;
+  }
+  if (projectedCm <= DISTANCE_THRESHOLD_CM) {
+    return APPROACH_MIN_PWM;
+  }
+  return APPROACH_MIN_PWM +
+         (int)((projectedCm - DISTANCE_THRESHOLD_CM) * (CRUISE_PWM - APPROACH_MIN_PWM) /
+               (SLOWDOWN_START_CM - DISTANCE_THRESHOLD_CM));
+}
+
+void resetSweep() {
+  for (int s = 0; s < SWEEP_SECTORS; s++) {
+    sweepRangeCm[s] = NO_ECHO_CM;
+    for (int b = 0; b < RANGE_BINS; b++) {
+      occupancy[s][b] = 0;
+    }
+  }
+  sweepSector = SWEEP_CENTER_SECTOR;
+  sweepStep = 1;
+  servo.write(SERVO_CENTER_DEG);
+}
+
+// Records the reading taken at the current servo angle, then steps the servo
+// so it settles while the colour sensor is read next loop. Returns the
+// nearest range seen ahead during the current sweep.
+int updateSweep(int cm) {
+  sweepRangeCm[sweepSector] = cm;
+  bool inCone = abs(sweepSector - SWEEP_CENTER_SECTOR) <= FORWARD_CONE_SECTORS;
+  freshAheadCm = inCone ? cm : -1;
+
+  int hitBin = (cm > 0 && cm < NO_ECHO_CM) ? cm / RANGE_BIN_CM : RANGE_BINS;
+  for (int b = 0; b < RANGE_BINS; b++) {
+    int8_t &cell = occupancy[sweepSector][b];
+    if (b < hitBin) {
+      cell = max(cell - OCC_MISS, -OCC_LIMIT);
+    } else if (b == hitBin) {
+      cell = min(cell + OCC_HIT, OCC_LIMIT);
+    }
+  }
+
+  sweepSector += sweepStep;
+  if (sweepSector <= 0 || sweepSector >= SWEEP_SECTORS - 1) {
+    sweepStep = -sweepStep;
+  }
+  servo.write(SWEEP_MIN_DEG + sweepSector * SWEEP_STEP_DEG);
+
+  int ahead = NO_ECHO_CM;
+  for (int s = SWEEP_CENTER_SECTOR - FORWARD_CONE_SECTORS;
+       s <= SWEEP_CENTER_SECTOR + FORWARD_CONE_SECTORS; s++) {
+    if (sweepRangeCm[s] > 0) {
+      ahead = min(ahead, sweepRangeCm[s]);
+    }
+  }
+  return ahead;
+}
+
+// Nearest occupied cell in a sector, or NO_ECHO_CM if the sector looks clear.
+int sectorClearanceCm(int sector) {
+  for (int b = 0; b < RANGE_BINS; b++) {
+    if (occupancy[sector][b] > 0) {
+      return b * RANGE_BIN_CM;
+    }
+  }
+  return NO_ECHO_CM;
+}
+
+// Picks the side whose obstacle edge is closest to straight ahead and sizes
+// the sideways leg so the robot just clears that edge.
+void planBypass(int obstacleCm) {
+  int leftEdge = -1;
+  int rightEdge = -1;
+  for (int off = 1; off <= SWEEP_CENTER_SECTOR; off++) {
+    if (leftEdge < 0 && SWEEP_CENTER_SECTOR + off < SWEEP_SECTORS &&
+        sectorClearanceCm(SWEEP_CENTER_SECTOR + off) > obstacleCm + EDGE_MARGIN_CM) {
+      leftEdge = off;
+    }
+    if (rightEdge < 0 && SWEEP_CENTER_SECTOR - off >= 0 &&
+        sectorClearanceCm(SWEEP_CENTER_SECTOR - off) > obstacleCm + EDGE_MARGIN_CM) {
+      rightEdge = off;
+    }
+  }
+
+  if (leftEdge < 0 && rightEdge < 0) {
+    // wall-like obstacle: fall back to the fixed manoeuvre
+    bypassDir = TURN_LEFT_DIR;
+    bypassLateralMs = FORWARD1_MS;
+    bypassPassMs = FORWARD2_MS;
+    return;
+  }
+
+  int edge;
+  if (rightEdge < 0 || (leftEdge > 0 && leftEdge <= rightEdge)) {
+    bypassDir = TURN_LEFT_DIR;
+    edge = leftEdge;
+  } else {
+    bypassDir = TURN_RIGHT_DIR;
+    edge = rightEdge;
+  }
+
+  // obstacle half-width on the chosen side from the last blocked ray
+  float blockedRad = (edge - 1) * SWEEP_STEP_DEG * (PI / 180.0f);
+  float lateralCm = obstacleCm * tan(blockedRad + SWEEP_STEP_DEG * (PI / 360.0f)) +
+                    ROBOT_HALF_WIDTH_CM + BYPASS_MARGIN_CM;
+  unsigned long ms = (unsigned long)(lateralCm * 1000.0f / CRUISE_CM_PER_S);
+  bypassLateralMs = constrain(ms, BYPASS_MIN_MS, BYPASS_MAX_MS);
+
+  // The sweep cannot see how deep the obstacle is, so take it as deep as it
+  // is wide and drive the range, that depth and the robot's length past it.
+  float halfCm = lateralCm - ROBOT_HALF_WIDTH_CM - BYPASS_MARGIN_CM;
+  float passCm = obstacleCm + 2.0f * halfCm + 2.0f * ROBOT_HALF_WIDTH_CM + BYPASS_MARGIN_CM;
+  ms = (unsigned long)(passCm * 1000.0f / CRUISE_CM_PER_S);
+  bypassPassMs = constrain(ms, FORWARD2_MS, BYPASS_MAX_MS * 2);
+}
+
+// Turn towards the planned bypass side (AVOID_LEFT, ALIGN_LEFT) or back
+// towards the line (AVOID_RIGHT1/2); the state names assume a left bypass.
+void turnAway() {
+  if (bypassDir == TURN_LEFT_DIR) {
+    moveLeft();
+  } else {
+    moveRight();
+  }
+}
+
+void turnBack() {
+  if (bypassDir == TURN_LEFT_DIR) {
+    moveRight();
+  } else {
+    moveLeft();
+  }
+}
+
+// The last getColour() was far enough from a class boundary to act on.
+bool isConfident() {
+  return colourReading.confidence >= MIN_TRANSITION_CONFIDENCE;
+}
+
 bool isRed(PathColour color) {
-  return color == PATH_RED;
+  return color == PATH_RED && isConfident();
 }
 
+// ENA/ENB carry the approach limit for both wheels, so the steering is
+// graded by the kind of turn: a white reading that is still close to red means the
+// sensor has only just left the edge, and stopping one wheel brings it back
+// without the overshoot of a pivot.
 void followRed(PathColour color) {
   if (color == PATH_RED) {
     moveForward();
   } else if (color == PATH_WHITE) {
+    bool pivot = colourReading.confidence >= PIVOT_CONFIDENCE;
     if (lastTurnDir == TURN_LEFT_DIR) {
-      moveLeft();
+      if (pivot) moveLeft(); else arcLeft();
       lastTurnDir = TURN_LEFT_DIR;
     } else {
-      moveRight();
+      if (pivot) moveRight(); else arcRight();
       lastTurnDir = TURN_RIGHT_DIR;
     }
   } else {
@@ -131,42 +400,31 @@ void followRed(PathColour color) {
 // white threshold: red pulse under 40
 PathColour getColour()
 {
+  PROFILE_SCOPE("colour");
   redPW = getRedPW();
   greenPW = getGreenPW();
   bluePW = getBluePW();
-  
-  Serial.print("R:");
-  Serial.print(redPW);
-  Serial.print(" G:");
-  Serial.print(greenPW);
-  Serial.print(" B:");
-  Serial.print(bluePW);
-  Serial.print(" -> ");
+  return classifyColour();
+}
 
+// Classifies redPW/greenPW/bluePW into colourReading.
+PathColour classifyColour()
+{
   // timeout returns 0, treat as previous color or red
   if (redPW == 0 && greenPW == 0 && bluePW == 0) {
+    colourReading.colour = PATH_RED;
+    colourReading.confidence = 0;
     return PATH_RED;
   }
 
-  // All high = black
-  if (redPW > blackThreshold && greenPW > blackThreshold && bluePW > blackThreshold) {
-    return PATH_BLACK;
-  }
-
-  // All low = white
-  if (redPW < whiteThreshold && greenPW < whiteThreshold && bluePW < whiteThreshold) {
-    return PATH_WHITE;
-  }
-
-  // Find dominant color (lowest PW value = strongest reflection)
-  int minPW = min(redPW, min(greenPW, bluePW));
-  if (minPW == redPW) {
-    return PATH_RED;
-  } else if (minPW == greenPW) {
-    return PATH_GREEN;
-  } else {
-    return PATH_BLUE;
-  }
+#ifdef UTRA_COLOUR_MODEL
+  colourReadModel(&COLOUR_MODEL, redPW, greenPW, bluePW, &colourReading);
+#elif defined(UTRA_COLOUR_ADAPTIVE)
+  colourReadAdaptive(&colourTracker, redPW, greenPW, bluePW, &colourReading);
+#else
+  colourReadThresholds(redPW, greenPW, bluePW, whiteThreshold, blackThreshold, &colourReading);
+#endif
+  return (PathColour)colourReading.colour;
 }
 
 int getRedPW() {
@@ -200,6 +458,13 @@ void moveForward() {
   digitalWrite(IN4, HIGH);
 }
 
+void moveBackward() {
+  digitalWrite(IN1, HIGH);
+  digitalWrite(IN2, LOW);
+  digitalWrite(IN3, HIGH);
+  digitalWrite(IN4, LOW);
+}
+
 void moveLeft() {
   digitalWrite(IN3, LOW);
   digitalWrite(IN4, HIGH);
@@ -214,6 +479,38 @@ void moveRight() {
   digitalWrite(IN4, LOW);
 }
 
+void arcLeft() {
+  digitalWrite(IN1, LOW);
+  digitalWrite(IN2, LOW);
+  digitalWrite(IN3, LOW);
+  digitalWrite(IN4, HIGH);
+}
+
+void arcRight() {
+  digitalWrite(IN1, LOW);
+  digitalWrite(IN2, HIGH);
+  digitalWrite(IN3, LOW);
+  digitalWrite(IN4, LOW);
+}
+
+// On a pin with no timer output analogWrite() below 128 writes LOW, which
+// would stop the motors during the approach. If the enables are ever wired
+// to such pins, hold them fully on instead; the slowdown then has no effect
+// and FOLLOW_RED stops and settles before the avoidance turn.
+void writeEnable(int pin, int pwm) {
+  if (digitalPinHasPWM(pin)) {
+    analogWrite(pin, pwm);
+  } else {
+    digitalWrite(pin, pwm > 0 ? HIGH : LOW);
+  }
+}
+
+void setDriveSpeed(int pwm) {
+  pwm = constrain(pwm, 0, 255);
+  writeEnable(ENA, pwm);
+  writeEnable(ENB, pwm);
+}
+
 void stopMotors() {
   digitalWrite(IN1, LOW);
   digitalWrite(IN2, LOW);
@@ -221,22 +518,24 @@ void stopMotors() {
   digitalWrite(IN4, LOW);
 }
 
-int getDistance() {
+int getDistance(unsigned long timeoutUs /* = ECHO_PULSE_TIMEOUT_US */) {
+  PROFILE_SCOPE("range");
   digitalWrite(TRIGPIN, LOW);
   delayMicroseconds(2);
   digitalWrite(TRIGPIN, HIGH);
   delayMicroseconds(10);
   digitalWrite(TRIGPIN, LOW);
   
-  duration = pulseIn(ECHOPIN, HIGH, ECHO_PULSE_TIMEOUT_US);
-  if (duration == 0) return 99999;
-  return duration * 340 / 200;
+  duration = pulseIn(ECHOPIN, HIGH, timeoutUs);
+  if (duration == 0) return NO_ECHO_CM;
+  // 340 m/s = 0.034 cm/us, halved for the round trip
+  return duration * 34 / 2000;
 }
 
 void setup()
 {
   servo.attach(SERVOPIN);
-  servo.write(0);
+  resetSweep();
 
   // ultrasonic sensor
   pinMode(TRIGPIN, OUTPUT);
@@ -249,8 +548,7 @@ void setup()
   pinMode(IN4, OUTPUT);
   pinMode(ENA, OUTPUT);
   pinMode(ENB, OUTPUT);
-  analogWrite(ENA, 128);  // Half power left motor
-  analogWrite(ENB, 128);  // Half power right motor
+  setDriveSpeed(CRUISE_PWM);  // Half power both motors
   
   // colour sensor
   pinMode(S0, OUTPUT);
@@ -261,49 +559,232 @@ void setup()
   // set PW scaling to 20%
   digitalWrite(S0, HIGH);
   digitalWrite(S1, LOW);
+  colourTrackerBegin(&colourTracker, whiteThreshold, blackThreshold);
+#ifdef UTRA_BATTERY
+  batteryBegin(BATTERY_PIN);
+#endif
 
   // set sensor output as input
   pinMode(S_OUT, INPUT);
-
-  Serial.begin(9600);
+#ifdef UTRA_PIPELINE
+  selectFilter(0);
+#endif
+
+  telemetryBegin();
+  flightRecorderBegin();
+  PROFILER_BEGIN();
+  stateStatsBegin(&robotStateStats, STATE_MACHINE_OBSTACLE, robotStateTimes,
+                  STATE_END + 1, STATE_FOLLOW_RED, millis());
   setRobotState(STATE_FOLLOW_RED);
 }
 
+// ========== Multi-rate pipeline (-DUTRA_PIPELINE) ==========
+// Without it, every loop reads all three colour filters (10 ms settle each)
+// and then the ultrasonic, and the state machine runs once per slowest read.
+// With it, the colour sampler steps through the filters without waiting on
+// the settle, ranging runs at its own rate inside the settle that follows a
+// filter change, and control runs at CONTROL_PERIOD_US on the freshest
+// sample of each (pipeline.h).
+#ifdef UTRA_PIPELINE
+typedef struct {
+  uint16_t red, green, blue;
+} ColourSample;
+
+const unsigned long COLOUR_SETTLE_US = 3000;         // per filter, three per sample: ~100 Hz
+const unsigned long RANGE_PERIOD_US = 50000;         // 20 Hz, outlasts a no-target echo (38 ms)
+const unsigned long CONTROL_PERIOD_US = 5000;        // 200 Hz
+const unsigned long PIPELINE_ECHO_TIMEOUT_US = 6000; // ~100 cm, past the sweep grid
+const unsigned long COLOUR_STALE_MS = 50;            // stop rather than steer on an old colour
+
+SampleSlot<ColourSample> colourSlot;
+SampleSlot<int> rangeSlot;
+RateTask rangeTask = { RANGE_PERIOD_US, 0 };
+RateTask controlTask = { CONTROL_PERIOD_US, 0 };
+uint8_t colourFilter = 0;      // 0 red, 1 green, 2 blue
+unsigned long filterSetUs = 0;
+ColourSample colourPartial;
+uint8_t colourSeq = 0;         // last sample control used, per slot
+uint8_t rangeSeq = 0;
+PathColour pipelineColour = PATH_RED;
+int pipelineRawCm = NO_ECHO_CM;
+int pipelineCm = NO_ECHO_CM;
+
+void selectFilter(uint8_t filter) {
+  colourFilter = filter;
+  digitalWrite(S2, filter == 1 ? HIGH : LOW);
+  digitalWrite(S3, filter == 0 ? LOW : HIGH);
+  filterSetUs = micros();
+}
+
+void sampleRange() {
+  int cm = getDistance(PIPELINE_ECHO_TIMEOUT_US);
+  slotPublish(&rangeSlot, cm, micros());
+}
+
+// One filter per call, once it has settled; a no-op until then.
+void sampleColour() {
+  if (micros() - filterSetUs < COLOUR_SETTLE_US) return;
+  uint16_t pw;
+  {
+    PROFILE_SCOPE("colour");
+    pw = pulseIn(S_OUT, LOW, COLOR_PULSE_TIMEOUT_US);
+  }
+  if (colourFilter == 0) colourPartial.red = pw;
+  else if (colourFilter == 1) colourPartial.green = pw;
+  else colourPartial.blue = pw;
+  if (colourFilter == 2) slotPublish(&colourSlot, colourPartial, micros());
+  selectFilter((colourFilter + 1) % 3);
+  // The echo wait overlaps the settle that has just started.
+  if (rateDue(&rangeTask, micros())) sampleRange();
+}
+
+void controlStep() {
+  ColourSample colour;
+  uint32_t colourUs;
+  uint8_t seq = slotRead(&colourSlot, &colour, &colourUs);
+  if (seq == 0) return;   // no colour yet
+  bool colourFresh = seq != colourSeq;
+  colourSeq = seq;
+
+  int rawCm = NO_ECHO_CM;
+  uint32_t rangeUs = 0;
+  seq = slotRead(&rangeSlot, &rawCm, &rangeUs);
+  bool rangeFresh = seq != 0 && seq != rangeSeq;
+  rangeSeq = seq;
+
+  if (colourFresh) {
+    redPW = colour.red;
+    greenPW = colour.green;
+    bluePW = colour.blue;
+    pipelineColour = classifyColour();
+  }
+  if (rangeFresh) {
+    pipelineRawCm = rawCm;
+    pipelineCm = updateSweep(rawCm);
+  }
+  if (colourFresh) {
+    SensorFrame frame = SensorFrame();
+    frame.tMs = millis();
+    frame.redPW = redPW;
+    frame.greenPW = greenPW;
+    frame.bluePW = bluePW;
+    frame.distanceCm = pipelineRawCm;
+    frame.colour = pipelineColour;
+    telemetrySendSensor(&frame, robotState);
+  }
+
+  uint32_t now = micros();
+  if ((now - colourUs) / 1000UL > COLOUR_STALE_MS) {
+    stopMotors();
+    return;
+  }
+  updateState(pipelineColour, pipelineCm, (now - rangeUs) / 1000UL, colourFresh, rangeFresh);
+}
+#endif
+
 void loop()
 {
+  PROFILE_LOOP_TICK();
+  telemetryPump();
+  serialCommandPoll();
+  flightRecorderTick();
+  if (batteryUpdate()) telemetrySendBattery(batteryMillivolts(), millis());
+
+#ifdef UTRA_PIPELINE
+  sampleColour();
+  if (rateDue(&controlTask, micros())) controlStep();
+#else
+  SensorFrame frame = SensorFrame();
+  frame.tMs = millis();
   PathColour color = getColour();
-  int cm = getDistance();
+  int rawCm = getDistance();
+  int cm = updateSweep(rawCm);
+
+  // Raw reading, so a replayed trace goes through updateSweep() again.
+  frame.redPW = redPW;
+  frame.greenPW = greenPW;
+  frame.bluePW = bluePW;
+  frame.distanceCm = rawCm;
+  frame.colour = color;
+  telemetrySendSensor(&frame, robotState);
+
+  updateState(color, cm, 0, true, true);
+#endif
+}
 
-  Serial.print("Color: ");
-  switch (color) {
-    case PATH_WHITE:
-      Serial.println("WHITE");
-      break;
-    case PATH_RED:
-      Serial.println("RED");
-      break;
-    case PATH_GREEN:
-      Serial.println("GREEN");
-      break;
-    case PATH_BLUE:
-      Serial.println("BLUE");
-      break;
-    case PATH_BLACK:
-      Serial.println("BLACK");
-      break;
+// Driving forward at something in range, with neither the colour nor the
+// range ahead changing: pushing into it. Open floor with nothing in range
+// gives no evidence either way, so it is not watched. Back off, then run at
+// it with the enables fully on for DRIVE_STALL_PUSH_MS per retry so far, and
+// restart the interrupted state's timer (stall_detector.h). The run-up is
+// timed rather than a higher PWM: CRUISE_PWM is already full scale, and the
+// approach limit and setRobotState() would overwrite any speed set here.
+// True while backing off or pushing.
+bool driveStalled(PathColour color, int cm, bool colourFresh, bool rangeFresh)
+{
+#ifdef UTRA_STALL
+  unsigned long now = millis();
+  if (stallPushing) {
+    if ((long)(now - stallPushEndMs) < 0) {
+      moveForward();
+      return true;
+    }
+    stallPushing = false;
+    stateStartMs = now;
+    stallNoteMoving(&driveStall, now, true);   // the window starts after the run-up
   }
+  if (colourFresh) stallNoteColour(&driveStall, now, color);
+  if (rangeFresh && cm < NO_ECHO_CM) stallNoteRange(&driveStall, now, cm);
+  bool forward = robotState == STATE_FOLLOW_RED || robotState == STATE_AVOID_FORWARD1 ||
+                 robotState == STATE_AVOID_FORWARD2 || robotState == STATE_AVOID_FORWARD3;
+  bool driving = forward && cm < NO_ECHO_CM;
+  bool wasBackingOff = driveStall.phase == STALL_PHASE_BACK_OFF;
+  if (stallUpdate(&driveStall, now, driving)) {
+    setDriveSpeed(255);
+    moveBackward();
+    return true;
+  }
+  if (wasBackingOff) {
+    stallPushEndMs = now + batteryScaleMs(DRIVE_STALL_PUSH_MS * driveStall.retries);
+    stallPushing = true;
+    setDriveSpeed(255);
+    moveForward();
+    return true;
+  }
+#else
+  (void)color;
+  (void)cm;
+  (void)colourFresh;
+  (void)rangeFresh;
+#endif
+  return false;
+}
+
+// Colour decisions that count readings only count fresh ones, and the
+// obstacle debounce and approach speed only move on a fresh range.
+void updateState(PathColour color, int cm, unsigned long rangeAgeMs, bool colourFresh, bool rangeFresh)
+{
+  PROFILE_SCOPE("state");
+  if (driveStalled(color, cm, colourFresh, rangeFresh)) return;
 
   switch (robotState) {
     case STATE_FOLLOW_RED:
-      if (color == PATH_BLACK) {
+      if (color == PATH_BLACK && isConfident()) {
         stopMotors();
         setRobotState(STATE_END);
         break;
       }
 
+      // A borderline white neither counts towards the streak nor breaks it.
+      // It must also last WHITE_STREAK_MS: six reads pass while a pivot is
+      // still reversing out of the last turn, sooner at the pipeline's rate.
       if (color == PATH_WHITE) {
-        whiteStreakCount++;
-        if (whiteStreakCount >= WHITE_STREAK_HITS) {
+        if (colourFresh && isConfident()) {
+          if (whiteStreakCount == 0) whiteStreakStartMs = millis();
+          whiteStreakCount++;
+        }
+        if (whiteStreakCount >= WHITE_STREAK_HITS &&
+            millis() - whiteStreakStartMs >= WHITE_STREAK_MS) {
           setRobotState(STATE_TURN_RIGHT_INTERSECTION);
           break;
         }
@@ -311,18 +792,26 @@ void loop()
         whiteStreakCount = 0;
       }
 
-      if (isObstacleDetected(cm)) {
-        stopMotors();
-        delay(100);
+      // Already slowed by the approach limit, so go straight into the turn;
+      // enables without PWM were never slowed, so stop and settle first.
+      // The cone minimum holds readings from earlier passes too, so only a
+      // reading just taken inside the cone counts towards the debounce.
+      if (rangeFresh && freshAheadCm >= 0 && isObstacleDetected(freshAheadCm)) {
+        planBypass(cm);
+        if (!digitalPinHasPWM(ENA) || !digitalPinHasPWM(ENB)) {
+          stopMotors();
+          delay(100);
+        }
         setRobotState(STATE_AVOID_LEFT);
         break;
       }
+      if (rangeFresh) setDriveSpeed(approachSpeedLimit(cm, rangeAgeMs));
       followRed(color);
       break;
 
     case STATE_AVOID_LEFT:
-      moveLeft();
-      if (millis() - stateStartMs >= TURN_LEFT_MS) {
+      turnAway();
+      if (millis() - stateStartMs >= batteryScaleMs(TURN_LEFT_MS)) {
         setRobotState(STATE_AVOID_FORWARD1);
       }
       break;
@@ -331,14 +820,14 @@ void loop()
       moveForward();
       if (isRed(color)) {
         setRobotState(STATE_ALIGN_LEFT);
-      } else if (millis() - stateStartMs >= FORWARD1_MS) {
+      } else if (millis() - stateStartMs >= batteryScaleMs(bypassLateralMs)) {
         setRobotState(STATE_AVOID_RIGHT1);
       }
       break;
 
     case STATE_AVOID_RIGHT1:
-      moveRight();
-      if (millis() - stateStartMs >= TURN_RIGHT_MS) {
+      turnBack();
+      if (millis() - stateStartMs >= batteryScaleMs(TURN_RIGHT_MS)) {
         setRobotState(STATE_AVOID_FORWARD2);
       }
       break;
@@ -347,14 +836,14 @@ void loop()
       moveForward();
       if (isRed(color)) {
         setRobotState(STATE_ALIGN_LEFT);
-      } else if (millis() - stateStartMs >= FORWARD2_MS) {
+      } else if (millis() - stateStartMs >= batteryScaleMs(bypassPassMs)) {
         setRobotState(STATE_AVOID_RIGHT2);
       }
       break;
 
     case STATE_AVOID_RIGHT2:
-      moveRight();
-      if (millis() - stateStartMs >= TURN_RIGHT_MS) {
+      turnBack();
+      if (millis() - stateStartMs >= batteryScaleMs(TURN_RIGHT_MS)) {
         setRobotState(STATE_AVOID_FORWARD3);
       }
       break;
@@ -363,22 +852,22 @@ void loop()
       moveForward();
       if (isRed(color)) {
         setRobotState(STATE_ALIGN_LEFT);
-      } else if (millis() - stateStartMs >= FORWARD3_MS) {
+      } else if (millis() - stateStartMs >= batteryScaleMs(FORWARD3_MS)) {
         // keep going forward until red is found
         stateStartMs = millis();
       }
       break;
 
     case STATE_ALIGN_LEFT:
-      moveLeft();
-      if (millis() - stateStartMs >= ALIGN_LEFT_MS) {
+      turnAway();
+      if (millis() - stateStartMs >= batteryScaleMs(ALIGN_LEFT_MS)) {
         setRobotState(STATE_FOLLOW_RED);
       }
       break;
 
     case STATE_TURN_RIGHT_INTERSECTION:
       moveRight();
-      if (millis() - stateStartMs >= INTERSECTION_RIGHT_MS) {
+      if (millis() - stateStartMs >= batteryScaleMs(INTERSECTION_RIGHT_MS)) {
         setRobotState(STATE_FOLLOW_RED);
       }
       break;
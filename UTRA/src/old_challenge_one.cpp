@@ -9,18 +9,45 @@
  */
 
 #include <Arduino.h>
+#include "battery.h"
+#include "colour_classifier.h"
+#include "line_array.h"
+#include "profiler.h"
+#include "ramp_estimator.h"
+#include "stall_detector.h"
+#include "state_stats.h"
+#include "telemetry.h"
+#include "tunable.h"
 
 // --- TCS3200 color sensor pins ---
+// S1 is tied to GND (20% output scaling with S0 high); 3, 5 and 6 are the
+// right motor's.
 const int S0 = 2;
-const int S1 = 3;
+const int S1 = -1;
 const int S2 = 4;
-const int S3 = 5;
-const int S_OUT = 6;
-const int blackThreshold = 100;
-const int whiteThreshold = 40;
+const int S3 = 13;
+const int S_OUT = 12;
+TUNABLE(int, blackThreshold, 100, 60, 200);
+TUNABLE(int, whiteThreshold, 40, 10, 80);
+static ColourTracker colourTracker;   // UTRA_COLOUR_ADAPTIVE
+static ColourReading colourReading;   // from the last getColour()
 int redPW = 0;
 int greenPW = 0;
 int bluePW = 0;
+const uint16_t NO_ECHO_CM = 9999;     // SensorFrame: part one has no ultrasonic
+
+// --- IR reflectance array (-DUTRA_LINE_ARRAY), steers the line followers ---
+#ifdef UTRA_LINE_ARRAY
+#ifdef UTRA_RAMP_ACCEL_MPU6050
+#error "UTRA_LINE_ARRAY uses A4/A5, which the MPU-6050 needs for I2C"
+#endif
+static const uint8_t LINE_PINS[] = { A1, A2, A3, A4, A5 };   // left to right
+TUNABLE(int, LINE_FLOOR_RAW, 150, 0, 1023);
+TUNABLE(int, LINE_TAPE_RAW, 650, 0, 1023);
+TUNABLE(int, LINE_STEER_GAIN, 40, 0, 150);   // PWM per channel pitch off centre
+static LineArray lineArray;
+static LineReading lastLine;          // from the last lineArrayRead(), for the sensor frames
+#endif
 
 typedef enum {
   PATH_WHITE = 0,
@@ -31,14 +58,32 @@ typedef enum {
 } PathColour;
 
 // --- Constants ---
-const int TURN_SPEED = 120;
-const int DRIVE_SPEED = 180;
-const int RAMP_SPEED = 220;
-const int LINE_FOLLOW_SPEED = 100;
+TUNABLE(int, TURN_SPEED, 120, 60, 255);
+TUNABLE(int, DRIVE_SPEED, 180, 80, 255);
+TUNABLE(int, RAMP_SPEED, 220, 120, 255);
+TUNABLE(int, LINE_FOLLOW_SPEED, 100, 50, 200);
+TUNABLE(int, MIN_TRANSITION_CONFIDENCE, 64, 0, 255);  // colourReading.confidence to end a stage
 const int turnBackTimeOffset = 900;
 const int COLOR_CHANGES_TO_CENTER = 5;
 const int COLOR_CHANGES_FOR_EDGES = 3;
 
+// --- Pack voltage through the divider (-DUTRA_BATTERY) ---
+const int BATTERY_PIN = A0;
+
+// --- Stall recovery on the ramp (-DUTRA_STALL) ---
+#ifdef UTRA_STALL
+TUNABLE(unsigned long, RAMP_STALL_WINDOW_MS, 6000, 2000, 15000);  // no colour change at all: a backstop
+TUNABLE(unsigned long, RAMP_STALL_BACKOFF_MS, 300, 100, 1000);
+TUNABLE(int, RAMP_STALL_BACKOFF_PWM, 160, 80, 255);
+TUNABLE(int, RAMP_STALL_TORQUE_STEP, 25, 0, 100);    // PWM added per retry
+TUNABLE(int, RAMP_STALL_MAX_RETRIES, 3, 0, 10);
+TUNABLE(int, MOTOR_STALL_MA, 1500, 200, 4000);
+const int MOTOR_SENSE_PIN = -1;     // shared L298N sense resistor (-1 if not fitted)
+const long MOTOR_SENSE_MOHM = 500;
+static StallDetector rampStall;
+static bool rampBackingOff = false;
+#endif
+
 // --- Motor pins (L298N) ---
 const int IN1 = 9;   // Left motor direction
 const int IN2 = 10;  // Left motor direction
@@ -57,15 +102,22 @@ enum class ChallengeOneState {
 };
 
 ChallengeOneState challengeOneState = ChallengeOneState::STAGE1_GREEN_PATH;
+const uint8_t CHALLENGE_ONE_STATE_COUNT = (uint8_t)ChallengeOneState::DONE + 1;
+StateTime challengeOneTimes[CHALLENGE_ONE_STATE_COUNT];
+StateStats challengeOneStats;
 unsigned long startTime = 0;
 unsigned long timestampOne = 0;
 unsigned long timestampTwo = 0;
 unsigned long centerTime = 0;
 int colorChanges = 0;
 PathColour currentColor = PATH_WHITE;
+RampEstimator rampEstimator;
 
 // --- Forward declarations ---
 PathColour getColour();
+int getRedPW();
+int getGreenPW();
+int getBluePW();
 bool isColorFound();
 bool isOnBlackTape();
 bool isOnGreenLine();
@@ -77,37 +129,44 @@ void stop();
 void reverse();
 void turnLeft(int pwm = -1);
 void turnRight(int pwm = -1);
+void followLine(PathColour line);
 void followGreenLine();
 void followBlackLine();
 void followBlackTape();
 bool followBlackTapeUntilCenter();
 bool isAtRampTop();
+bool rampStalled(PathColour c, bool driving);
 void timeSave();
+void setChallengeOneState(ChallengeOneState state);
 
 // ========== Color sensor (TCS3200) ==========
 PathColour getColour() {
+  PROFILE_SCOPE("colour");
+  SensorFrame frame = SensorFrame();
+  frame.tMs = millis();
   redPW = getRedPW();
   greenPW = getGreenPW();
   bluePW = getBluePW();
 
-  if (redPW > blackThreshold && greenPW > blackThreshold && bluePW > blackThreshold) {
-    return PATH_BLACK;
-  }
-
-  if (redPW < whiteThreshold && greenPW < whiteThreshold && bluePW < whiteThreshold) {
-    return PATH_WHITE;
-  }
-
-  int maxColor = min(redPW, min(greenPW, bluePW));
-  if (maxColor == redPW) {
-    return PATH_RED;
-  }
-  else if (maxColor == greenPW) {
-    return PATH_GREEN;
-  }
-  else {
-    return PATH_BLUE;
-  }
+#ifdef UTRA_COLOUR_MODEL
+  colourReadModel(&COLOUR_MODEL, redPW, greenPW, bluePW, &colourReading);
+#elif defined(UTRA_COLOUR_ADAPTIVE)
+  colourReadAdaptive(&colourTracker, redPW, greenPW, bluePW, &colourReading);
+#else
+  colourReadThresholds(redPW, greenPW, bluePW, whiteThreshold, blackThreshold, &colourReading);
+#endif
+
+  frame.redPW = redPW;
+  frame.greenPW = greenPW;
+  frame.bluePW = bluePW;
+  frame.distanceCm = NO_ECHO_CM;
+  frame.colour = colourReading.colour;
+#ifdef UTRA_LINE_ARRAY
+  frame.linePos = lastLine.position;
+  frame.lineWidth = lastLine.width;
+#endif
+  telemetrySendSensor(&frame, (uint8_t)challengeOneState);
+  return (PathColour)colourReading.colour;
 }
 
 int getRedPW() {
@@ -151,6 +210,11 @@ bool isOnRedSurface() {
   return getColour() == PATH_RED;
 }
 
+// A borderline reading at a tape edge must not end a stage.
+bool isConfidentlyOn(PathColour c) {
+  return getColour() == c && colourReading.confidence >= MIN_TRANSITION_CONFIDENCE;
+}
+
 String getEnumColor(PathColour c) {
   switch (c) {
     case PATH_RED:   return "RED";
@@ -164,8 +228,10 @@ String getEnumColor(PathColour c) {
 
 // ========== Motor control ==========
 void driveMotor(int leftPWM, int rightPWM) {
-  int lp = constrain(abs(leftPWM), 0, 255);
-  int rp = constrain(abs(rightPWM), 0, 255);
+  PROFILE_SCOPE("motor");
+  // Same average motor voltage whatever the pack is at (battery.h)
+  int lp = constrain(abs(batteryScalePwm(leftPWM)), 0, 255);
+  int rp = constrain(abs(batteryScalePwm(rightPWM)), 0, 255);
 
   if (ENA_PIN >= 0) { analogWrite(ENA_PIN, lp); } else { lp = 255; }
   if (ENB_PIN >= 0) { analogWrite(ENB_PIN, rp); } else { rp = 255; }
@@ -214,20 +280,44 @@ void turnRight(int pwm /* = -1 */) {
 }
 
 // ========== Line following ==========
-void followGreenLine() {
-  if (isOnGreenLine()) {
+// Off the line, the confidence of the reading says how far off: just past
+// the edge the sensor still sees some of the tape, so arc back gently and
+// only pivot once it is clearly on the floor.
+void followLine(PathColour line) {
+#ifdef UTRA_LINE_ARRAY
+  // The array sees where the tape is, not what colour; callers check the
+  // colour for their stage changes.
+  LineReading reading;
+  lineArrayRead(&lineArray, &reading);
+  lastLine = reading;
+  if (reading.width > 0) {
+    int turn = (int)((long)reading.position * LINE_STEER_GAIN / LINE_PITCH_Q8);
+    driveMotor(LINE_FOLLOW_SPEED + turn, LINE_FOLLOW_SPEED - turn);
+    return;
+  }
+  if (reading.position > 0) {
+    turnRight(LINE_FOLLOW_SPEED);   // lost off the right-hand channels
+    return;
+  }
+  if (reading.position < 0) {
+    turnLeft(LINE_FOLLOW_SPEED);
+    return;
+  }
+#endif
+  if (getColour() == line) {
     driveMotor(LINE_FOLLOW_SPEED, LINE_FOLLOW_SPEED);
-  } else {
-    turnLeft(LINE_FOLLOW_SPEED);  // Lost line: rotate to find it
+    return;
   }
+  int inner = LINE_FOLLOW_SPEED - (int)((2L * LINE_FOLLOW_SPEED * colourReading.confidence) / 255);
+  driveMotor(inner, LINE_FOLLOW_SPEED);  // turnLeft() at full confidence
+}
+
+void followGreenLine() {
+  followLine(PATH_GREEN);
 }
 
 void followBlackLine() {
-  if (isOnBlackTape()) {
-    driveMotor(LINE_FOLLOW_SPEED, LINE_FOLLOW_SPEED);
-  } else {
-    turnLeft(LINE_FOLLOW_SPEED);
-  }
+  followLine(PATH_BLACK);
 }
 
 void followBlackTape() {
@@ -248,14 +338,44 @@ bool followBlackTapeUntilCenter() {
 }
 
 bool isAtRampTop() {
-  return false;
+  return rampIsAtTop(&rampEstimator);
 }
 
+// ========== Stall detection ==========
+#ifdef UTRA_STALL
+// The ramp is one long stretch of black, so a colour change alone would
+// call every slow climb a stall, and the window is only a backstop. The
+// estimator's slip verdict (commanded travel against pitch when an
+// accelerometer is fitted, still on the lines when not) is a stall in
+// STALL_SLIP_MS; current sense, where fitted, in STALL_CURRENT_MS. True
+// while backing off.
+bool rampStalled(PathColour c, bool driving) {
+  unsigned long now = millis();
+  stallNoteColour(&rampStall, now, c);
+  stallNoteSlipping(&rampStall, now, rampIsSlipping(&rampEstimator));
+  if (MOTOR_SENSE_PIN >= 0) {
+    long mV = (long)analogRead(MOTOR_SENSE_PIN) * 5000L / 1023L;
+    stallNoteCurrent(&rampStall, now, (uint16_t)(mV * 1000L / MOTOR_SENSE_MOHM), MOTOR_STALL_MA);
+  }
+  return stallUpdate(&rampStall, now, driving);
+}
+#endif
+
 // ========== Utility ==========
 void timeSave() {
   // Placeholder for turn-back timing (from last year)
 }
 
+// ========== State accounting ==========
+void setChallengeOneState(ChallengeOneState state) {
+  challengeOneState = state;
+  telemetrySendState(STATE_MACHINE_CHALLENGE_ONE, (uint8_t)state, millis());
+  stateStatsEnter(&challengeOneStats, (uint8_t)state, millis());
+  if (state == ChallengeOneState::DONE) {
+    stateStatsFinish(&challengeOneStats, millis());
+  }
+}
+
 // ========== Initialization ==========
 void initChallengeOne() {
   pinMode(IN1, OUTPUT);
@@ -265,14 +385,27 @@ void initChallengeOne() {
   if (ENA_PIN >= 0) pinMode(ENA_PIN, OUTPUT);
   if (ENB_PIN >= 0) pinMode(ENB_PIN, OUTPUT);
   pinMode(S0, OUTPUT);
-  pinMode(S1, OUTPUT);
+  if (S1 >= 0) pinMode(S1, OUTPUT);
   pinMode(S2, OUTPUT);
   pinMode(S3, OUTPUT);
   pinMode(S_OUT, INPUT);
   digitalWrite(S0, HIGH);
-  digitalWrite(S1, LOW);
+  if (S1 >= 0) digitalWrite(S1, LOW);
+  colourTrackerBegin(&colourTracker, whiteThreshold, blackThreshold);
+#ifdef UTRA_BATTERY
+  batteryBegin(BATTERY_PIN);
+#endif
+#ifdef UTRA_LINE_ARRAY
+  lineArrayBegin(&lineArray, LINE_PINS, sizeof(LINE_PINS), LINE_FLOOR_RAW, LINE_TAPE_RAW);
+#endif
+#ifdef UTRA_RAMP_ACCEL_MPU6050
+  mpu6050Begin();
+#endif
 
   challengeOneState = ChallengeOneState::STAGE1_GREEN_PATH;
+  telemetrySendState(STATE_MACHINE_CHALLENGE_ONE, (uint8_t)challengeOneState, millis());
+  stateStatsBegin(&challengeOneStats, STATE_MACHINE_CHALLENGE_ONE, challengeOneTimes,
+                  CHALLENGE_ONE_STATE_COUNT, (uint8_t)challengeOneState, millis());
 }
 
 bool isChallengeOneComplete() {
@@ -281,15 +414,28 @@ bool isChallengeOneComplete() {
 
 // ========== Main challenge state machine ==========
 void challengeOne() {
+  PROFILE_SCOPE("state1");
   timeSave();
 
   switch (challengeOneState) {
     // --- STAGE 1: Initial path following (green line) ---
     case ChallengeOneState::STAGE1_GREEN_PATH: {
-      if (isOnBlackTape()) {
+      if (isConfidentlyOn(PATH_BLACK)) {
         stop();
         delay(500);
-        challengeOneState = ChallengeOneState::STAGE2_RAMP_ASCENT;
+#ifdef UTRA_RAMP_ACCEL_MPU6050
+        rampEstimatorBegin(&rampEstimator, millis(), mpu6050ReadAccel);
+#elif defined(UTRA_RAMP_ACCEL_SIMULATED)
+        rampEstimatorBegin(&rampEstimator, millis(), simulatedAccelRead);
+#else
+        rampEstimatorBegin(&rampEstimator, millis(), NULL);
+#endif
+#ifdef UTRA_STALL
+        stallBegin(&rampStall, millis(), RAMP_STALL_WINDOW_MS, RAMP_STALL_BACKOFF_MS,
+                   RAMP_STALL_MAX_RETRIES);
+        rampBackingOff = false;
+#endif
+        setChallengeOneState(ChallengeOneState::STAGE2_RAMP_ASCENT);
       } else {
         followGreenLine();
       }
@@ -297,15 +443,38 @@ void challengeOne() {
     }
 
     // --- STAGE 2: Ramp detection and ascent (black lines -> red) ---
+    // Throttle follows the ramp estimator phase: full torque on the climb,
+    // braking from the crest so the robot doesn't fly past the red zone.
     case ChallengeOneState::STAGE2_RAMP_ASCENT: {
-      if (isOnRedSurface()) {
+      PathColour c = getColour();
+      bool onBlack = (c == PATH_BLACK);
+      int throttle = rampThrottle(&rampEstimator, RAMP_SPEED);
+#ifdef UTRA_STALL
+      // Back down off whatever holds it, then retry with more torque.
+      throttle = stallRetryPwm(&rampStall, throttle, RAMP_STALL_TORQUE_STEP);
+      if (rampStalled(c, onBlack || isAtRampTop())) {
+        rampBackingOff = true;
+        rampEstimatorUpdate(&rampEstimator, millis(), onBlack, 0);
+        driveMotor(-RAMP_STALL_BACKOFF_PWM, -RAMP_STALL_BACKOFF_PWM);
+        break;
+      }
+      // Driving again after a back-off: slip counts from here, not from the
+      // base of the ramp.
+      if (rampBackingOff) {
+        rampBackingOff = false;
+        rampEstimatorRebaseline(&rampEstimator);
+      }
+#endif
+      rampEstimatorUpdate(&rampEstimator, millis(), onBlack, onBlack ? throttle : 0);
+
+      if (c == PATH_RED && colourReading.confidence >= MIN_TRANSITION_CONFIDENCE) {
         stop();
         delay(500);
-        challengeOneState = ChallengeOneState::STAGE3_PLATFORM_DETECTED;
-      } else if (isOnBlackTape()) {
-        driveMotor(RAMP_SPEED, RAMP_SPEED);  // On black: ascend ramp
+        setChallengeOneState(ChallengeOneState::STAGE3_PLATFORM_DETECTED);
+      } else if (onBlack || isAtRampTop()) {
+        driveMotor(throttle, throttle);  // On black (or past the crest): keep going
       } else {
-        turnLeft(RAMP_SPEED);  // Lost line: search for it
+        turnLeft(throttle);  // Lost line: search for it
       }
       break;
     }
@@ -314,7 +483,7 @@ void challengeOne() {
     case ChallengeOneState::STAGE3_PLATFORM_DETECTED: {
       stop();
       delay(300);
-      challengeOneState = ChallengeOneState::STAGE4_PLATFORM_NAV;
+      setChallengeOneState(ChallengeOneState::STAGE4_PLATFORM_NAV);
       break;
     }
 
@@ -333,7 +502,7 @@ void challengeOne() {
       // Now on black center zone - Part Two (challenge_one_part_two) continues from here
       stop();
       delay(500);
-      challengeOneState = ChallengeOneState::DONE;
+      setChallengeOneState(ChallengeOneState::DONE);
       break;
     }
 
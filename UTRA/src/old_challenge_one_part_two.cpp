@@ -5,18 +5,28 @@
  */
 
 #include <Arduino.h>
+#include "battery.h"
+#include "colour_classifier.h"
+#include "profiler.h"
+#include "state_stats.h"
+#include "telemetry.h"
+#include "tunable.h"
 
 // --- TCS3200 color sensor pins ---
+// S1 is tied to GND (20% output scaling with S0 high); 3, 5 and 6 are the
+// right motor's.
 const int S0 = 2;
-const int S1 = 3;
+const int S1 = -1;
 const int S2 = 4;
-const int S3 = 5;
-const int S_OUT = 6;
-const int blackThreshold = 100;
-const int whiteThreshold = 40;
-int redPW = 0;
-int greenPW = 0;
-int bluePW = 0;
+const int S3 = 13;
+const int S_OUT = 12;
+TUNABLE(int, blackThreshold, 100, 60, 200);
+TUNABLE(int, whiteThreshold, 40, 10, 80);
+static ColourTracker colourTracker;   // UTRA_COLOUR_ADAPTIVE
+static ColourReading colourReading;   // from the last getColour()
+static int redPW = 0;
+static int greenPW = 0;
+static int bluePW = 0;
 
 typedef enum {
   PATH_WHITE = 0,
@@ -27,11 +37,12 @@ typedef enum {
 } PathColour;
 
 // --- Constants ---
-const int TURN_SPEED = 120;
-const int DRIVE_SPEED = 180;
-const int RAMP_SPEED = 220;
-const int LINE_FOLLOW_SPEED = 100;
-const int REVERSE_SPEED = 100;
+TUNABLE(int, TURN_SPEED, 120, 60, 255);
+TUNABLE(int, DRIVE_SPEED, 180, 80, 255);
+TUNABLE(int, RAMP_SPEED, 220, 120, 255);
+TUNABLE(int, LINE_FOLLOW_SPEED, 100, 50, 200);
+TUNABLE(int, REVERSE_SPEED, 100, 50, 200);
+TUNABLE(int, MIN_TRANSITION_CONFIDENCE, 64, 0, 255);  // colourReading.confidence to end a stage
 const unsigned long FOLLOW_HOME_DURATION_MS = 8000;
 
 // --- Ultrasonic sensor (HC-SR04) ---
@@ -40,9 +51,18 @@ const int TRIG_PIN = 7;
 const int ECHO_PIN = 8;
 const int SCAN_STEP_DEGREES = 12;
 const int NUM_SCAN_STEPS = 360 / SCAN_STEP_DEGREES;
-const unsigned long SCAN_STEP_DURATION_MS = 250;
+TUNABLE(unsigned long, SCAN_STEP_DURATION_MS, 250, 100, 600);
 const unsigned long ULTRASONIC_TIMEOUT_US = 30000;
 
+// --- Wall alignment ---
+// Scan rotation is clockwise (turnRight), so headings are degrees clockwise.
+const int WALL_FIT_HALF_WINDOW = 2;        // scan steps either side of the nearest reading
+const float WALL_FIT_MAX_SPREAD_CM = 25.0f; // ignore points that are clearly not the wall
+const float ALIGN_PROBE_DEGREES = 8.0f;
+const float ALIGN_TOLERANCE_DEGREES = 1.5f;
+const int ALIGN_MAX_ITERATIONS = 4;
+const unsigned long ALIGN_SETTLE_MS = 60;
+
 // --- Motor pins (L298N) ---
 const int IN1 = 9;
 const int IN2 = 10;
@@ -62,22 +82,30 @@ enum class ChallengeTwoState {
   DONE
 };
 
-ChallengeTwoState challengeTwoState = ChallengeTwoState::FIND_WALL_ANGLE;
-unsigned long startTime = 0;
-unsigned long centerTime = 0;
-int wallAngleDegrees = 0;
-int scanStepIndex = 0;
-unsigned long scanStepStartTime = 0;
-float scanDistances[NUM_SCAN_STEPS];
-bool scanRotationPhase = true;
-int colorChanges = 0;
-PathColour currentColor = PATH_BLACK;
+static ChallengeTwoState challengeTwoState = ChallengeTwoState::FIND_WALL_ANGLE;
+const uint8_t CHALLENGE_TWO_STATE_COUNT = (uint8_t)ChallengeTwoState::DONE + 1;
+static StateTime challengeTwoTimes[CHALLENGE_TWO_STATE_COUNT];
+static StateStats challengeTwoStats;
+static unsigned long startTime = 0;
+static int wallAngleDegrees = 0;
+static float wallNormalDegrees = 0.0f;
+static int scanStepIndex = 0;
+static unsigned long scanStepStartTime = 0;
+static float scanDistances[NUM_SCAN_STEPS];
+static bool scanRotationPhase = true;
+static int colorChanges = 0;
+static PathColour currentColor = PATH_BLACK;
+static uint16_t lastRangeCm = 9999;    // for the sensor frames, 9999 = no echo
 
 // --- Forward declarations (static = file-local, no conflict with challenge_one.cpp) ---
 static PathColour getColour();
+static int getRedPW();
+static int getGreenPW();
+static int getBluePW();
 static bool isOnGreenLine();
 static bool isOnRedSurface();
 static bool isOnBlackTape();
+static bool isConfidentlyOn(PathColour c);
 static String getEnumColor(PathColour c);
 static void driveMotor(int leftPWM, int rightPWM);
 static void stop();
@@ -85,31 +113,42 @@ static void turnLeft(int pwm = -1);
 static void turnRight(int pwm = -1);
 static float measureDistanceCm();
 static void driveBackward(int speed);
+static float fitWallNormalDegrees(int nearestIdx);
+static void rotateByDegrees(float degrees);
+static float measureSettledCm();
+static void fineAlignToWall();
+static void setChallengeTwoState(ChallengeTwoState state);
+static void sendSensorFrame(uint32_t tMs);
 
 // ========== Color sensor (TCS3200) ==========
 static PathColour getColour() {
+  PROFILE_SCOPE("colour2");
+  uint32_t t = millis();
   redPW = getRedPW();
   greenPW = getGreenPW();
   bluePW = getBluePW();
 
-  if (redPW > blackThreshold && greenPW > blackThreshold && bluePW > blackThreshold) {
-    return PATH_BLACK;
-  }
-
-  if (redPW < whiteThreshold && greenPW < whiteThreshold && bluePW < whiteThreshold) {
-    return PATH_WHITE;
-  }
+#ifdef UTRA_COLOUR_MODEL
+  colourReadModel(&COLOUR_MODEL, redPW, greenPW, bluePW, &colourReading);
+#elif defined(UTRA_COLOUR_ADAPTIVE)
+  colourReadAdaptive(&colourTracker, redPW, greenPW, bluePW, &colourReading);
+#else
+  colourReadThresholds(redPW, greenPW, bluePW, whiteThreshold, blackThreshold, &colourReading);
+#endif
+  sendSensorFrame(t);
+  return (PathColour)colourReading.colour;
+}
 
-  int maxColor = min(redPW, min(greenPW, bluePW));
-  if (maxColor == redPW) {
-    return PATH_RED;
-  }
-  else if (maxColor == greenPW) {
-    return PATH_GREEN;
-  }
-  else {
-    return PATH_BLUE;
-  }
+// Latest colour and range together, after either sensor is read.
+static void sendSensorFrame(uint32_t tMs) {
+  SensorFrame frame = SensorFrame();
+  frame.tMs = tMs;
+  frame.redPW = redPW;
+  frame.greenPW = greenPW;
+  frame.bluePW = bluePW;
+  frame.distanceCm = lastRangeCm;
+  frame.colour = colourReading.colour;
+  telemetrySendSensor(&frame, (uint8_t)challengeTwoState);
 }
 
 static int getRedPW() {
@@ -139,6 +178,10 @@ static int getBluePW() {
 static bool isOnGreenLine() { return getColour() == PATH_GREEN; }
 static bool isOnRedSurface() { return getColour() == PATH_RED; }
 static bool isOnBlackTape() { return getColour() == PATH_BLACK; }
+// A borderline reading at a zone edge must not end a stage.
+static bool isConfidentlyOn(PathColour c) {
+  return getColour() == c && colourReading.confidence >= MIN_TRANSITION_CONFIDENCE;
+}
 
 static String getEnumColor(PathColour c) {
   switch (c) {
@@ -153,35 +196,38 @@ static String getEnumColor(PathColour c) {
 
 // ========== Motor control ==========
 static void driveMotor(int leftPWM, int rightPWM) {
-  int lp = constrain(abs(leftPWM), 0, 255);
-  int rp = constrain(abs(rightPWM), 0, 255);
+  PROFILE_SCOPE("motor2");
+  // Same average motor voltage whatever the pack is at (battery.h)
+  int lp = constrain(abs(batteryScalePwm(leftPWM)), 0, 255);
+  int rp = constrain(abs(batteryScalePwm(rightPWM)), 0, 255);
   if (ENA_PIN >= 0) analogWrite(ENA_PIN, lp); else lp = 255;
   if (ENB_PIN >= 0) analogWrite(ENB_PIN, rp); else rp = 255;
 
+  // Same polarity as challenge one: both drive the same motors in main.cpp.
   if (leftPWM >= 0) {
-    digitalWrite(IN1, lp > 0 ? HIGH : LOW);
-    digitalWrite(IN2, LOW);
-  } else {
     digitalWrite(IN1, LOW);
     digitalWrite(IN2, lp > 0 ? HIGH : LOW);
+  } else {
+    digitalWrite(IN1, lp > 0 ? HIGH : LOW);
+    digitalWrite(IN2, LOW);
   }
   if (rightPWM >= 0) {
-    digitalWrite(IN3, rp > 0 ? HIGH : LOW);
-    digitalWrite(IN4, LOW);
-  } else {
     digitalWrite(IN3, LOW);
     digitalWrite(IN4, rp > 0 ? HIGH : LOW);
+  } else {
+    digitalWrite(IN3, rp > 0 ? HIGH : LOW);
+    digitalWrite(IN4, LOW);
   }
 }
 
 static void stop() { driveMotor(0, 0); }
 
-static void turnLeft(int pwm = -1) {
+static void turnLeft(int pwm) {
   int s = (pwm >= 0) ? pwm : TURN_SPEED;
   driveMotor(-s, s);
 }
 
-static void turnRight(int pwm = -1) {
+static void turnRight(int pwm) {
   int s = (pwm >= 0) ? pwm : TURN_SPEED;
   driveMotor(s, -s);
 }
@@ -192,14 +238,113 @@ static void driveBackward(int speed) {
 
 // ========== Ultrasonic ==========
 static float measureDistanceCm() {
+  PROFILE_SCOPE("range2");
+  uint32_t t = millis();
   digitalWrite(TRIG_PIN, LOW);
   delayMicroseconds(2);
   digitalWrite(TRIG_PIN, HIGH);
   delayMicroseconds(10);
   digitalWrite(TRIG_PIN, LOW);
   long duration = pulseIn(ECHO_PIN, HIGH, ULTRASONIC_TIMEOUT_US);
-  if (duration <= 0) return 999.0f;
-  return (duration / 2.0f) / 29.1f;
+  float cm = duration <= 0 ? 999.0f : (duration / 2.0f) / 29.1f;
+  lastRangeCm = duration <= 0 ? 9999 : (uint16_t)(cm + 0.5f);
+  sendSensorFrame(t);
+  return cm;
+}
+
+// ========== Wall alignment ==========
+// Least-squares line through the scan points around the nearest reading.
+// Returns the heading of the wall normal, which is where the robot should
+// face so that reversing takes it straight away from the wall.
+static float fitWallNormalDegrees(int nearestIdx) {
+  float xs[2 * WALL_FIT_HALF_WINDOW + 1];
+  float ys[2 * WALL_FIT_HALF_WINDOW + 1];
+  int n = 0;
+  float nearest = scanDistances[nearestIdx];
+
+  for (int k = -WALL_FIT_HALF_WINDOW; k <= WALL_FIT_HALF_WINDOW; k++) {
+    int i = (nearestIdx + k + NUM_SCAN_STEPS) % NUM_SCAN_STEPS;
+    float d = scanDistances[i];
+    if (d <= 2.0f || d - nearest > WALL_FIT_MAX_SPREAD_CM) continue;
+    float rad = (i * SCAN_STEP_DEGREES) * (PI / 180.0f);
+    xs[n] = d * cos(rad);
+    ys[n] = d * sin(rad);
+    n++;
+  }
+  if (n < 2) {
+    return nearestIdx * SCAN_STEP_DEGREES;
+  }
+
+  float mx = 0.0f, my = 0.0f;
+  for (int i = 0; i < n; i++) { mx += xs[i]; my += ys[i]; }
+  mx /= n;
+  my /= n;
+  float sxx = 0.0f, syy = 0.0f, sxy = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float dx = xs[i] - mx;
+    float dy = ys[i] - my;
+    sxx += dx * dx;
+    syy += dy * dy;
+    sxy += dx * dy;
+  }
+
+  // Principal axis of the points is the wall direction; the normal is
+  // perpendicular to it, flipped to point from the robot towards the wall.
+  float lineRad = 0.5f * atan2(2.0f * sxy, sxx - syy);
+  float nx = -sin(lineRad);
+  float ny = cos(lineRad);
+  if (nx * mx + ny * my < 0.0f) { nx = -nx; ny = -ny; }
+
+  float deg = atan2(ny, nx) * (180.0f / PI);
+  if (deg < 0.0f) deg += 360.0f;
+  return deg;
+}
+
+// Timed spin; positive is clockwise to match the scan.
+static void rotateByDegrees(float degrees) {
+  unsigned long ms = (unsigned long)(fabs(degrees) * SCAN_STEP_DURATION_MS / SCAN_STEP_DEGREES);
+  if (ms == 0) return;
+  if (degrees > 0.0f) turnRight(); else turnLeft();
+  delay(ms);
+  stop();
+  delay(ALIGN_SETTLE_MS);
+}
+
+static float measureSettledCm() {
+  float a = measureDistanceCm();
+  float b = measureDistanceCm();
+  float c = measureDistanceCm();
+  // median of three
+  return max(min(a, b), min(max(a, b), c));
+}
+
+// Probe the wall either side of the current heading. For a flat wall at
+// heading error e, d(e + p) / d(e - p) gives tan(e) in closed form, so one
+// probe pair corrects most of the error and the loop just cleans up.
+static void fineAlignToWall() {
+  const float tanProbe = tan(ALIGN_PROBE_DEGREES * (PI / 180.0f));
+  for (int iter = 0; iter < ALIGN_MAX_ITERATIONS; iter++) {
+    rotateByDegrees(ALIGN_PROBE_DEGREES);
+    float dPlus = measureSettledCm();
+    rotateByDegrees(-2.0f * ALIGN_PROBE_DEGREES);
+    float dMinus = measureSettledCm();
+    rotateByDegrees(ALIGN_PROBE_DEGREES);
+
+    if (dPlus >= 999.0f || dMinus >= 999.0f) break;  // lost the wall
+    float errDeg = atan((dPlus - dMinus) / ((dPlus + dMinus) * tanProbe)) * (180.0f / PI);
+    if (fabs(errDeg) < ALIGN_TOLERANCE_DEGREES) break;
+    rotateByDegrees(-errDeg);
+  }
+}
+
+// ========== State accounting ==========
+static void setChallengeTwoState(ChallengeTwoState state) {
+  challengeTwoState = state;
+  telemetrySendState(STATE_MACHINE_CHALLENGE_TWO, (uint8_t)state, millis());
+  stateStatsEnter(&challengeTwoStats, (uint8_t)state, millis());
+  if (state == ChallengeTwoState::DONE) {
+    stateStatsFinish(&challengeTwoStats, millis());
+  }
 }
 
 // ========== Initialization ==========
@@ -213,21 +358,30 @@ void initChallengeTwo() {
   pinMode(TRIG_PIN, OUTPUT);
   pinMode(ECHO_PIN, INPUT);
   pinMode(S0, OUTPUT);
-  pinMode(S1, OUTPUT);
+  if (S1 >= 0) pinMode(S1, OUTPUT);
   pinMode(S2, OUTPUT);
   pinMode(S3, OUTPUT);
   pinMode(S_OUT, INPUT);
   digitalWrite(S0, HIGH);
-  digitalWrite(S1, LOW);
+  if (S1 >= 0) digitalWrite(S1, LOW);
+  colourTrackerBegin(&colourTracker, whiteThreshold, blackThreshold);
 
   challengeTwoState = ChallengeTwoState::FIND_WALL_ANGLE;
+  telemetrySendState(STATE_MACHINE_CHALLENGE_TWO, (uint8_t)challengeTwoState, millis());
+  stateStatsBegin(&challengeTwoStats, STATE_MACHINE_CHALLENGE_TWO, challengeTwoTimes,
+                  CHALLENGE_TWO_STATE_COUNT, (uint8_t)challengeTwoState, millis());
   scanStepIndex = 0;
   scanRotationPhase = true;
   scanStepStartTime = millis();
 }
 
+bool isChallengeTwoComplete() {
+  return challengeTwoState == ChallengeTwoState::DONE;
+}
+
 // ========== Challenge Two state machine ==========
 void challengeTwo() {
+  PROFILE_SCOPE("state2");
   switch (challengeTwoState) {
     case ChallengeTwoState::FIND_WALL_ANGLE: {
       if (scanRotationPhase) {
@@ -246,10 +400,9 @@ void challengeTwo() {
                 minIdx = i;
               }
             }
-            wallAngleDegrees = minIdx * SCAN_STEP_DEGREES;
-            startTime = millis();
-            centerTime = (wallAngleDegrees * SCAN_STEP_DURATION_MS) / SCAN_STEP_DEGREES;
-            challengeTwoState = ChallengeTwoState::ALIGN_TO_WALL;
+            wallNormalDegrees = fitWallNormalDegrees(minIdx);
+            wallAngleDegrees = (int)(wallNormalDegrees + 0.5f);
+            setChallengeTwoState(ChallengeTwoState::ALIGN_TO_WALL);
           } else {
             scanStepStartTime = millis();
           }
@@ -259,41 +412,40 @@ void challengeTwo() {
     }
 
     case ChallengeTwoState::ALIGN_TO_WALL: {
-      driveMotor(TURN_SPEED, -TURN_SPEED);
-      if ((millis() - startTime) >= centerTime) {
-        driveMotor(0, 0);
-        delay(500);
-        challengeTwoState = ChallengeTwoState::RETURN_TO_RAMP;
-      }
+      // The scan ends back at heading 0; take the shorter way round.
+      float coarse = wallNormalDegrees > 180.0f ? wallNormalDegrees - 360.0f : wallNormalDegrees;
+      rotateByDegrees(coarse);
+      fineAlignToWall();
+      setChallengeTwoState(ChallengeTwoState::RETURN_TO_RAMP);
       break;
     }
 
     case ChallengeTwoState::RETURN_TO_RAMP: {
       driveBackward(REVERSE_SPEED);
-      if (isOnRedSurface()) {
+      if (isConfidentlyOn(PATH_RED)) {
         stop();
         delay(500);
-        challengeTwoState = ChallengeTwoState::DESCEND_RAMP;
+        setChallengeTwoState(ChallengeTwoState::DESCEND_RAMP);
       }
       break;
     }
 
     case ChallengeTwoState::DESCEND_RAMP: {
       driveBackward(RAMP_SPEED);
-      if (isOnGreenLine()) {
+      if (isConfidentlyOn(PATH_GREEN)) {
         stop();
         delay(500);
-        challengeTwoState = ChallengeTwoState::FIND_GREEN_LINE;
+        setChallengeTwoState(ChallengeTwoState::FIND_GREEN_LINE);
       }
       break;
     }
 
     case ChallengeTwoState::FIND_GREEN_LINE: {
-      if (isOnGreenLine()) {
+      if (isConfidentlyOn(PATH_GREEN)) {
         stop();
         delay(300);
         startTime = millis();
-        challengeTwoState = ChallengeTwoState::FOLLOW_GREEN_HOME;
+        setChallengeTwoState(ChallengeTwoState::FOLLOW_GREEN_HOME);
       } else {
         turnLeft(LINE_FOLLOW_SPEED);
       }
@@ -304,11 +456,14 @@ void challengeTwo() {
       if (isOnGreenLine()) {
         driveBackward(LINE_FOLLOW_SPEED);
       } else {
-        turnLeft(LINE_FOLLOW_SPEED);
+        // Just off the edge: keep reversing on a gentle arc; clearly off:
+        // pivot (turnLeft()) as before.
+        int right = -LINE_FOLLOW_SPEED + (int)((2L * LINE_FOLLOW_SPEED * colourReading.confidence) / 255);
+        driveMotor(-LINE_FOLLOW_SPEED, right);
       }
       if ((millis() - startTime) >= FOLLOW_HOME_DURATION_MS) {
         stop();
-        challengeTwoState = ChallengeTwoState::DONE;
+        setChallengeTwoState(ChallengeTwoState::DONE);
       }
       break;
     }
@@ -322,9 +477,14 @@ void challengeTwo() {
 // For standalone Part Two only: uncomment below and exclude challenge_one.cpp + main.cpp from build
 /*
 void setup() {
-  Serial.begin(9600);
-  Serial.println("UTRA: Challenge One Part Two starting...");
+  telemetryBegin();
+  flightRecorderBegin();
   initChallengeTwo();
 }
-void loop() { challengeTwo(); }
+void loop() {
+  telemetryPump();
+  serialCommandPoll();
+  flightRecorderTick();
+  challengeTwo();
+}
 */
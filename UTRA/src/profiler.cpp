@@ -0,0 +1,111 @@
+/**
+ * Loop-timing profiler - see profiler.h
+ */
+
+#include "profiler.h"
+
+#ifdef UTRA_PROFILE
+
+#include "serial_command.h"
+#include "telemetry.h"
+
+static ProfileSite *sites = NULL;
+static ProfileSite loopSite = { "loop", NULL, false, 0, 0, 0, {0} };
+static ProfileSite jitterSite = { "jitter", NULL, false, 0, 0, 0, {0} };
+static uint32_t lastLoopStartUs = 0;
+static uint32_t lastLoopPeriodUs = 0;
+
+static uint8_t bucketFor(uint32_t us) {
+  uint8_t b = 0;
+  while (us != 0 && b < PROFILE_BUCKETS - 1) {
+    us >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void profileRecord(ProfileSite *site, uint32_t us) {
+  if (!site->registered) {
+    site->registered = true;
+    site->next = sites;
+    sites = site;
+  }
+  site->count++;
+  site->totalUs += us;
+  if (us > site->maxUs) site->maxUs = us;
+  uint16_t &bucket = site->buckets[bucketFor(us)];
+  if (bucket != 0xFFFF) bucket++;
+}
+
+void profilerLoopTick() {
+  uint32_t now = micros();
+  if (lastLoopStartUs != 0) {
+    uint32_t period = now - lastLoopStartUs;
+    profileRecord(&loopSite, period);
+    if (lastLoopPeriodUs != 0) {
+      profileRecord(&jitterSite, period > lastLoopPeriodUs ? period - lastLoopPeriodUs
+                                                          : lastLoopPeriodUs - period);
+    }
+    lastLoopPeriodUs = period;
+  }
+  lastLoopStartUs = now;
+}
+
+void profilerReset() {
+  for (ProfileSite *s = sites; s != NULL; s = s->next) {
+    s->count = 0;
+    s->totalUs = 0;
+    s->maxUs = 0;
+    memset(s->buckets, 0, sizeof(s->buckets));
+  }
+  lastLoopStartUs = 0;
+  lastLoopPeriodUs = 0;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// PROFILE_SITE:    u8 type | u8 idx | u32 count | u32 totalUs | u32 maxUs | char name[8]
+// PROFILE_BUCKETS: u8 type | u8 idx | u8 first | u16 buckets[8]
+void profilerDump() {
+  uint8_t idx = 0;
+  for (ProfileSite *s = sites; s != NULL; s = s->next, idx++) {
+    uint8_t rec[2 + 12 + PROFILE_NAME_LEN];
+    rec[0] = TELEMETRY_PROFILE_SITE;
+    rec[1] = idx;
+    put32(rec + 2, s->count);
+    put32(rec + 6, s->totalUs);
+    put32(rec + 10, s->maxUs);
+    memset(rec + 14, 0, PROFILE_NAME_LEN);
+    strncpy((char *)rec + 14, s->name, PROFILE_NAME_LEN);
+    telemetrySendRecord(rec, sizeof(rec), TELEMETRY_PRIO_CRITICAL);
+
+    for (uint8_t first = 0; first < PROFILE_BUCKETS; first += 8) {
+      uint8_t brec[3 + 16];
+      brec[0] = TELEMETRY_PROFILE_BUCKETS;
+      brec[1] = idx;
+      brec[2] = first;
+      for (uint8_t i = 0; i < 8; i++) {
+        brec[3 + 2 * i] = (uint8_t)s->buckets[first + i];
+        brec[4 + 2 * i] = (uint8_t)(s->buckets[first + i] >> 8);
+      }
+      telemetrySendRecord(brec, sizeof(brec), TELEMETRY_PRIO_CRITICAL);
+    }
+  }
+  telemetryFlush();
+}
+
+static void onProfCommand(const char *args) {
+  if (strncmp(args, "reset", 5) == 0) {
+    profilerReset();
+  } else {
+    profilerDump();
+  }
+}
+
+void profilerBegin() {
+  serialCommandRegister("prof", onProfCommand);
+}
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * Ramp state estimator - see ramp_estimator.h
+ * Without an accelerometer the phases come from commanded travel while on
+ * black tape, and the top needs the lines to have run out as well; with one,
+ * pitch drives the phases. Either way commanded travel is checked against
+ * what is observed: far more travel than the ramp is long with the ramp still
+ * under the robot is slip, not progress. A rebaseline after a back-off
+ * clears the verdict and gives the retry a shorter budget of its own.
+ */
+
+#include <Arduino.h>
+#include "ramp_estimator.h"
+
+#ifdef UTRA_RAMP_ACCEL_MPU6050
+#include <Wire.h>
+#endif
+
+// --- Course / drivetrain (measure on the practice table) ---
+const long RAMP_LENGTH_MM = 600;
+const long FULL_PWM_SPEED_MM_S = 450;     // on the flat at PWM 255
+const long RAMP_EFFICIENCY_PCT = 60;      // speed lost to the incline
+const unsigned long CLIMB_DWELL_MS = 200; // black dwell that means we are on the ramp
+const unsigned long OFF_BLACK_HOLD_MS = 300;
+
+// --- Pitch thresholds (tenths of a degree) ---
+const int CLIMB_PITCH_D10 = 60;
+const int CREST_PITCH_D10 = 40;   // pitch falling back as the front wheels crest
+const int LEVEL_PITCH_D10 = 20;
+const unsigned long MID_MIN_MS = 250;
+
+// --- Phase progress as a percentage of RAMP_LENGTH_MM (no-accel path) ---
+const long MID_TRAVEL_PCT = 30;
+const long CREST_TRAVEL_PCT = 80;
+// Commanded this far with the ramp still under the robot: slipping or stuck.
+const long SLIP_TRAVEL_PCT = 150;
+// After a back-off: a retry that freed it is off the ramp (or over the
+// crest) within this much more, and one that didn't is caught in ~1 s.
+const long RETRY_SLIP_TRAVEL_PCT = 25;
+
+// --- Throttle per phase, percent of the caller's ramp speed ---
+const int APPROACH_THROTTLE_PCT = 90;
+const int CLIMB_THROTTLE_PCT = 105;
+const int MID_THROTTLE_PCT = 95;
+const int CREST_THROTTLE_PCT = 60;
+const int TOP_THROTTLE_PCT = 45;
+
+static void setPhase(RampEstimator *est, RampPhase phase, unsigned long nowMs) {
+  est->phase = phase;
+  est->phaseStartMs = nowMs;
+}
+
+static long travelPct(long travelUm) {
+  return travelUm / 10L / RAMP_LENGTH_MM;
+}
+
+void rampEstimatorBegin(RampEstimator *est, unsigned long nowMs, RampAccelReader reader) {
+  est->phase = RAMP_PHASE_APPROACH;
+  est->phaseStartMs = nowMs;
+  est->lastUpdateMs = nowMs;
+  est->blackDwellMs = 0;
+  est->offBlackMs = 0;
+  est->travelUm = 0;
+  est->slipBaseUm = 0;
+  est->pitchDeg10 = 0;
+  est->pitchValid = false;
+  est->slipping = false;
+  est->readAccel = reader;
+}
+
+void rampEstimatorUpdate(RampEstimator *est, unsigned long nowMs, bool onBlack, int commandedPwm) {
+  unsigned long dt = nowMs - est->lastUpdateMs;
+  est->lastUpdateMs = nowMs;
+
+  // Commanded travel only counts while we can see the ramp lines; off the
+  // line the robot is hunting, not climbing.
+  if (onBlack) {
+    est->blackDwellMs += dt;
+    est->offBlackMs = 0;
+    long speed = (long)constrain(commandedPwm, 0, 255) * FULL_PWM_SPEED_MM_S / 255;
+    if (est->phase != RAMP_PHASE_APPROACH) {
+      speed = speed * RAMP_EFFICIENCY_PCT / 100;
+    }
+    est->travelUm += speed * (long)dt;   // mm/s * ms
+  } else {
+    est->offBlackMs += dt;
+  }
+
+  int16_t ax, az;
+  if (est->readAccel != NULL && est->readAccel(&ax, &az)) {
+    int pitch = (int)(atan2((float)ax, (float)az) * (1800.0f / PI));
+    est->pitchDeg10 = est->pitchValid ? (est->pitchDeg10 * 3 + pitch) / 4 : pitch;
+    est->pitchValid = true;
+  }
+
+  unsigned long inPhase = nowMs - est->phaseStartMs;
+  long pct = travelPct(est->travelUm);
+
+  // Commanded against observed progress: the ramp is still under the robot
+  // if it is still pitched up or, without an accelerometer, still on the
+  // ramp lines.
+  bool onRamp = est->pitchValid ? est->pitchDeg10 >= CREST_PITCH_D10 : est->offBlackMs == 0;
+  est->slipping = est->phase >= RAMP_PHASE_CLIMB && est->phase <= RAMP_PHASE_CREST && onRamp &&
+                  travelPct(est->travelUm - est->slipBaseUm) >= SLIP_TRAVEL_PCT;
+
+  switch (est->phase) {
+    case RAMP_PHASE_APPROACH:
+      if (est->pitchValid ? est->pitchDeg10 > CLIMB_PITCH_D10 : est->blackDwellMs >= CLIMB_DWELL_MS) {
+        est->travelUm = 0;
+        est->slipBaseUm = 0;
+        setPhase(est, RAMP_PHASE_CLIMB, nowMs);
+      }
+      break;
+
+    case RAMP_PHASE_CLIMB:
+      if (est->pitchValid ? inPhase >= MID_MIN_MS : pct >= MID_TRAVEL_PCT) {
+        setPhase(est, RAMP_PHASE_MID, nowMs);
+      }
+      break;
+
+    case RAMP_PHASE_MID:
+      if (est->pitchValid ? est->pitchDeg10 < CREST_PITCH_D10 : pct >= CREST_TRAVEL_PCT) {
+        setPhase(est, RAMP_PHASE_CREST, nowMs);
+      }
+      break;
+
+    case RAMP_PHASE_CREST:
+      // Without pitch, commanded travel only says the top is near; the
+      // lines running out says the robot got there.
+      if (est->pitchValid ? est->pitchDeg10 < LEVEL_PITCH_D10 : est->offBlackMs >= OFF_BLACK_HOLD_MS) {
+        setPhase(est, RAMP_PHASE_TOP, nowMs);
+      }
+      break;
+
+    case RAMP_PHASE_TOP:
+      break;
+  }
+}
+
+int rampThrottle(const RampEstimator *est, int rampSpeed) {
+  int pct;
+  switch (est->phase) {
+    case RAMP_PHASE_APPROACH: pct = APPROACH_THROTTLE_PCT; break;
+    case RAMP_PHASE_CLIMB:    pct = CLIMB_THROTTLE_PCT; break;
+    case RAMP_PHASE_MID:      pct = MID_THROTTLE_PCT; break;
+    case RAMP_PHASE_CREST:    pct = CREST_THROTTLE_PCT; break;
+    default:                  pct = TOP_THROTTLE_PCT; break;
+  }
+  // Lost the line mid-climb: hold enough torque not to roll back.
+  if (est->offBlackMs > OFF_BLACK_HOLD_MS && est->phase >= RAMP_PHASE_CLIMB &&
+      est->phase <= RAMP_PHASE_MID) {
+    pct = MID_THROTTLE_PCT;
+  }
+  // Not getting the travel it is commanded: climbing torque, not braking.
+  if (est->slipping) pct = CLIMB_THROTTLE_PCT;
+  return constrain((long)rampSpeed * pct / 100, 0, 255);
+}
+
+bool rampIsAtTop(const RampEstimator *est) {
+  return est->phase >= RAMP_PHASE_CREST;
+}
+
+bool rampIsSlipping(const RampEstimator *est) {
+  return est->slipping;
+}
+
+void rampEstimatorRebaseline(RampEstimator *est) {
+  est->slipBaseUm = est->travelUm - (SLIP_TRAVEL_PCT - RETRY_SLIP_TRAVEL_PCT) * 10L * RAMP_LENGTH_MM;
+  est->slipping = false;
+}
+
+// ========== MPU-6050 (I2C 0x68) ==========
+#ifdef UTRA_RAMP_ACCEL_MPU6050
+const uint8_t MPU6050_ADDR = 0x68;
+
+bool mpu6050Begin() {
+  Wire.begin();
+  Wire.beginTransmission(MPU6050_ADDR);
+  Wire.write(0x6B);  // PWR_MGMT_1: wake up
+  Wire.write(0);
+  return Wire.endTransmission() == 0;
+}
+
+bool mpu6050ReadAccel(int16_t *ax, int16_t *az) {
+  Wire.beginTransmission(MPU6050_ADDR);
+  Wire.write(0x3B);  // ACCEL_XOUT_H
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom(MPU6050_ADDR, (uint8_t)6) != 6) return false;
+  uint8_t b[6];
+  for (int i = 0; i < 6; i++) b[i] = Wire.read();
+  *ax = (int16_t)((b[0] << 8) | b[1]);
+  *az = (int16_t)((b[4] << 8) | b[5]);
+  return true;
+}
+#endif
+
+// ========== Simulated accelerometer ==========
+static float simulatedPitchDeg = 0.0f;
+static bool simulatedAccelFitted = true;
+
+void simulatedAccelSetPitch(float degrees) {
+  simulatedPitchDeg = degrees;
+}
+
+void simulatedAccelSetFitted(bool fitted) {
+  simulatedAccelFitted = fitted;
+}
+
+bool simulatedAccelRead(int16_t *ax, int16_t *az) {
+  if (!simulatedAccelFitted) return false;
+  float rad = simulatedPitchDeg * (PI / 180.0f);
+  *ax = (int16_t)(RAMP_ACCEL_1G * sin(rad));
+  *az = (int16_t)(RAMP_ACCEL_1G * cos(rad));
+  return true;
+}
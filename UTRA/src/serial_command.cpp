@@ -0,0 +1,51 @@
+/**
+ * Line-based serial commands - see serial_command.h
+ */
+
+#include <Arduino.h>
+#include "serial_command.h"
+
+typedef struct {
+  const char *name;
+  SerialCommandHandler handler;
+} SerialCommand;
+
+static SerialCommand commands[SERIAL_COMMAND_MAX];
+static int commandCount = 0;
+static char line[SERIAL_COMMAND_LINE];
+static int lineLen = 0;
+
+bool serialCommandRegister(const char *name, SerialCommandHandler handler) {
+  if (commandCount >= SERIAL_COMMAND_MAX) return false;
+  commands[commandCount].name = name;
+  commands[commandCount].handler = handler;
+  commandCount++;
+  return true;
+}
+
+static void dispatch() {
+  for (int i = 0; i < commandCount; i++) {
+    size_t n = strlen(commands[i].name);
+    if (strncmp(line, commands[i].name, n) == 0 && (line[n] == '\0' || line[n] == ' ')) {
+      const char *args = line + n;
+      while (*args == ' ') args++;
+      commands[i].handler(args);
+      return;
+    }
+  }
+}
+
+void serialCommandPoll() {
+  while (Serial.available() > 0) {
+    char c = (char)Serial.read();
+    if (c == '\n' || c == '\r') {
+      if (lineLen > 0) {
+        line[lineLen] = '\0';
+        dispatch();
+      }
+      lineLen = 0;
+    } else if (lineLen < SERIAL_COMMAND_LINE - 1) {
+      line[lineLen++] = c;
+    }
+  }
+}
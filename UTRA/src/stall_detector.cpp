@@ -0,0 +1,125 @@
+/**
+ * Stall and wheel-slip detector - see stall_detector.h
+ */
+
+#include <Arduino.h>
+#include "stall_detector.h"
+
+void stallBegin(StallDetector *d, unsigned long nowMs, unsigned long windowMs,
+                unsigned long backoffMs, uint8_t maxRetries) {
+  d->phase = STALL_PHASE_WATCH;
+  d->phaseStartMs = nowMs;
+  d->progressMs = nowMs;
+  d->tickMs = nowMs;
+  d->overCurrentMs = nowMs;
+  d->slipMs = nowMs;
+  d->driving = false;
+  d->hasEncoders = false;
+  d->overCurrent = false;
+  d->slipping = false;
+  d->hasColour = false;
+  d->colour = 0;
+  d->rangeCm = -1;
+  d->retries = 0;
+  d->maxRetries = maxRetries;
+  d->windowMs = windowMs;
+  d->backoffMs = backoffMs;
+}
+
+// Still getting somewhere a window after the back-off: the retry worked.
+static void noteProgress(StallDetector *d, unsigned long nowMs) {
+  if (d->phase == STALL_PHASE_WATCH && nowMs - d->phaseStartMs >= d->windowMs) d->retries = 0;
+  d->progressMs = nowMs;
+}
+
+void stallNoteColour(StallDetector *d, unsigned long nowMs, uint8_t colour) {
+  if (d->hasColour && colour != d->colour) noteProgress(d, nowMs);
+  d->colour = colour;
+  d->hasColour = true;
+}
+
+void stallNoteRange(StallDetector *d, unsigned long nowMs, int cm) {
+  if (cm <= 0) return;
+  if (d->rangeCm < 0) {
+    d->rangeCm = cm;
+  } else if (abs(cm - d->rangeCm) >= STALL_RANGE_STEP_CM) {
+    d->rangeCm = cm;
+    noteProgress(d, nowMs);
+  }
+}
+
+void stallNoteTicks(StallDetector *d, unsigned long nowMs, int ticks) {
+  if (ticks == 0) return;
+  d->hasEncoders = true;
+  d->tickMs = nowMs;
+  noteProgress(d, nowMs);
+}
+
+void stallNoteMoving(StallDetector *d, unsigned long nowMs, bool moving) {
+  if (moving) noteProgress(d, nowMs);
+}
+
+void stallNoteCurrent(StallDetector *d, unsigned long nowMs, uint16_t mA, uint16_t limitMa) {
+  if (mA < limitMa) {
+    d->overCurrent = false;
+  } else if (!d->overCurrent) {
+    d->overCurrent = true;
+    d->overCurrentMs = nowMs;
+  }
+}
+
+void stallNoteSlipping(StallDetector *d, unsigned long nowMs, bool slipping) {
+  if (!slipping) {
+    d->slipping = false;
+  } else if (!d->slipping) {
+    d->slipping = true;
+    d->slipMs = nowMs;
+  }
+}
+
+bool stallUpdate(StallDetector *d, unsigned long nowMs, bool driving) {
+  switch (d->phase) {
+    case STALL_PHASE_WATCH: {
+      if (!driving) {
+        d->driving = false;
+        return false;
+      }
+      // Time spent stopped or turning is not time without progress.
+      if (!d->driving) {
+        d->driving = true;
+        d->progressMs = nowMs;
+        d->tickMs = nowMs;
+      }
+      bool stalled = nowMs - d->progressMs >= d->windowMs ||
+                     (d->hasEncoders && nowMs - d->tickMs >= STALL_ENCODER_MS) ||
+                     (d->overCurrent && nowMs - d->overCurrentMs >= STALL_CURRENT_MS) ||
+                     (d->slipping && nowMs - d->slipMs >= STALL_SLIP_MS);
+      if (!stalled) return false;
+      if (d->retries >= d->maxRetries) {
+        d->phase = STALL_PHASE_OFF;
+        return false;
+      }
+      d->retries++;
+      d->phase = STALL_PHASE_BACK_OFF;
+      d->phaseStartMs = nowMs;
+      return true;
+    }
+
+    case STALL_PHASE_BACK_OFF:
+      if (nowMs - d->phaseStartMs < d->backoffMs) return true;
+      d->phase = STALL_PHASE_WATCH;
+      d->phaseStartMs = nowMs;
+      d->driving = false;
+      d->overCurrent = false;
+      d->slipping = false;
+      return stallUpdate(d, nowMs, driving);
+
+    case STALL_PHASE_OFF:
+      break;
+  }
+  return false;
+}
+
+int stallRetryPwm(const StallDetector *d, int pwm, int stepPwm) {
+  return (int)constrain((long)pwm + (long)d->retries * stepPwm, 0L, 255L);
+}
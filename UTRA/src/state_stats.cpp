@@ -0,0 +1,112 @@
+/**
+ * Per-state time accounting - see state_stats.h
+ */
+
+#include <Arduino.h>
+#include "state_stats.h"
+#include "telemetry.h"
+
+// A reset that is not a power cycle leaves RAM intact, so a counter kept in
+// .noinit (not zeroed by the C runtime) counts the resets of this attempt.
+#ifdef __AVR__
+const uint32_t RESET_MAGIC = 0x55AA7E57UL;
+static uint32_t resetMagic __attribute__((section(".noinit")));
+static uint8_t resetCount __attribute__((section(".noinit")));
+#else
+static uint8_t resetCount = 0;
+#endif
+static bool resetCounted = false;
+static const StateStats *activeStats = NULL;
+
+uint8_t stateStatsResetCount() {
+  if (!resetCounted) {
+    resetCounted = true;
+#ifdef __AVR__
+    if (resetMagic == RESET_MAGIC) {
+      if (resetCount < 255) resetCount++;
+    } else {
+      resetMagic = RESET_MAGIC;
+      resetCount = 0;
+    }
+#endif
+  }
+  return resetCount;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void closeStay(StateStats *stats, uint32_t nowMs) {
+  if (stats->current >= stats->count) return;
+  StateTime &t = stats->slots[stats->current];
+  uint32_t stay = nowMs - stats->enteredMs;
+  t.totalMs += stay;
+  if (stay > t.longestMs) t.longestMs = stay;
+}
+
+void stateStatsBegin(StateStats *stats, uint8_t machine, StateTime *slots, uint8_t count,
+                     uint8_t initial, uint32_t nowMs) {
+  stateStatsResetCount();
+  stats->slots = slots;
+  stats->count = count;
+  stats->machine = machine;
+  stats->runStartMs = nowMs;
+  stats->finished = false;
+  memset(slots, 0, sizeof(StateTime) * count);
+  stats->current = initial;
+  stats->enteredMs = nowMs;
+  if (initial < count) slots[initial].entries = 1;
+  activeStats = stats;
+}
+
+void stateStatsEnter(StateStats *stats, uint8_t state, uint32_t nowMs) {
+  if (stats->finished || state == stats->current) return;
+  closeStay(stats, nowMs);
+  stats->current = state;
+  stats->enteredMs = nowMs;
+  activeStats = stats;
+  if (state < stats->count && stats->slots[state].entries < 0xFFFF) {
+    stats->slots[state].entries++;
+  }
+}
+
+uint32_t stateStatsElapsed(const StateStats *stats, uint32_t nowMs) {
+  return nowMs - stats->runStartMs;
+}
+
+const StateStats *stateStatsActive() {
+  return activeStats;
+}
+
+void stateStatsFinish(StateStats *stats, uint32_t nowMs) {
+  if (stats->finished) return;
+  closeStay(stats, nowMs);
+  stats->finished = true;
+
+  uint8_t summary[7];
+  summary[0] = TELEMETRY_RUN_SUMMARY;
+  summary[1] = stats->machine;
+  put32(summary + 2, stateStatsElapsed(stats, nowMs));
+  summary[6] = stateStatsResetCount();
+  telemetrySendRecord(summary, sizeof(summary), TELEMETRY_PRIO_CRITICAL);
+
+  for (uint8_t s = 0; s < stats->count; s++) {
+    const StateTime &t = stats->slots[s];
+    if (t.entries == 0) continue;
+    uint8_t rec[13];
+    rec[0] = TELEMETRY_STATE_TIME;
+    rec[1] = stats->machine;
+    rec[2] = s;
+    put16(rec + 3, t.entries);
+    put32(rec + 5, t.totalMs);
+    put32(rec + 9, t.longestMs);
+    telemetrySendRecord(rec, sizeof(rec), TELEMETRY_PRIO_CRITICAL);
+  }
+}
@@ -0,0 +1,252 @@
+/**
+ * Binary telemetry - see telemetry.h for the record layouts.
+ */
+
+#include <Arduino.h>
+#include "profiler.h"
+#include "telemetry.h"
+
+// Bump whenever a record layout changes; sent in the HELLO record.
+const uint8_t TELEMETRY_SCHEMA_VERSION PROGMEM = 4;
+
+// Longest a critical send waits on the UART: two 17-byte frames at 115200.
+const unsigned long TELEMETRY_CRITICAL_WAIT_US = 3000;
+
+// ========== Frame rings ==========
+// Each entry is [len][frame bytes], stored contiguously with wrap-around.
+typedef struct {
+  uint8_t *buf;
+  uint16_t size;
+  uint16_t head;   // next write
+  uint16_t tail;   // oldest entry
+  uint16_t used;
+} FrameRing;
+
+static uint8_t sampleBuf[UTRA_TELEMETRY_SAMPLE_RING];
+static uint8_t criticalBuf[UTRA_TELEMETRY_CRITICAL_RING];
+static FrameRing sampleRing = { sampleBuf, UTRA_TELEMETRY_SAMPLE_RING, 0, 0, 0 };
+static FrameRing criticalRing = { criticalBuf, UTRA_TELEMETRY_CRITICAL_RING, 0, 0, 0 };
+static TelemetryStats stats;
+static TelemetryTap tap = NULL;
+#ifdef UTRA_HOST
+static TelemetryTap hostTap = NULL;
+#endif
+
+static uint8_t ringPeekLen(const FrameRing *r) {
+  return r->used ? r->buf[r->tail] : 0;
+}
+
+static void ringPop(FrameRing *r) {
+  uint16_t n = (uint16_t)ringPeekLen(r) + 1;
+  r->tail = (uint16_t)((r->tail + n) % r->size);
+  r->used -= n;
+}
+
+static void ringPush(FrameRing *r, const uint8_t *frame, uint8_t len) {
+  r->buf[r->head] = len;
+  r->head = (uint16_t)((r->head + 1) % r->size);
+  for (uint8_t i = 0; i < len; i++) {
+    r->buf[r->head] = frame[i];
+    r->head = (uint16_t)((r->head + 1) % r->size);
+  }
+  r->used += (uint16_t)len + 1;
+}
+
+static bool ringFits(const FrameRing *r, uint8_t len) {
+  return (uint16_t)(r->size - r->used) >= (uint16_t)len + 1;
+}
+
+// Writes the oldest frame if the UART buffer can take all of it.
+static bool sendOldest(FrameRing *r) {
+  uint8_t len = ringPeekLen(r);
+  if (len == 0 || Serial.availableForWrite() < len) return false;
+  uint16_t p = (uint16_t)((r->tail + 1) % r->size);
+  uint16_t firstRun = (uint16_t)(r->size - p);
+  if (firstRun >= len) {
+    Serial.write(r->buf + p, len);
+  } else {
+    Serial.write(r->buf + p, firstRun);
+    Serial.write(r->buf, len - firstRun);
+  }
+  ringPop(r);
+  return true;
+}
+
+void telemetryPump() {
+  // Critical frames go first, but only whole frames are ever written, so the
+  // two streams never interleave mid-frame.
+  while (sendOldest(&criticalRing)) {}
+  while (criticalRing.used == 0 && sendOldest(&sampleRing)) {}
+}
+
+void telemetryFlush() {
+  while (criticalRing.used > 0 || sampleRing.used > 0) {
+    telemetryPump();
+  }
+}
+
+void telemetrySetTap(TelemetryTap t) {
+  tap = t;
+}
+
+#ifdef UTRA_HOST
+void telemetrySetHostTap(TelemetryTap t) {
+  hostTap = t;
+}
+#endif
+
+static void tapRecord(const uint8_t *rec, uint8_t len) {
+  if (tap != NULL) tap(rec, len);
+#ifdef UTRA_HOST
+  if (hostTap != NULL) hostTap(rec, len);
+#endif
+}
+
+const TelemetryStats *telemetryStats() {
+  return &stats;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+uint16_t telemetryCrc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Consistent Overhead Byte Stuffing; output has no zero bytes and is at most
+// len + len/254 + 1 long. The caller appends the 0x00 delimiter.
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t codeIdx = 0;
+  size_t o = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (in[i] == 0) {
+      out[codeIdx] = code;
+      codeIdx = o++;
+      code = 1;
+    } else {
+      out[o++] = in[i];
+      code++;
+      if (code == 0xFF) {
+        out[codeIdx] = code;
+        codeIdx = o++;
+        code = 1;
+      }
+    }
+  }
+  out[codeIdx] = code;
+  return o;
+}
+
+void telemetrySendRecord(const uint8_t *payload, uint8_t len, TelemetryPriority prio) {
+  uint8_t raw[TELEMETRY_MAX_PAYLOAD + 2];
+  uint8_t frame[TELEMETRY_MAX_FRAME];
+  if (len > TELEMETRY_MAX_PAYLOAD) return;
+
+  memcpy(raw, payload, len);
+  put16(raw + len, telemetryCrc16(payload, len));
+  size_t n = cobsEncode(raw, len + 2, frame);
+  frame[n++] = 0x00;
+
+  if (prio == TELEMETRY_PRIO_CRITICAL) {
+    if (!ringFits(&criticalRing, n)) {
+      // State changes outpacing the link. Give the UART a couple of frame
+      // times to make room, then drop the oldest rather than stall the loop.
+      stats.criticalStalls++;
+      unsigned long start = micros();
+      while (!ringFits(&criticalRing, n) && micros() - start < TELEMETRY_CRITICAL_WAIT_US) {
+        sendOldest(&criticalRing);
+      }
+      while (!ringFits(&criticalRing, n)) {
+        ringPop(&criticalRing);
+        stats.criticalDropped++;
+      }
+    }
+    ringPush(&criticalRing, frame, n);
+    stats.criticalQueued++;
+  } else {
+    while (!ringFits(&sampleRing, n)) {
+      ringPop(&sampleRing);
+      stats.samplesDropped++;
+    }
+    ringPush(&sampleRing, frame, n);
+    stats.samplesQueued++;
+  }
+  telemetryPump();
+}
+
+uint8_t telemetryPackSensor(uint8_t *out, const SensorFrame *frame, uint8_t state) {
+  out[0] = TELEMETRY_SENSOR;
+  out[1] = state;
+  put16(out + 2, (uint16_t)frame->tMs);
+  put16(out + 4, frame->redPW);
+  put16(out + 6, frame->greenPW);
+  put16(out + 8, frame->bluePW);
+  out[10] = frame->colour;
+  put16(out + 11, frame->distanceCm);
+  return TELEMETRY_SENSOR_LEN;
+}
+
+uint8_t telemetryPackLine(uint8_t *out, const SensorFrame *frame, uint8_t state) {
+  out[0] = TELEMETRY_LINE;
+  out[1] = state;
+  put16(out + 2, (uint16_t)frame->tMs);
+  put16(out + 4, (uint16_t)frame->linePos);
+  put16(out + 6, frame->lineWidth);
+  return TELEMETRY_LINE_LEN;
+}
+
+void telemetryBegin(unsigned long baud) {
+  Serial.begin(baud);
+  uint8_t hello[3];
+  hello[0] = TELEMETRY_HELLO;
+  hello[1] = pgm_read_byte(&TELEMETRY_SCHEMA_VERSION);
+  hello[2] = TELEMETRY_SENSOR_LEN;
+  telemetrySendRecord(hello, sizeof(hello), TELEMETRY_PRIO_CRITICAL);
+}
+
+void telemetrySendSensor(const SensorFrame *frame, uint8_t state) {
+  PROFILE_SCOPE("telem");
+  uint8_t rec[TELEMETRY_SENSOR_LEN];
+  telemetryPackSensor(rec, frame, state);
+  tapRecord(rec, TELEMETRY_SENSOR_LEN);
+  telemetrySendRecord(rec, TELEMETRY_SENSOR_LEN);
+  // Without an array both stay 0; a lost line keeps its last side.
+  if (frame->lineWidth == 0 && frame->linePos == 0) return;
+  telemetryPackLine(rec, frame, state);
+  tapRecord(rec, TELEMETRY_LINE_LEN);
+  telemetrySendRecord(rec, TELEMETRY_LINE_LEN);
+}
+
+void telemetrySendState(uint8_t machine, uint8_t state, uint32_t tMs) {
+  uint8_t rec[TELEMETRY_STATE_LEN];
+  rec[0] = TELEMETRY_STATE;
+  rec[1] = state;
+  put32(rec + 2, tMs);
+  rec[6] = machine;
+  tapRecord(rec, TELEMETRY_STATE_LEN);
+  telemetrySendRecord(rec, TELEMETRY_STATE_LEN, TELEMETRY_PRIO_CRITICAL);
+}
+
+void telemetrySendBattery(uint16_t millivolts, uint32_t tMs) {
+  uint8_t rec[TELEMETRY_BATTERY_LEN];
+  rec[0] = TELEMETRY_BATTERY;
+  rec[1] = 0;
+  put16(rec + 2, (uint16_t)tMs);
+  put16(rec + 4, millivolts);
+  telemetrySendRecord(rec, TELEMETRY_BATTERY_LEN);
+}
@@ -0,0 +1,91 @@
+/**
+ * Pack voltage sense and output scaling (battery.h), on the host HAL.
+ */
+
+#include <unity.h>
+#include "Arduino.h"
+#include "hal_host.h"
+#include "battery.h"
+
+static int adcCounts = 0;
+
+static int divider(uint8_t pin) {
+  (void)pin;
+  return adcCounts;
+}
+
+// ADC counts for a pack voltage through the divider.
+static int countsFor(uint32_t mv) {
+  return (int)(mv * 1023UL * 10 / (5000UL * UTRA_BATTERY_DIVIDER_X10));
+}
+
+static void settle(uint32_t mv) {
+  adcCounts = countsFor(mv);
+  for (int i = 0; i < 200; i++) {
+    delay(BATTERY_SAMPLE_MS);
+    batteryUpdate();
+  }
+}
+
+void setUp() {
+  hostReset();
+  hostSetAnalogSource(divider);
+  batteryBegin(A0);
+}
+
+void tearDown() {}
+
+void test_first_sample_reports_and_reads_the_divider() {
+  adcCounts = countsFor(BATTERY_NOMINAL_MV);
+  TEST_ASSERT_TRUE(batteryUpdate());
+  TEST_ASSERT_INT_WITHIN(20, BATTERY_NOMINAL_MV, batteryMillivolts());
+  TEST_ASSERT_FALSE(batteryUpdate());   // inside BATTERY_SAMPLE_MS
+}
+
+void test_nominal_pack_scales_nothing() {
+  settle(BATTERY_NOMINAL_MV);
+  TEST_ASSERT_INT_WITHIN(2, 200, batteryScalePwm(200));
+  TEST_ASSERT_INT_WITHIN(10, 1000, (int)batteryScaleMs(1000));
+}
+
+void test_sagging_pack_gets_more_output() {
+  settle(6000);
+  TEST_ASSERT_INT_WITHIN(3, 200 * BATTERY_NOMINAL_MV / 6000, batteryScalePwm(200));
+  TEST_ASSERT_EQUAL_INT(255, batteryScalePwm(240));
+  TEST_ASSERT_EQUAL_INT(-255, batteryScalePwm(-240));
+  TEST_ASSERT_GREATER_THAN(1000, (int)batteryScaleMs(1000));
+}
+
+void test_full_pack_gets_less_output() {
+  settle(8400);
+  TEST_ASSERT_INT_WITHIN(3, 200 * BATTERY_NOMINAL_MV / 8400, batteryScalePwm(200));
+}
+
+void test_no_pack_leaves_output_alone() {
+  settle(0);
+  TEST_ASSERT_EQUAL_INT(200, batteryScalePwm(200));
+  TEST_ASSERT_EQUAL_UINT32(1000, batteryScaleMs(1000));
+}
+
+void test_reports_once_per_log_interval() {
+  adcCounts = countsFor(BATTERY_NOMINAL_MV);
+  int reports = 0;
+  for (int i = 0; i < 3 * (BATTERY_LOG_SAMPLES + 1); i++) {
+    if (batteryUpdate()) reports++;
+    delay(BATTERY_SAMPLE_MS);
+  }
+  TEST_ASSERT_EQUAL_INT(3, reports);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_first_sample_reports_and_reads_the_divider);
+  RUN_TEST(test_nominal_pack_scales_nothing);
+  RUN_TEST(test_sagging_pack_gets_more_output);
+  RUN_TEST(test_full_pack_gets_less_output);
+  RUN_TEST(test_no_pack_leaves_output_alone);
+  RUN_TEST(test_reports_once_per_log_interval);
+  return UNITY_END();
+}
@@ -0,0 +1,103 @@
+/**
+ * Integer colour classifiers (colour_classifier.h).
+ */
+
+#include <unity.h>
+#include "colour_classifier.h"
+
+const uint16_t WHITE_US = 60;
+const uint16_t BLACK_US = 200;
+
+void setUp() {}
+void tearDown() {}
+
+void test_thresholds_black_white_and_shortest_channel() {
+  ColourReading r;
+  colourReadThresholds(300, 320, 310, WHITE_US, BLACK_US, &r);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_BLACK, r.colour);
+  colourReadThresholds(30, 35, 32, WHITE_US, BLACK_US, &r);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_WHITE, r.colour);
+  colourReadThresholds(50, 150, 140, WHITE_US, BLACK_US, &r);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_RED, r.colour);
+  colourReadThresholds(150, 140, 50, WHITE_US, BLACK_US, &r);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_BLUE, r.colour);
+  colourReadThresholds(80, 80, 150, WHITE_US, BLACK_US, &r);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_RED, r.colour);   // red wins ties
+}
+
+void test_confidence_grows_with_margin() {
+  ColourReading close, clear;
+  colourReadThresholds(100, 104, 150, WHITE_US, BLACK_US, &close);
+  colourReadThresholds(70, 150, 150, WHITE_US, BLACK_US, &clear);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_RED, close.colour);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_RED, clear.colour);
+  TEST_ASSERT_LESS_THAN(clear.confidence, close.confidence);
+}
+
+void test_shares_sum_to_about_one() {
+  ColourReading r;
+  colourReadThresholds(50, 150, 140, WHITE_US, BLACK_US, &r);
+  int sum = r.share[0] + r.share[1] + r.share[2];
+  TEST_ASSERT_INT_WITHIN(3, 255, sum);
+  TEST_ASSERT_GREATER_THAN(r.share[1], r.share[0]);   // red: most light
+}
+
+void test_normalize_maps_references_to_the_ends() {
+  ColourTracker t;
+  colourTrackerBegin(&t, WHITE_US, BLACK_US);
+  uint16_t white[3] = { WHITE_US, WHITE_US, WHITE_US };
+  uint16_t black[3] = { BLACK_US, BLACK_US, 0 };
+  uint16_t refl[3];
+  colourNormalize(&t, white, refl);
+  TEST_ASSERT_INT_WITHIN(2, COLOUR_REFLECTANCE_ONE, refl[0]);
+  colourNormalize(&t, black, refl);
+  TEST_ASSERT_INT_WITHIN(2, 0, refl[0]);
+  TEST_ASSERT_EQUAL_UINT16(0, refl[2]);   // timeout reads as black
+}
+
+void test_adaptive_follows_a_darker_room() {
+  ColourTracker t;
+  colourTrackerBegin(&t, WHITE_US, BLACK_US);
+  // dimmer white: not white against the starting references ...
+  TEST_ASSERT_NOT_EQUAL(COLOUR_WHITE, colourClassifyAdaptive(&t, 95, 95, 95));
+  // ... but once the table has read clearly white a few times a little
+  // dimmer, the white reference has moved toward it
+  for (int i = 0; i < 40; i++) colourClassifyAdaptive(&t, 75, 75, 75);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_WHITE, colourClassifyAdaptive(&t, 95, 95, 95));
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_BLACK, colourClassifyAdaptive(&t, 300, 300, 300));
+}
+
+void test_tree_model_picks_labels() {
+  static const uint8_t labels[] = { COLOUR_WHITE, COLOUR_BLACK };
+  static const ColourTreeNode tree[] = { { 0, 120, ~0, ~1 } };
+  ColourModel model = { 2, labels, NULL, tree };
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_WHITE, colourClassify(&model, 40, 40, 40));
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_BLACK, colourClassify(&model, 250, 250, 250));
+  TEST_ASSERT_EQUAL_UINT8(1, colourModelClass(&model, 250, 250, 250));
+}
+
+void test_linear_model_highest_score_wins() {
+  static const uint8_t labels[] = { COLOUR_RED, COLOUR_BLUE };
+  // red: short red width; blue: short blue width
+  static const ColourLinearTerm linear[] = { { { -2, 1, 1 }, 0 }, { { 1, 1, -2 }, 0 } };
+  ColourModel model = { 2, labels, linear, NULL };
+  ColourReading r;
+  colourReadModel(&model, 50, 150, 140, &r);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_RED, r.colour);
+  colourReadModel(&model, 150, 140, 50, &r);
+  TEST_ASSERT_EQUAL_UINT8(COLOUR_BLUE, r.colour);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_thresholds_black_white_and_shortest_channel);
+  RUN_TEST(test_confidence_grows_with_margin);
+  RUN_TEST(test_shares_sum_to_about_one);
+  RUN_TEST(test_normalize_maps_references_to_the_ends);
+  RUN_TEST(test_adaptive_follows_a_darker_room);
+  RUN_TEST(test_tree_model_picks_labels);
+  RUN_TEST(test_linear_model_highest_score_wins);
+  return UNITY_END();
+}
@@ -0,0 +1,81 @@
+/**
+ * Single-producer/single-consumer event queue (event_queue.h).
+ */
+
+#include <unity.h>
+#include "event_queue.h"
+
+static EventQueue q;
+
+static Event make(uint16_t value) {
+  Event e = Event();
+  e.type = EVENT_PULSE;
+  e.source = 2;
+  e.value = value;
+  e.tUs = value * 10UL;
+  return e;
+}
+
+void setUp() {
+  eventQueueInit(&q);
+}
+
+void tearDown() {}
+
+void test_empty_queue_pops_nothing() {
+  Event e;
+  TEST_ASSERT_FALSE(eventPop(&q, &e));
+  TEST_ASSERT_EQUAL_UINT8(0, eventPending(&q));
+}
+
+void test_events_come_out_in_order() {
+  for (uint16_t v = 1; v <= 5; v++) {
+    Event e = make(v);
+    TEST_ASSERT_TRUE(eventPush(&q, &e));
+  }
+  TEST_ASSERT_EQUAL_UINT8(5, eventPending(&q));
+  for (uint16_t v = 1; v <= 5; v++) {
+    Event e;
+    TEST_ASSERT_TRUE(eventPop(&q, &e));
+    TEST_ASSERT_EQUAL_UINT16(v, e.value);
+    TEST_ASSERT_EQUAL_UINT32(v * 10UL, e.tUs);
+  }
+}
+
+void test_full_queue_drops_new_events_and_counts_them() {
+  for (uint16_t v = 0; v < EVENT_QUEUE_SIZE; v++) {
+    Event e = make(v);
+    TEST_ASSERT_TRUE(eventPush(&q, &e));
+  }
+  Event extra = make(999);
+  TEST_ASSERT_FALSE(eventPush(&q, &extra));
+  TEST_ASSERT_FALSE(eventPush(&q, &extra));
+  uint8_t seen = 0;
+  TEST_ASSERT_EQUAL_UINT8(2, eventDroppedSince(&q, &seen));
+  TEST_ASSERT_EQUAL_UINT8(0, eventDroppedSince(&q, &seen));
+  Event e;
+  TEST_ASSERT_TRUE(eventPop(&q, &e));
+  TEST_ASSERT_EQUAL_UINT16(0, e.value);   // the oldest survived
+}
+
+void test_indices_wrap_past_256() {
+  for (uint16_t v = 0; v < 1000; v++) {
+    Event e = make(v);
+    TEST_ASSERT_TRUE(eventPush(&q, &e));
+    Event out;
+    TEST_ASSERT_TRUE(eventPop(&q, &out));
+    TEST_ASSERT_EQUAL_UINT16(v, out.value);
+  }
+  TEST_ASSERT_EQUAL_UINT8(0, eventPending(&q));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_queue_pops_nothing);
+  RUN_TEST(test_events_come_out_in_order);
+  RUN_TEST(test_full_queue_drops_new_events_and_counts_them);
+  RUN_TEST(test_indices_wrap_past_256);
+  return UNITY_END();
+}
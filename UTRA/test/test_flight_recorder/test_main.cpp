@@ -0,0 +1,94 @@
+/**
+ * Flight recorder RAM ring (flight_recorder.h): which records it keeps and
+ * what a dump sends back, decoded the way trace replay reads a capture.
+ */
+
+#include <unity.h>
+#include <vector>
+#include "Arduino.h"
+#include "flight_recorder.h"
+#include "hal_host.h"
+#include "state_stats.h"
+#include "telemetry.h"
+#include "trace_replay.h"
+#include "virtual_clock.h"
+
+static std::vector<uint8_t> captured;
+
+static void sink(const uint8_t *data, size_t len) {
+  captured.insert(captured.end(), data, data + len);
+}
+
+void setUp() {
+  hostReset();
+  hostSetSerialSink(sink);
+  telemetryBegin();
+  flightRecorderBegin();
+  telemetrySetTap(NULL);   // log by hand, so only the dump reaches the capture
+  captured.clear();
+}
+
+void tearDown() {
+  hostSetSerialSink(NULL);
+}
+
+static void logSensor(unsigned long tMs) {
+  SensorFrame frame = SensorFrame();
+  frame.tMs = tMs;
+  uint8_t rec[TELEMETRY_SENSOR_LEN];
+  telemetryPackSensor(rec, &frame, 0);
+  flightRecorderLog(rec, sizeof(rec));
+}
+
+static Trace dumpRam(uint32_t lastMs) {
+  captured.clear();
+  flightRecorderDump(lastMs, RECORDER_SOURCE_RAM);
+  Trace trace;
+  traceDecodeTelemetry(captured.data(), captured.size(), &trace);
+  return trace;
+}
+
+// A frame every 10 ms for 5 s: one per UTRA_RECORDER_RAM_INTERVAL_MS is
+// kept, so the ring reaches back RECORDER_RAM_SPAN_MS, not 160 ms.
+void test_sensor_frames_are_decimated() {
+  for (unsigned long t = 0; t < 5000; t += 10) {
+    vclockAdvanceTo((uint64_t)t * 1000);
+    logSensor(millis());
+  }
+  Trace trace = dumpRam(0);
+  TEST_ASSERT_EQUAL_UINT32(UTRA_RECORDER_SLOTS, trace.samples.size());
+  uint32_t span = trace.samples.back().frame.tMs - trace.samples.front().frame.tMs;
+  TEST_ASSERT_UINT_WITHIN(UTRA_RECORDER_RAM_INTERVAL_MS, RECORDER_RAM_SPAN_MS, span);
+}
+
+void test_state_records_are_all_kept() {
+  for (uint8_t s = 0; s < 4; s++) {
+    vclockAdvanceBy(1000);
+    uint8_t rec[TELEMETRY_STATE_LEN] = { TELEMETRY_STATE, s, 0, 0, 0, 0, STATE_MACHINE_OBSTACLE };
+    rec[2] = (uint8_t)millis();
+    rec[3] = (uint8_t)(millis() >> 8);
+    flightRecorderLog(rec, sizeof(rec));
+    logSensor(millis());
+  }
+  Trace trace = dumpRam(0);
+  TEST_ASSERT_EQUAL_UINT32(4, trace.transitions.size());
+}
+
+void test_dump_window_past_the_ring_sends_everything() {
+  for (unsigned long t = 0; t < 5000; t += 10) {
+    vclockAdvanceTo((uint64_t)t * 1000);
+    logSensor(millis());
+  }
+  TEST_ASSERT_EQUAL_UINT32(UTRA_RECORDER_SLOTS, dumpRam(60000).samples.size());
+  TEST_ASSERT_EQUAL_UINT32(1000 / UTRA_RECORDER_RAM_INTERVAL_MS, dumpRam(1000).samples.size());
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_sensor_frames_are_decimated);
+  RUN_TEST(test_state_records_are_all_kept);
+  RUN_TEST(test_dump_window_past_the_ring_sends_everything);
+  return UNITY_END();
+}
@@ -0,0 +1,162 @@
+/**
+ * Host HAL shims (host/Arduino.h, host/Servo.h, hal_host.cpp): the Arduino
+ * API the sketches call must behave as the AVR core does.
+ */
+
+#include <unity.h>
+#include "Arduino.h"
+#include "Servo.h"
+#include "hal_host.h"
+#include "virtual_clock.h"
+
+static uint8_t sunk[16];
+static size_t sunkLen = 0;
+
+static void sink(const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len && sunkLen < sizeof(sunk); i++) sunk[sunkLen++] = data[i];
+}
+
+static int analogSource(uint8_t pin) {
+  return pin == A2 ? 512 : 7;
+}
+
+static unsigned long pulseSource(uint8_t pin, uint8_t state, unsigned long timeoutUs,
+                                 unsigned long *blockedUs) {
+  (void)state;
+  (void)timeoutUs;
+  if (pin != 6) return 0;
+  *blockedUs = 250;
+  return 120;
+}
+
+static void dropInput(void *ctx, uint64_t nowUs) {
+  (void)nowUs;
+  hostDriveInput(*(uint8_t *)ctx, LOW);
+}
+
+static void raiseInput(void *ctx, uint64_t nowUs) {
+  (void)nowUs;
+  hostDriveInput(*(uint8_t *)ctx, HIGH);
+}
+
+void setUp() {
+  hostReset();
+  sunkLen = 0;
+}
+
+void tearDown() {}
+
+void test_digital_write_sets_level_and_clears_pwm() {
+  pinMode(9, OUTPUT);
+  analogWrite(9, 100);
+  TEST_ASSERT_EQUAL_INT(100, hostPwmValue(9));
+  digitalWrite(9, HIGH);
+  TEST_ASSERT_EQUAL_INT(HIGH, hostPinLevel(9));
+  TEST_ASSERT_EQUAL_INT(-1, hostPwmValue(9));
+  TEST_ASSERT_EQUAL_INT(OUTPUT, hostPinMode(9));
+}
+
+void test_analog_write_clamps_and_sets_level_like_the_core() {
+  analogWrite(3, 300);
+  TEST_ASSERT_EQUAL_INT(255, hostPwmValue(3));
+  TEST_ASSERT_EQUAL_INT(HIGH, hostPinLevel(3));
+  analogWrite(3, 127);
+  TEST_ASSERT_EQUAL_INT(LOW, hostPinLevel(3));
+  analogWrite(3, -5);
+  TEST_ASSERT_EQUAL_INT(0, hostPwmValue(3));
+}
+
+void test_pwm_pins_match_the_uno() {
+  TEST_ASSERT_TRUE(digitalPinHasPWM(3));
+  TEST_ASSERT_TRUE(digitalPinHasPWM(11));
+  TEST_ASSERT_FALSE(digitalPinHasPWM(8));
+  TEST_ASSERT_FALSE(digitalPinHasPWM(13));
+}
+
+void test_inputs_read_what_models_drive_outputs_read_back() {
+  pinMode(4, INPUT);
+  TEST_ASSERT_EQUAL_INT(LOW, digitalRead(4));
+  hostDriveInput(4, HIGH);
+  TEST_ASSERT_EQUAL_INT(HIGH, digitalRead(4));
+  pinMode(5, OUTPUT);
+  hostDriveInput(5, HIGH);
+  digitalWrite(5, LOW);
+  TEST_ASSERT_EQUAL_INT(LOW, digitalRead(5));
+}
+
+void test_analog_read_uses_the_source_or_reads_zero() {
+  TEST_ASSERT_EQUAL_INT(0, analogRead(A2));
+  hostSetAnalogSource(analogSource);
+  TEST_ASSERT_EQUAL_INT(512, analogRead(A2));
+  TEST_ASSERT_EQUAL_INT(7, analogRead(A0));
+}
+
+void test_calls_charge_the_virtual_clock() {
+  uint64_t t0 = vclockNowUs();
+  analogRead(A0);
+  TEST_ASSERT_EQUAL_UINT32(hostCallCosts()->analogReadUs, (uint32_t)(vclockNowUs() - t0));
+  t0 = vclockNowUs();
+  delay(25);
+  TEST_ASSERT_EQUAL_UINT32(25000, (uint32_t)(vclockNowUs() - t0));
+  unsigned long ms = millis();
+  delayMicroseconds(3000);
+  TEST_ASSERT_EQUAL_UINT32(ms + 3, millis());
+}
+
+void test_pulse_in_follows_scheduled_edges() {
+  static uint8_t pin = 6;
+  pinMode(pin, INPUT);
+  hostDriveInput(pin, HIGH);
+  uint64_t t0 = vclockNowUs();
+  vclockSchedule(t0 + 100, dropInput, &pin);
+  vclockSchedule(t0 + 400, raiseInput, &pin);
+  TEST_ASSERT_EQUAL_UINT32(300, pulseIn(pin, LOW, 10000));
+  TEST_ASSERT_EQUAL_UINT32(0, pulseIn(pin, LOW, 1000));   // no edge: timeout
+}
+
+void test_pulse_in_from_a_source_blocks_as_told() {
+  hostSetPulseSource(pulseSource);
+  uint64_t t0 = vclockNowUs();
+  TEST_ASSERT_EQUAL_UINT32(120, pulseIn(6, LOW, 10000));
+  TEST_ASSERT_EQUAL_UINT32(250, (uint32_t)(vclockNowUs() - t0));
+}
+
+void test_servo_attach_and_write() {
+  Servo s;
+  s.attach(A3);
+  s.write(200);
+  TEST_ASSERT_EQUAL_INT(A3, hostServoPin(0));
+  TEST_ASSERT_EQUAL_INT(180, hostServoAngle(0));
+  TEST_ASSERT_EQUAL_INT(-1, hostServoAngle(1));
+}
+
+void test_serial_writes_reach_the_sink_and_reads_the_injection() {
+  hostSetSerialSink(sink);
+  Serial.print("ok");
+  Serial.write((uint8_t)0);
+  TEST_ASSERT_EQUAL_UINT32(3, sunkLen);
+  TEST_ASSERT_EQUAL_UINT8('o', sunk[0]);
+  TEST_ASSERT_EQUAL_UINT8(0, sunk[2]);
+  hostSerialInject("d\n");
+  TEST_ASSERT_EQUAL_INT(2, Serial.available());
+  TEST_ASSERT_EQUAL_INT('d', Serial.read());
+  TEST_ASSERT_EQUAL_INT('\n', Serial.read());
+  TEST_ASSERT_EQUAL_INT(-1, Serial.read());
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_digital_write_sets_level_and_clears_pwm);
+  RUN_TEST(test_analog_write_clamps_and_sets_level_like_the_core);
+  RUN_TEST(test_pwm_pins_match_the_uno);
+  RUN_TEST(test_inputs_read_what_models_drive_outputs_read_back);
+  RUN_TEST(test_analog_read_uses_the_source_or_reads_zero);
+  RUN_TEST(test_calls_charge_the_virtual_clock);
+  RUN_TEST(test_pulse_in_follows_scheduled_edges);
+  RUN_TEST(test_pulse_in_from_a_source_blocks_as_told);
+  RUN_TEST(test_servo_attach_and_write);
+  RUN_TEST(test_serial_writes_reach_the_sink_and_reads_the_injection);
+  return UNITY_END();
+}
@@ -0,0 +1,77 @@
+/**
+ * Reflectance array centroid (line_array.h).
+ */
+
+#include <unity.h>
+#include "Arduino.h"
+#include "hal_host.h"
+#include "line_array.h"
+
+static const uint8_t PINS[5] = { A0, A1, A2, A3, A4 };
+const uint16_t FLOOR_RAW = 100;
+const uint16_t LINE_RAW = 900;
+
+static LineArray arr;
+
+static int scanSource(uint8_t pin) {
+  return pin == A3 ? LINE_RAW : FLOOR_RAW;
+}
+
+void setUp() {
+  hostReset();
+  lineArrayBegin(&arr, PINS, 5, FLOOR_RAW, LINE_RAW);
+}
+
+void tearDown() {}
+
+void test_centred_line() {
+  const uint16_t raw[5] = { 100, 100, 900, 100, 100 };
+  LineReading r;
+  lineArrayEstimate(&arr, raw, &r);
+  TEST_ASSERT_EQUAL_INT16(0, r.position);
+  TEST_ASSERT_EQUAL_UINT16(LINE_PITCH_Q8, r.width);
+}
+
+void test_line_between_two_channels() {
+  const uint16_t raw[5] = { 100, 100, 100, 900, 900 };
+  LineReading r;
+  lineArrayEstimate(&arr, raw, &r);
+  TEST_ASSERT_EQUAL_INT16(3 * LINE_PITCH_Q8 / 2, r.position);
+  TEST_ASSERT_EQUAL_UINT16(2 * LINE_PITCH_Q8, r.width);
+}
+
+void test_partial_cover_pulls_the_centroid() {
+  const uint16_t raw[5] = { 100, 500, 900, 100, 100 };   // half a channel to the left
+  LineReading r;
+  lineArrayEstimate(&arr, raw, &r);
+  TEST_ASSERT_INT_WITHIN(2, -LINE_PITCH_Q8 / 3, r.position);
+}
+
+void test_noise_is_ignored_and_a_lost_line_stays_on_its_side() {
+  const uint16_t right[5] = { 100, 100, 100, 100, 900 };
+  const uint16_t noise[5] = { 120, 110, 100, 100, 100 };
+  LineReading r;
+  lineArrayEstimate(&arr, right, &r);
+  lineArrayEstimate(&arr, noise, &r);
+  TEST_ASSERT_EQUAL_UINT16(0, r.width);
+  TEST_ASSERT_EQUAL_INT16(2 * LINE_PITCH_Q8, r.position);
+}
+
+void test_read_scans_the_pins_left_to_right() {
+  hostSetAnalogSource(scanSource);
+  LineReading r;
+  lineArrayRead(&arr, &r);
+  TEST_ASSERT_EQUAL_INT16(LINE_PITCH_Q8, r.position);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_centred_line);
+  RUN_TEST(test_line_between_two_channels);
+  RUN_TEST(test_partial_cover_pulls_the_centroid);
+  RUN_TEST(test_noise_is_ignored_and_a_lost_line_stays_on_its_side);
+  RUN_TEST(test_read_scans_the_pins_left_to_right);
+  return UNITY_END();
+}
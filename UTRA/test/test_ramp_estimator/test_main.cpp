@@ -0,0 +1,148 @@
+/**
+ * Ramp state estimator (ramp_estimator.h), with and without the simulated
+ * accelerometer.
+ */
+
+#include <unity.h>
+#include "ramp_estimator.h"
+
+const int RAMP_SPEED = 200;
+const unsigned long STEP_MS = 20;
+
+static RampEstimator est;
+static unsigned long now = 0;
+
+// Drives at the estimator's throttle for ms, on or off the ramp lines.
+static void run(unsigned long ms, bool onBlack) {
+  for (unsigned long t = 0; t < ms; t += STEP_MS) {
+    now += STEP_MS;
+    rampEstimatorUpdate(&est, now, onBlack, onBlack ? rampThrottle(&est, RAMP_SPEED) : 0);
+  }
+}
+
+// Runs until the phase changes or ms passes; returns the new phase.
+static RampPhase runUntilChange(unsigned long ms, bool onBlack) {
+  RampPhase from = est.phase;
+  for (unsigned long t = 0; t < ms && est.phase == from; t += STEP_MS) run(STEP_MS, onBlack);
+  return est.phase;
+}
+
+void setUp() {
+  now = 0;
+  simulatedAccelSetFitted(true);
+  simulatedAccelSetPitch(0.0f);
+}
+
+void tearDown() {}
+
+void test_tape_and_travel_phases() {
+  rampEstimatorBegin(&est, now, NULL);
+  run(100, true);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_APPROACH, est.phase);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CLIMB, runUntilChange(200, true));
+  int climb = rampThrottle(&est, RAMP_SPEED);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_MID, runUntilChange(2000, true));
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CREST, runUntilChange(4000, true));
+  TEST_ASSERT_TRUE(rampIsAtTop(&est));
+  TEST_ASSERT_LESS_THAN(climb, rampThrottle(&est, RAMP_SPEED));   // braking
+  TEST_ASSERT_FALSE(rampIsSlipping(&est));
+}
+
+void test_top_needs_the_lines_to_run_out() {
+  rampEstimatorBegin(&est, now, NULL);
+  runUntilChange(400, true);
+  runUntilChange(2000, true);
+  runUntilChange(4000, true);
+  run(600, true);   // still on the lines
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CREST, est.phase);
+  run(200, false);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CREST, est.phase);   // not off long enough
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_TOP, runUntilChange(400, false));
+}
+
+void test_travel_without_observed_progress_is_slip() {
+  rampEstimatorBegin(&est, now, NULL);
+  runUntilChange(400, true);
+  int climb = rampThrottle(&est, RAMP_SPEED);
+  for (unsigned long t = 0; t < 10000 && !rampIsSlipping(&est); t += STEP_MS) run(STEP_MS, true);
+  TEST_ASSERT_TRUE(rampIsSlipping(&est));
+  TEST_ASSERT_NOT_EQUAL(RAMP_PHASE_TOP, est.phase);
+  TEST_ASSERT_EQUAL_INT(climb, rampThrottle(&est, RAMP_SPEED));   // not braking
+  run(400, false);   // the lines ran out after all
+  TEST_ASSERT_FALSE(rampIsSlipping(&est));
+}
+
+void test_rebaseline_gives_the_retry_its_own_budget() {
+  rampEstimatorBegin(&est, now, NULL);
+  runUntilChange(400, true);
+  for (unsigned long t = 0; t < 10000 && !rampIsSlipping(&est); t += STEP_MS) run(STEP_MS, true);
+  TEST_ASSERT_TRUE(rampIsSlipping(&est));
+  rampEstimatorRebaseline(&est);   // backed off, retrying
+  run(STEP_MS, true);
+  TEST_ASSERT_FALSE(rampIsSlipping(&est));
+  unsigned long retryMs = 0;
+  for (; retryMs < 10000 && !rampIsSlipping(&est); retryMs += STEP_MS) run(STEP_MS, true);
+  TEST_ASSERT_TRUE(rampIsSlipping(&est));   // stuck again
+  TEST_ASSERT_LESS_THAN(1500, retryMs);     // on a shorter budget
+}
+
+void test_low_pwm_travel_accumulates() {
+  rampEstimatorBegin(&est, now, NULL);
+  // PWM 10 in 2 ms steps is 20 um a step, but still gets up the ramp.
+  for (int i = 0; i < 100000 && est.phase < RAMP_PHASE_CREST; i++) {
+    now += 2;
+    rampEstimatorUpdate(&est, now, true, 10);
+  }
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CREST, est.phase);
+}
+
+void test_pitch_phases() {
+  rampEstimatorBegin(&est, now, simulatedAccelRead);
+  run(300, true);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_APPROACH, est.phase);   // level: dwell alone is not a climb
+  simulatedAccelSetPitch(15.0f);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CLIMB, runUntilChange(200, true));
+  TEST_ASSERT_TRUE(est.pitchValid);
+  TEST_ASSERT_GREATER_THAN(0, est.pitchDeg10);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_MID, runUntilChange(400, true));
+  run(200, true);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_MID, est.phase);   // travel alone does not crest
+  simulatedAccelSetPitch(3.0f);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CREST, runUntilChange(400, true));
+  simulatedAccelSetPitch(0.0f);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_TOP, runUntilChange(400, true));
+}
+
+void test_pitched_up_past_the_ramp_length_is_slip() {
+  rampEstimatorBegin(&est, now, simulatedAccelRead);
+  simulatedAccelSetPitch(15.0f);
+  runUntilChange(200, true);
+  for (unsigned long t = 0; t < 10000 && !rampIsSlipping(&est); t += STEP_MS) run(STEP_MS, true);
+  TEST_ASSERT_TRUE(rampIsSlipping(&est));
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_MID, est.phase);
+}
+
+void test_unfitted_accelerometer_falls_back_to_tape() {
+  simulatedAccelSetFitted(false);
+  int16_t ax, az;
+  TEST_ASSERT_FALSE(simulatedAccelRead(&ax, &az));
+  rampEstimatorBegin(&est, now, simulatedAccelRead);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_CLIMB, runUntilChange(400, true));
+  TEST_ASSERT_FALSE(est.pitchValid);
+  TEST_ASSERT_EQUAL_INT(RAMP_PHASE_MID, runUntilChange(2000, true));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_tape_and_travel_phases);
+  RUN_TEST(test_top_needs_the_lines_to_run_out);
+  RUN_TEST(test_travel_without_observed_progress_is_slip);
+  RUN_TEST(test_rebaseline_gives_the_retry_its_own_budget);
+  RUN_TEST(test_low_pwm_travel_accumulates);
+  RUN_TEST(test_pitch_phases);
+  RUN_TEST(test_pitched_up_past_the_ramp_length_is_slip);
+  RUN_TEST(test_unfitted_accelerometer_falls_back_to_tape);
+  return UNITY_END();
+}
@@ -0,0 +1,133 @@
+/**
+ * Stall and wheel-slip detector (stall_detector.h).
+ */
+
+#include <unity.h>
+#include "stall_detector.h"
+
+const unsigned long WINDOW_MS = 1000;
+const unsigned long BACKOFF_MS = 300;
+
+static StallDetector d;
+
+void setUp() {
+  stallBegin(&d, 0, WINDOW_MS, BACKOFF_MS, 2);
+}
+
+void tearDown() {}
+
+void test_no_progress_for_a_window_backs_off_then_retries() {
+  TEST_ASSERT_FALSE(stallUpdate(&d, 0, true));
+  TEST_ASSERT_FALSE(stallUpdate(&d, WINDOW_MS - 1, true));
+  TEST_ASSERT_TRUE(stallUpdate(&d, WINDOW_MS, true));
+  TEST_ASSERT_EQUAL_INT(STALL_PHASE_BACK_OFF, d.phase);
+  TEST_ASSERT_TRUE(stallUpdate(&d, WINDOW_MS + BACKOFF_MS - 1, true));
+  TEST_ASSERT_FALSE(stallUpdate(&d, WINDOW_MS + BACKOFF_MS, true));
+  TEST_ASSERT_EQUAL_INT(STALL_PHASE_WATCH, d.phase);
+  TEST_ASSERT_EQUAL_UINT8(1, d.retries);
+  TEST_ASSERT_EQUAL_INT(125, stallRetryPwm(&d, 100, 25));
+}
+
+void test_gives_up_after_max_retries() {
+  unsigned long t = 0;
+  for (int i = 0; i < 2; i++) {
+    stallUpdate(&d, t, true);
+    t += WINDOW_MS;
+    TEST_ASSERT_TRUE(stallUpdate(&d, t, true));
+    t += BACKOFF_MS;
+    stallUpdate(&d, t, true);
+  }
+  t += WINDOW_MS;
+  TEST_ASSERT_FALSE(stallUpdate(&d, t, true));
+  TEST_ASSERT_EQUAL_INT(STALL_PHASE_OFF, d.phase);
+  TEST_ASSERT_FALSE(stallUpdate(&d, t + 10 * WINDOW_MS, true));
+}
+
+void test_colour_and_range_changes_are_progress() {
+  stallUpdate(&d, 0, true);
+  stallNoteColour(&d, 100, 4);
+  stallNoteColour(&d, 800, 0);      // changed
+  TEST_ASSERT_FALSE(stallUpdate(&d, 1500, true));
+  stallNoteRange(&d, 1500, 40);
+  stallNoteRange(&d, 1700, 41);     // jitter, not progress
+  stallNoteRange(&d, 2200, 36);
+  TEST_ASSERT_FALSE(stallUpdate(&d, 3000, true));
+  TEST_ASSERT_TRUE(stallUpdate(&d, 3200, true));
+}
+
+// One long black stretch: the colour never changes, the estimator's
+// verdict is what keeps the window open.
+void test_moving_verdict_is_progress() {
+  stallUpdate(&d, 0, true);
+  for (unsigned long t = 100; t <= 3 * WINDOW_MS; t += 100) {
+    stallNoteColour(&d, t, 4);
+    stallNoteMoving(&d, t, true);
+    TEST_ASSERT_FALSE(stallUpdate(&d, t, true));
+  }
+  unsigned long slipFrom = 3 * WINDOW_MS;
+  stallNoteMoving(&d, slipFrom + 100, false);
+  TEST_ASSERT_FALSE(stallUpdate(&d, slipFrom + WINDOW_MS - 1, true));
+  TEST_ASSERT_TRUE(stallUpdate(&d, slipFrom + WINDOW_MS, true));
+}
+
+void test_time_not_driving_is_not_counted() {
+  stallUpdate(&d, 0, true);
+  stallUpdate(&d, 500, false);
+  TEST_ASSERT_FALSE(stallUpdate(&d, 5000, true));
+  TEST_ASSERT_FALSE(stallUpdate(&d, 5000 + WINDOW_MS - 1, true));
+}
+
+void test_encoders_shorten_the_window() {
+  stallUpdate(&d, 0, true);
+  stallNoteTicks(&d, 10, 3);
+  TEST_ASSERT_FALSE(stallUpdate(&d, 10 + STALL_ENCODER_MS - 1, true));
+  TEST_ASSERT_TRUE(stallUpdate(&d, 10 + STALL_ENCODER_MS, true));
+}
+
+void test_held_over_current_is_a_stall() {
+  stallUpdate(&d, 0, true);
+  stallNoteCurrent(&d, 100, 1800, 1500);
+  stallNoteCurrent(&d, 200, 1900, 1500);
+  TEST_ASSERT_FALSE(stallUpdate(&d, 100 + STALL_CURRENT_MS - 1, true));
+  TEST_ASSERT_TRUE(stallUpdate(&d, 100 + STALL_CURRENT_MS, true));
+}
+
+void test_held_slip_verdict_is_a_stall() {
+  stallUpdate(&d, 0, true);
+  stallNoteSlipping(&d, 100, true);
+  stallNoteSlipping(&d, 200, true);
+  TEST_ASSERT_FALSE(stallUpdate(&d, 100 + STALL_SLIP_MS - 1, true));
+  TEST_ASSERT_TRUE(stallUpdate(&d, 100 + STALL_SLIP_MS, true));
+  // The back-off clears the verdict; the retry is not backed off again.
+  TEST_ASSERT_FALSE(stallUpdate(&d, 100 + STALL_SLIP_MS + BACKOFF_MS, true));
+  TEST_ASSERT_FALSE(stallUpdate(&d, 100 + STALL_SLIP_MS + BACKOFF_MS + STALL_SLIP_MS, true));
+}
+
+void test_progress_after_a_retry_resets_the_count() {
+  stallUpdate(&d, 0, true);
+  TEST_ASSERT_TRUE(stallUpdate(&d, WINDOW_MS, true));
+  unsigned long retryMs = WINDOW_MS + BACKOFF_MS;
+  stallUpdate(&d, retryMs, true);
+  stallNoteColour(&d, retryMs, 4);
+  stallNoteColour(&d, retryMs + 500, 0);   // only backing in again
+  TEST_ASSERT_EQUAL_UINT8(1, d.retries);
+  stallNoteColour(&d, retryMs + WINDOW_MS, 4);
+  TEST_ASSERT_EQUAL_UINT8(0, d.retries);
+  TEST_ASSERT_EQUAL_INT(100, stallRetryPwm(&d, 100, 25));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_no_progress_for_a_window_backs_off_then_retries);
+  RUN_TEST(test_gives_up_after_max_retries);
+  RUN_TEST(test_colour_and_range_changes_are_progress);
+  RUN_TEST(test_moving_verdict_is_progress);
+  RUN_TEST(test_time_not_driving_is_not_counted);
+  RUN_TEST(test_encoders_shorten_the_window);
+  RUN_TEST(test_held_over_current_is_a_stall);
+  RUN_TEST(test_held_slip_verdict_is_a_stall);
+  RUN_TEST(test_progress_after_a_retry_resets_the_count);
+  return UNITY_END();
+}
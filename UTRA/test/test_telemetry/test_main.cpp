@@ -0,0 +1,130 @@
+/**
+ * Telemetry framing (telemetry.h): CRC-16/CCITT, COBS and the record layouts
+ * the bridge and trace-replay decode.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "telemetry.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_crc16_check_value() {
+  const char *check = "123456789";
+  TEST_ASSERT_EQUAL_HEX16(0x29B1, telemetryCrc16((const uint8_t *)check, strlen(check)));
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, telemetryCrc16(NULL, 0));
+}
+
+void test_cobs_replaces_zeros() {
+  const uint8_t in[] = { 0x11, 0x00, 0x22, 0x33, 0x00 };
+  const uint8_t expect[] = { 0x02, 0x11, 0x03, 0x22, 0x33, 0x01 };
+  uint8_t out[8];
+  TEST_ASSERT_EQUAL_UINT32(sizeof(expect), cobsEncode(in, sizeof(in), out));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expect, out, sizeof(expect));
+}
+
+void test_cobs_without_zeros_and_empty() {
+  const uint8_t in[] = { 0x01, 0x02, 0x03 };
+  const uint8_t expect[] = { 0x04, 0x01, 0x02, 0x03 };
+  uint8_t out[8];
+  TEST_ASSERT_EQUAL_UINT32(sizeof(expect), cobsEncode(in, sizeof(in), out));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expect, out, sizeof(expect));
+  TEST_ASSERT_EQUAL_UINT32(1, cobsEncode(in, 0, out));
+  TEST_ASSERT_EQUAL_UINT8(0x01, out[0]);
+}
+
+void test_cobs_output_has_no_zero_bytes() {
+  uint8_t in[TELEMETRY_MAX_PAYLOAD];
+  for (uint8_t i = 0; i < sizeof(in); i++) in[i] = (uint8_t)(i % 3 == 0 ? 0 : i);
+  uint8_t out[TELEMETRY_MAX_FRAME];
+  size_t n = cobsEncode(in, sizeof(in), out);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(in) + 1, n);
+  for (size_t i = 0; i < n; i++) TEST_ASSERT_NOT_EQUAL(0, out[i]);
+}
+
+void test_sensor_record_layout() {
+  SensorFrame frame = SensorFrame();
+  frame.tMs = 0x12345;
+  frame.redPW = 0x0102;
+  frame.greenPW = 40;
+  frame.bluePW = 50;
+  frame.colour = 3;
+  frame.distanceCm = 9999;
+  uint8_t out[TELEMETRY_MAX_PAYLOAD];
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_SENSOR_LEN, telemetryPackSensor(out, &frame, 7));
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_SENSOR, out[0]);
+  TEST_ASSERT_EQUAL_UINT8(7, out[1]);
+  TEST_ASSERT_EQUAL_UINT8(0x45, out[2]);     // t wraps at 16 bits, little-endian
+  TEST_ASSERT_EQUAL_UINT8(0x23, out[3]);
+  TEST_ASSERT_EQUAL_UINT8(0x02, out[4]);     // widths whole, not saturated at 255
+  TEST_ASSERT_EQUAL_UINT8(0x01, out[5]);
+  TEST_ASSERT_EQUAL_UINT8(40, out[6]);
+  TEST_ASSERT_EQUAL_UINT8(50, out[8]);
+  TEST_ASSERT_EQUAL_UINT8(3, out[10]);
+  TEST_ASSERT_EQUAL_UINT8(9999 & 0xFF, out[11]);
+  TEST_ASSERT_EQUAL_UINT8(9999 >> 8, out[12]);
+}
+
+void test_line_record_layout() {
+  SensorFrame frame = SensorFrame();
+  frame.tMs = 0x12345;
+  frame.linePos = -384;      // 1.5 channel pitches left
+  frame.lineWidth = 512;
+  uint8_t out[TELEMETRY_MAX_PAYLOAD];
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_LINE_LEN, telemetryPackLine(out, &frame, 2));
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_LINE, out[0]);
+  TEST_ASSERT_EQUAL_UINT8(2, out[1]);
+  TEST_ASSERT_EQUAL_UINT8(0x45, out[2]);
+  TEST_ASSERT_EQUAL_UINT8(0x23, out[3]);
+  TEST_ASSERT_EQUAL_UINT8(0x80, out[4]);     // -384 = 0xFE80
+  TEST_ASSERT_EQUAL_UINT8(0xFE, out[5]);
+  TEST_ASSERT_EQUAL_UINT8(0x00, out[6]);
+  TEST_ASSERT_EQUAL_UINT8(0x02, out[7]);
+}
+
+static uint8_t tapped[4];
+static uint8_t tapCount = 0;
+
+static void recordTap(const uint8_t *payload, uint8_t len) {
+  (void)len;
+  if (tapCount < sizeof(tapped)) tapped[tapCount] = payload[0];
+  tapCount++;
+}
+
+void test_line_record_follows_sensor_only_with_a_reading() {
+  telemetrySetTap(recordTap);
+  SensorFrame frame = SensorFrame();
+  tapCount = 0;
+  telemetrySendSensor(&frame, 0);
+  TEST_ASSERT_EQUAL_UINT8(1, tapCount);
+
+  frame.lineWidth = 256;
+  tapCount = 0;
+  telemetrySendSensor(&frame, 0);
+  TEST_ASSERT_EQUAL_UINT8(2, tapCount);
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_SENSOR, tapped[0]);
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_LINE, tapped[1]);
+
+  // Lost line: no width, but the side it was last seen on still goes out.
+  frame.lineWidth = 0;
+  frame.linePos = 512;
+  tapCount = 0;
+  telemetrySendSensor(&frame, 0);
+  TEST_ASSERT_EQUAL_UINT8(2, tapCount);
+  telemetrySetTap(NULL);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_crc16_check_value);
+  RUN_TEST(test_cobs_replaces_zeros);
+  RUN_TEST(test_cobs_without_zeros_and_empty);
+  RUN_TEST(test_cobs_output_has_no_zero_bytes);
+  RUN_TEST(test_sensor_record_layout);
+  RUN_TEST(test_line_record_layout);
+  RUN_TEST(test_line_record_follows_sensor_only_with_a_reading);
+  return UNITY_END();
+}